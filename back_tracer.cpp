@@ -1,52 +1,54 @@
 #include "back_tracer.h"
 
-void getRSP(uint64_t *rsp) {
-  __asm__ __volatile__("mov %%rsp, %0" : "=m"(*rsp)::"memory");
+// CCT of the current thread, registered in CPUCCTRegistry
+static thread_local CPUCCT *threadCPUCCT = nullptr;
+
+BackTracer::BackTracer() {
+  switch (GetFrameClassifierKind(GetProfilerConf()->backEnd)) {
+  case FRAME_CLASSIFIER_TORCH:
+    generateCallStack = &BackTracer::GenerateCallStack<TorchFrameClassifier>;
+    break;
+  case FRAME_CLASSIFIER_TF:
+    generateCallStack = &BackTracer::GenerateCallStack<TFFrameClassifier>;
+    break;
+  default:
+    generateCallStack = &BackTracer::GenerateCallStack<CxxFrameClassifier>;
+    break;
+  }
 }
 
+template <typename Classifier>
 CallStackStatus BackTracer::GenerateCallStack(std::stack<UNWValue> &q,
-                                         bool verbose /*=false*/) {
+                                              bool verbose /*=false*/) {
   std::queue<UNWValue> pyFrameQueue;
   CallStackStatus status;
-  if (GetProfilerConf()->doPyUnwinding)
+  if (Classifier::kCapturesPyFrames)
     pyBackTrace(pyFrameQueue);
   if (pyFrameQueue.size())
     status = CALL_STACK_HAS_PY;
   else
     status = CALL_STACK_NOT_HAS_PY;
 
-  unw_cursor_t cursor;
-  unw_context_t context;
-
-  unw_getcontext(&context);
-  unw_init_local(&cursor, &context);
-
-  while (unw_step(&cursor) > 0) {
-    unw_word_t offset, pc;
-    char fname[FUNC_NAME_LENGTH];
-    char *outer_name;
+  // skip the frame of GenerateCallStack
+  uint64_t pcs[MAX_UNWIND_DEPTH];
+  size_t depth = GetUnwinder()->unwind(pcs, MAX_UNWIND_DEPTH, 1);
 
-    unw_get_reg(&cursor, UNW_REG_IP, &pc);
-    unw_get_proc_name(&cursor, fname, sizeof(fname), &offset);
-    int status = 99;
-    if ((outer_name = abi::__cxa_demangle(fname, nullptr, nullptr, &status)) ==
-        0) {
-      outer_name = fname;
-    }
-
-    // skip cupti-related stack frames
-    if (HasExcludePatterns(outer_name))
+  ModuleFilter *moduleFilter = ModuleFilter::GetModuleFilter();
+  for (size_t i = 0; i < depth; ++i) {
+    uint64_t pc = pcs[i];
+    // skip the frames of cupti, cuda and the profiler before symbolizing
+    if (moduleFilter->isExcluded(pc))
       continue;
+    PCSymbol symbol = ResolvePCSymbol(pc);
 
-    if (GetProfilerConf()->doPyUnwinding &&
-        std::string(outer_name).find("_PyEval_EvalFrameDefault") !=
-            std::string::npos) {
+    if (Classifier::kCapturesPyFrames && !pyFrameQueue.empty() &&
+        Classifier::IsInterpreterFrame(pc)) {
       UNWValue value = pyFrameQueue.front();
       value.pc = pc + value.offset; // use native pc plus offset as PyFrame pc
       q.push(value);
       pyFrameQueue.pop();
     } else {
-      UNWValue value(pc, offset, std::string(outer_name));
+      UNWValue value(pc, symbol.offset, GetSymbol(symbol.funcNameId));
       q.push(value);
     }
     if (verbose) {
@@ -62,29 +64,9 @@ void BackTracer::DoBackTrace(bool verbose) {
   Timer *timer = Timer::GetGlobalTimer("back_tracer");
   timer->start();
 #endif
-  auto CPUCCTMap = GetCPUCCTMap();
-  pthread_t tid = pthread_self();
-  if (CPUCCTMap->find(tid) == CPUCCTMap->end()) {
-    DEBUG_LOG("new CCT, tid=%d\n", gettid());
-    CPUCCT *newCCT = new CPUCCT();
-    CPUCCTNode *vRootNode = new CPUCCTNode();
-
-    CPUCCTNodeIdMutex.lock();
-    vRootNode->id = CPUCCTNodeId;
-    ++CPUCCTNodeId;
-    CPUCCTNodeIdMutex.unlock();
-
-    vRootNode->funcName = "thread:" + std::to_string(gettid()) +
-                          "::id:" + std::to_string(vRootNode->id);
-    vRootNode->pc = 0;
-    vRootNode->offset = 0;
-    vRootNode->nodeType = CCTNODE_TYPE_CXX;
-
-    newCCT->setRootNode(vRootNode);
-    CPUCCTMap->insert({tid, newCCT});
-  }
-
-  CPUCCT *cpuCCT = CPUCCTMap->at(tid);
+  if (!threadCPUCCT)
+    threadCPUCCT = GetThreadCPUCCT(gettid());
+  CPUCCT *cpuCCT = threadCPUCCT;
 
   // If GetProfilerConf()->fakeBT is true, do not perform cpu
   // call stack unwinding.
@@ -99,55 +81,73 @@ void BackTracer::DoBackTrace(bool verbose) {
     return;
   }
 
-  // Optimization of cpu call stack unwinding: check the rsp register first.
-  uint64_t rsp;
-  getRSP(&rsp);
-  if (verbose)
-    DEBUG_LOG("rsp=%p\n", (void *)rsp);
-  if (GetProfilerConf()->checkRSP && 
-      esp2pcIdMap.find(rsp) != esp2pcIdMap.end()) {
-    uint64_t pcId = esp2pcIdMap[rsp];
-    activeCPUPCIDMutex.lock();
-    activeCPUPCID = pcId;
-    activeCPUPCIDMutex.unlock();
-    DEBUG_LOG("already unwound, active pc id changed to %lu\n", pcId);
-    return;
+  // Optimization of cpu call stack unwinding: look the stack signature up
+  // first, unwinding anyway to verify some of the hits.
+  StackSignatureCache *stackCache = nullptr;
+  StackSignature signature;
+  uint64_t cachedPCId = 0;
+  bool verifyingHit = false;
+  if (GetProfilerConf()->checkRSP) {
+    stackCache = StackSignatureCache::GetThreadCache();
+    GetStackSignature(signature, GetProfilerConf()->stackSignatureDepth);
+    // python frames are not on the native stack, the main python stack
+    // changes with every python call
+    if (GetProfilerConf()->doPyUnwinding)
+      signature.context = MainPyStack::GetMainPyStack()->getGeneration();
+    if (verbose)
+      DEBUG_LOG("rsp=%p\n", (void *)signature.rsp);
+    if (stackCache->lookup(signature, cachedPCId)) {
+      verifyingHit = stackCache->shouldVerify();
+      if (!verifyingHit) {
+        activeCPUPCIDMutex.lock();
+        activeCPUPCID = cachedPCId;
+        activeCPUPCIDMutex.unlock();
+        DEBUG_LOG("already unwound, active pc id changed to %lu\n",
+                  cachedPCId);
+        return;
+      }
+    }
   }
 
   // nodes to be inserted to the cpu calling context tree
   std::stack<UNWValue> toInsertUNW;
   std::stack<UNWValue> toInsertUNWMain;
 
-  auto status = GenerateCallStack(toInsertUNW, verbose);
+  // python frames of the main thread are tracked for the other threads
+  if (GetProfilerConf()->doPyUnwinding)
+    MainPyStack::GetMainPyStack()->reinstallIfMainThread();
+
+  auto status = (this->*generateCallStack)(toInsertUNW, verbose);
 
   // if the backend is Pytorch, and current thread has not PyFrame
-  // go to the main thread for PyFrame
+  // take the python frames of the main thread
   if (GetProfilerConf()->doPyUnwinding && status == CALL_STACK_NOT_HAS_PY) {
-    DEBUG_LOG("this thread has not PyFrame, going to the main thread\n");
-    handlingRemoteUnwinding = true;
-    pthread_kill(GetProfilerConf()->mainThreadTid, SIGUSR1);
-    while (handlingRemoteUnwinding) {
+    std::vector<PyFrameInfo> mainPyFrames;
+    if (MainPyStack::GetMainPyStack()->read(mainPyFrames)) {
+      for (auto itr = mainPyFrames.rbegin(); itr != mainPyFrames.rend();
+           ++itr) {
+        UNWValue value(GetSymbol(itr->fileNameId), GetSymbol(itr->funcNameId),
+                       itr->lineNumber);
+        value.pc = MainPyStack::FramePC(*itr);
+        toInsertUNWMain.push(value);
+      }
+    } else {
+      DEBUG_LOG("python stack of the main thread not available\n");
     }
-    toInsertUNWMain = g_callStack;
-    // TODO: clear the stack or not ?
-    while (!g_callStack.empty())
-      g_callStack.pop();
   }
 
-
-
+  CPUCCTWriteGuard writeGuard(cpuCCT);
   CPUCCTNode *parentNode = cpuCCT->root;
   while (!toInsertUNW.empty()) {
     UNWValue value;
     TOP2(toInsertUNWMain, toInsertUNW, value);
-    CPUCCTNode *childNode = parentNode->getChildbyPC(value.pc);
+    CPUCCTNode *childNode = cpuCCT->getChildbyPC(parentNode, value.pc);
     // if finding a CXX node with _PyEval_EvalFrameDefault (C2P node)
     //     replace it with PY node
     if (childNode) {
       if (childNode->nodeType == CCTNODE_TYPE_C2P) {
         if (value.nodeType == CCTNODE_TYPE_PY) {
-          childNode->nodeType = CCTNODE_TYPE_PY;
-          childNode->funcName = value.funcName;
+          cpuCCT->renameNode(childNode, CCTNODE_TYPE_PY, value.funcName);
           DEBUG_LOG("py node renamed in unwinding: %s\n",
                     value.funcName.c_str());
         } else {
@@ -162,10 +162,13 @@ void BackTracer::DoBackTrace(bool verbose) {
     }
   }
 
+  // id of the leaf of the call path
+  uint64_t leafPCId = 0;
+
   // the call path has been searched before
   if (toInsertUNW.empty()) {
     activeCPUPCIDMutex.lock();
-    activeCPUPCID = parentNode->id;
+    activeCPUPCID = leafPCId = parentNode->id;
     if (verbose)
       DEBUG_LOG("old pc, active pc changed to %lu:%p\n", parentNode->id,
                 (void *)(parentNode->pc));
@@ -176,23 +179,27 @@ void BackTracer::DoBackTrace(bool verbose) {
   while (!toInsertUNW.empty()) {
     UNWValue value;
     TOP2(toInsertUNWMain, toInsertUNW, value);
-    CPUCCTNode *newNode = new CPUCCTNode(value.nodeType);
+    CPUCCTNode *newNode = cpuCCT->newNode(value.nodeType);
+    // the tree is full, the path is cut at its deepest node
+    if (!newNode) {
+      activeCPUPCIDMutex.lock();
+      activeCPUPCID = leafPCId = parentNode->id;
+      activeCPUPCIDMutex.unlock();
+      break;
+    }
 
     newNode->pc = value.pc;
     newNode->offset = value.offset;
 
-    CPUCCTNodeIdMutex.lock();
-    newNode->id = CPUCCTNodeId;
-    ++CPUCCTNodeId;
-    CPUCCTNodeIdMutex.unlock();
+    newNode->id = CPUCCTNodeIdAllocator::NextId();
 
     if (value.nodeType == CCTNODE_TYPE_CXX) {
-      newNode->funcName = 
-          value.funcName; // + "_" + std::to_string(newNode->id);
+      newNode->setFuncName(
+          value.funcName); // + "_" + std::to_string(newNode->id);
     } else {
-      newNode->funcName = value.fileName + "::" + value.funcName + "_" +
-                          std::to_string(value.offset) + "_";
-                          // + std::to_string(newNode->id);
+      newNode->setFuncName(value.fileName + "::" + value.funcName + "_" +
+                           std::to_string(value.offset) + "_");
+                           // + std::to_string(newNode->id);
     }
 
     // leaf node
@@ -201,8 +208,7 @@ void BackTracer::DoBackTrace(bool verbose) {
       if (verbose)
         DEBUG_LOG("active pc changed to %lu:%p\n", newNode->id,
                   (void *)(newNode->pc));
-      activeCPUPCID = newNode->id;
-      esp2pcIdMap[rsp] = newNode->id;
+      activeCPUPCID = leafPCId = newNode->id;
       activeCPUPCIDMutex.unlock();
     }
 
@@ -210,6 +216,16 @@ void BackTracer::DoBackTrace(bool verbose) {
     parentNode = newNode;
     POP2(toInsertUNWMain, toInsertUNW);
   }
+
+  if (stackCache) {
+    if (verifyingHit && cachedPCId != leafPCId) {
+      stackCache->countFalseHit();
+      if (verbose)
+        DEBUG_LOG("false stack cache hit, cached=%lu, unwound=%lu\n",
+                  cachedPCId, leafPCId);
+    }
+    stackCache->insert(signature, leafPCId);
+  }
 #if DEBUG
   timer->stop();
 #endif
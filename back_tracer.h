@@ -9,8 +9,15 @@
 #include <libunwind.h>
 
 #include "calling_ctx_tree.h"
+#include "cct_pruner.h"
 #include "common.h"
 #include "cpu_sampler.h"
+#include "elf_symbolizer.h"
+#include "frame_classifier.h"
+#include "main_py_stack.h"
+#include "py_frame_cache.h"
+#include "stack_signature_cache.h"
+#include "unwinder.h"
 #include "utils.h"
 
 
@@ -44,25 +51,6 @@ static inline void PrintUNWValue(UNWValue &val) {
             (uint32_t)tid, val.pc, val.funcName.c_str(), val.offset);
 }
 
-static const char *PyObj2Str(PyObject *obj) {
-  PyObject *str = PyUnicode_AsEncodedString(obj, "utf-8", "~E~");
-  const char *bytes = PyBytes_AS_STRING(str);
-  return bytes;
-}
-
-static std::string GetPyLine(std::string pyFileName, int pyLineNumer) {
-  std::fstream inFile;
-  std::string lineStr;
-  inFile.open(pyFileName);
-  int i = 1;
-  while (std::getline(inFile, lineStr) && i < pyLineNumer)
-    ++i;
-  inFile.close();
-  lineStr.erase(std::remove(lineStr.begin(), lineStr.end(), ' '),
-                lineStr.end());
-  return lineStr;
-}
-
 static void pyBackTrace(std::queue<UNWValue> &pyFrameQueue) {
   DEBUG_LOG("[py back trace] entered\n");
   PyInterpreterState *mainInterpState = PyInterpreterState_Main();
@@ -71,30 +59,20 @@ static void pyBackTrace(std::queue<UNWValue> &pyFrameQueue) {
   PyThreadState *pyState = PyGILState_GetThisThreadState();
   PyFrameObject *frame = pyState->frame;
   while (frame) {
-    PyObject *fileNameObj = frame->f_code->co_filename;
-    PyObject *funcNameObj = frame->f_code->co_name;
-    const char *fileNameStr = PyObj2Str(fileNameObj);
-    const char *funcNameStr = PyObj2Str(funcNameObj);
-    int lineNumber = PyFrame_GetLineNumber(frame);
-    std::string lineContent = GetPyLine(fileNameStr, lineNumber);
-    // DEBUG_LOG("[py back trace] fileName: %s, funcName:%s, lineNumber:%d,
-    // lineContent:%s\n", fileNameStr, funcNameStr, lineNumber,
-    // lineContent.c_str());
-    pyFrameQueue.push(UNWValue(fileNameStr,
-                               std::string(funcNameStr) + "::" + lineContent,
-                               lineNumber));
+    PyFrameInfo info = PyFrameCache::GetPyFrameCache()->resolve(frame);
+    pyFrameQueue.push(UNWValue(GetSymbol(info.fileNameId),
+                               GetSymbol(info.funcNameId), info.lineNumber));
     frame = frame->f_back;
   }
 }
 
 class BackTracer {
 public:
-  BackTracer() {};
+  BackTracer();
   BackTracer(const BackTracer &) = delete;
   BackTracer &operator=(const BackTracer) = delete;
 
   static BackTracer *GetBackTracerSingleton();
-  CallStackStatus GenerateCallStack(std::stack<UNWValue> &q, bool verbose = false);
   void DoBackTrace(bool verbose);
 
   void SetCorId2ActivePCID(uint32_t corId) {
@@ -102,18 +80,18 @@ public:
     DEBUG_LOG("corId %u --> active PC ID %lu\n", corId, activeCPUPCID);
   }
 
-  bool handlingRemoteUnwinding;
-  std::stack<UNWValue> g_callStack;
-
 private:
-  std::unordered_map<uint64_t, uint64_t> esp2pcIdMap;
+  // GenerateCallStack specialized for the frame classifier of the backend,
+  // see frame_classifier.h
+  template <typename Classifier>
+  CallStackStatus GenerateCallStack(std::stack<UNWValue> &q,
+                                    bool verbose = false);
+  CallStackStatus (BackTracer::*generateCallStack)(std::stack<UNWValue> &q,
+                                                   bool verbose);
 
   std::recursive_mutex activeCPUPCIDMutex;
   unw_word_t activeCPUPCID;
 
-  std::mutex CPUCCTNodeIdMutex;
-  uint64_t CPUCCTNodeId = 1;
-
   std::unordered_map<uint32_t, unw_word_t> corId2ActivePCIDMap;
 
   friend class CPUCallStackSampler;
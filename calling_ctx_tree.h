@@ -1,13 +1,18 @@
 #pragma once
+#include <atomic>
 #include <iostream>
 #include <mutex>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string>
+#include <sys/types.h>
 #include <unordered_map>
 #include <vector>
 
 #include <libunwind.h>
 
+#include "symbol_table.h"
+
 typedef enum {
   // null node
   NULL_NODE = 0,
@@ -31,112 +36,580 @@ typedef enum {
   CCTNODE_TYPE_C2P = 2
 } CCTNodeType;
 
+// Index of a node inside the arena of the CPUCCT owning it. Tree relations
+// are stored as indices rather than pointers to keep nodes compact.
+typedef uint32_t CCTNodeIdx;
+#define CCT_NULL_IDX ((CCTNodeIdx)0xffffffff)
+
+// Lookup table from the pc of a child node to its index. Up to kInlineChilds
+// children are kept in a sorted array inside the node itself, larger fan-outs
+// switch to an open-addressing table with linear probing.
+class CCTChildIndex {
+public:
+  static const uint32_t kInlineChilds = 4;
+
+  CCTChildIndex() : n(0){};
+  ~CCTChildIndex() { clear(); }
+
+  CCTChildIndex(const CCTChildIndex &) = delete;
+  CCTChildIndex &operator=(const CCTChildIndex &) = delete;
+
+  CCTNodeIdx find(uint64_t pc) const {
+    if (n <= kInlineChilds) {
+      for (uint32_t i = 0; i < n && small.pcs[i] <= pc; ++i) {
+        if (small.pcs[i] == pc)
+          return small.idxs[i];
+      }
+      return CCT_NULL_IDX;
+    }
+    uint32_t mask = large.capacity - 1;
+    for (uint32_t i = hash(pc) & mask;; i = (i + 1) & mask) {
+      const Slot &slot = large.slots[i];
+      if (slot.idx == CCT_NULL_IDX || slot.pc == pc)
+        return slot.idx;
+    }
+  }
+
+  // the caller guarantees that pc is not in the index yet
+  void insert(uint64_t pc, CCTNodeIdx idx) {
+    if (n < kInlineChilds) {
+      uint32_t i = n;
+      for (; i > 0 && small.pcs[i - 1] > pc; --i) {
+        small.pcs[i] = small.pcs[i - 1];
+        small.idxs[i] = small.idxs[i - 1];
+      }
+      small.pcs[i] = pc;
+      small.idxs[i] = idx;
+    } else {
+      if (n == kInlineChilds) {
+        Slot inlineSlots[kInlineChilds];
+        for (uint32_t i = 0; i < kInlineChilds; ++i)
+          inlineSlots[i] = {small.pcs[i], small.idxs[i]};
+        allocTable(kInlineChilds * 4);
+        for (uint32_t i = 0; i < kInlineChilds; ++i)
+          insertSlot(inlineSlots[i]);
+      } else if ((n + 1) * 2 > large.capacity) {
+        // keep the load factor below 1/2
+        Slot *oldSlots = large.slots;
+        uint32_t oldCapacity = large.capacity;
+        allocTable(oldCapacity * 2);
+        for (uint32_t i = 0; i < oldCapacity; ++i) {
+          if (oldSlots[i].idx != CCT_NULL_IDX)
+            insertSlot(oldSlots[i]);
+        }
+        delete[] oldSlots;
+      }
+      insertSlot({pc, idx});
+    }
+    ++n;
+  }
+
+  void clear() {
+    if (n > kInlineChilds)
+      delete[] large.slots;
+    n = 0;
+  }
+
+  uint32_t size() const { return n; }
+
+private:
+  struct Slot {
+    uint64_t pc;
+    CCTNodeIdx idx;
+  };
+
+  static uint32_t hash(uint64_t pc) {
+    return (uint32_t)((pc * 0x9e3779b97f4a7c15ull) >> 32);
+  }
+
+  void allocTable(uint32_t capacity) {
+    large.slots = new Slot[capacity];
+    large.capacity = capacity;
+    for (uint32_t i = 0; i < capacity; ++i)
+      large.slots[i].idx = CCT_NULL_IDX;
+  }
+
+  void insertSlot(const Slot &slot) {
+    uint32_t mask = large.capacity - 1;
+    uint32_t i = hash(slot.pc) & mask;
+    while (large.slots[i].idx != CCT_NULL_IDX)
+      i = (i + 1) & mask;
+    large.slots[i] = slot;
+  }
+
+  uint32_t n;
+  union {
+    struct {
+      uint64_t pcs[kInlineChilds];
+      CCTNodeIdx idxs[kInlineChilds];
+    } small;
+    struct {
+      Slot *slots;
+      uint32_t capacity;
+    } large;
+  };
+};
+
+// Export epochs of the CCTs. Nodes are stamped with the epoch in which they
+// were last created or modified; every export closes the current epoch, and a
+// delta export collects the nodes stamped since the epoch asked by the client.
+class CPUCCTEpoch {
+public:
+  static uint32_t Current() {
+    return GetCounter().load(std::memory_order_relaxed);
+  }
+
+  // start a new epoch, return the closed one
+  static uint32_t Advance() {
+    return GetCounter().fetch_add(1, std::memory_order_relaxed);
+  }
+
+private:
+  // epoch 0 means "since the beginning"
+  static std::atomic<uint32_t> &GetCounter() {
+    static std::atomic<uint32_t> counter(1);
+    return counter;
+  }
+};
+
 class CPUCCTNode {
 public:
   uint64_t id;
   uint64_t pc;
-  uint64_t parentID;
-  uint64_t parentPC;
   uint64_t offset;
-  uint64_t samples;
+  std::atomic<uint64_t> samples;
   CCTNodeType nodeType;
-  std::string funcName;
-  std::vector<CPUCCTNode *> childNodes;
-  std::unordered_map<uint64_t, CPUCCTNode *> pc2ChildNodes;
-  std::unordered_map<uint64_t, CPUCCTNode *> id2ChildNodes;
-
-  CPUCCTNode()
-      : parentID(0), parentPC(0), samples(1), nodeType(CCTNODE_TYPE_CXX){};
-  CPUCCTNode(CCTNodeType t)
-      : parentID(0), parentPC(0), samples(1), nodeType(t){};
-
-  int addChild(CPUCCTNode *child, bool ignoreDupPC = false) {
-    childNodes.push_back(child);
-    if (id2ChildNodes.find(child->id) != id2ChildNodes.end()) {
-      return DUP_ID;
-    }
-    if (!ignoreDupPC && pc2ChildNodes.find(child->pc) != pc2ChildNodes.end()) {
-      return DUP_PC;
-    }
-    id2ChildNodes.insert(std::make_pair(child->id, child));
-    // TODO insert <pc, child> pair according to parent's pc (offset)
-    pc2ChildNodes.insert(std::make_pair(child->pc, child));
-    child->parentID = id;
-    child->parentPC = pc;
-    return INSERT_SUCCESS;
+  // interned in the SymbolTable, may be renamed while readers are active
+  std::atomic<SymbolId> funcNameId;
+  // epoch of the creation or the last modification of this node and of any
+  // node in its subtree, maintained by CPUCCT::touchNode
+  std::atomic<uint32_t> modifiedEpoch;
+  std::atomic<uint32_t> subtreeEpoch;
+
+  // relations inside the owning CPUCCT, children form a singly linked list.
+  // firstChildIdx is the publication point of a new child, everything else
+  // in the child is written before it becomes reachable.
+  CCTNodeIdx idx;
+  CCTNodeIdx parentIdx;
+  std::atomic<CCTNodeIdx> firstChildIdx;
+  CCTNodeIdx nextSiblingIdx;
+  std::atomic<uint32_t> nChilds;
+  // only touched by the writer of the tree
+  CCTChildIndex childIndex;
+  // node of the pruned view this node is attributed to, if the tree has one;
+  // in a pruned view, the node of the raw tree this node copies
+  CCTNodeIdx prunedIdx;
+
+  CPUCCTNode() { reset(CCTNODE_TYPE_CXX); };
+
+  void reset(CCTNodeType t) {
+    id = 0;
+    pc = 0;
+    offset = 0;
+    samples.store(1, std::memory_order_relaxed);
+    nodeType = t;
+    funcNameId.store(EMPTY_SYMBOL_ID, std::memory_order_relaxed);
+    modifiedEpoch.store(CPUCCTEpoch::Current(), std::memory_order_relaxed);
+    subtreeEpoch.store(0, std::memory_order_relaxed);
+    parentIdx = CCT_NULL_IDX;
+    firstChildIdx.store(CCT_NULL_IDX, std::memory_order_relaxed);
+    nextSiblingIdx = CCT_NULL_IDX;
+    nChilds.store(0, std::memory_order_relaxed);
+    childIndex.clear();
+    prunedIdx = CCT_NULL_IDX;
   }
 
-  // TODO check child by pc (offset) of the parent node
-  CPUCCTNode *getChildbyPC(uint64_t pc) {
-    if (pc2ChildNodes.find(pc) == pc2ChildNodes.end())
-      return nullptr;
-    return pc2ChildNodes[pc];
+  uint64_t getSamples() { return samples.load(std::memory_order_relaxed); }
+
+  void addSamples(uint64_t n) {
+    samples.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  uint32_t getNChilds() { return nChilds.load(std::memory_order_relaxed); }
+
+  SymbolId getFuncNameId() {
+    return funcNameId.load(std::memory_order_acquire);
+  }
+
+  const std::string &getFuncName() { return GetSymbol(getFuncNameId()); }
+
+  void setFuncName(const std::string &funcName) {
+    funcNameId.store(InternSymbol(funcName), std::memory_order_release);
+  }
+
+  // created or modified in epoch sinceEpoch or later
+  bool changedSince(uint32_t sinceEpoch) {
+    return modifiedEpoch.load(std::memory_order_relaxed) >= sinceEpoch;
+  }
+
+  bool subtreeChangedSince(uint32_t sinceEpoch) {
+    return subtreeEpoch.load(std::memory_order_relaxed) >= sinceEpoch;
   }
 
   static void copyNodeWithoutRelation(CPUCCTNode *src, CPUCCTNode *dst) {
     dst->id = src->id;
     dst->pc = src->pc;
     dst->offset = src->offset;
-    dst->funcName = src->funcName;
+    dst->funcNameId.store(src->getFuncNameId(), std::memory_order_relaxed);
     dst->nodeType = src->nodeType;
+    dst->modifiedEpoch.store(src->modifiedEpoch.load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+    dst->subtreeEpoch.store(src->subtreeEpoch.load(std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+  }
+};
+
+// Hands out node ids that are unique across all the CCTs of the process, so
+// that a node id alone identifies a calling context. Every thread reserves a
+// block of ids from one atomic counter and then allocates from it locally.
+class CPUCCTNodeIdAllocator {
+public:
+  static const uint64_t kBlockSize = 1024;
+
+  static uint64_t NextId() {
+    thread_local uint64_t next = 0, end = 0;
+    if (next == end) {
+      next = GetCounter().fetch_add(kBlockSize, std::memory_order_relaxed);
+      end = next + kBlockSize;
+    }
+    return next++;
+  }
+
+private:
+  // id 0 is reserved for "no node"
+  static std::atomic<uint64_t> &GetCounter() {
+    static std::atomic<uint64_t> counter(1);
+    return counter;
+  }
+};
+
+// Chunked slab storage of the nodes of one CPUCCT. Nodes never move once
+// allocated, so both indices and pointers stay valid until the arena is
+// destroyed, which frees the whole tree at once. The chunk table has a fixed
+// size so that readers can resolve indices while the writer allocates. A full
+// arena allocates nothing more, and the nodes it refuses are counted.
+class CPUCCTNodeArena {
+public:
+  static const uint32_t kChunkBits = 12;
+  static const uint32_t kChunkSize = 1u << kChunkBits;
+  // at most 16M nodes per tree
+  static const uint32_t kMaxChunks = 1u << 12;
+
+  CPUCCTNodeArena() : nNodes(0) {
+    for (uint32_t i = 0; i < kMaxChunks; ++i)
+      chunks[i].store(nullptr, std::memory_order_relaxed);
+  };
+  ~CPUCCTNodeArena() {
+    for (uint32_t i = 0; i < kMaxChunks; ++i)
+      delete[] chunks[i].load(std::memory_order_relaxed);
+  }
+
+  CPUCCTNodeArena(const CPUCCTNodeArena &) = delete;
+  CPUCCTNodeArena &operator=(const CPUCCTNodeArena &) = delete;
+
+  // only called by the writer of the tree, nullptr if the arena is full
+  CPUCCTNode *alloc(CCTNodeType t) {
+    uint32_t chunkIdx = nNodes >> kChunkBits;
+    if (chunkIdx == kMaxChunks) {
+      if (GetDropped().fetch_add(1, std::memory_order_relaxed) == 0)
+        fprintf(stderr,
+                "%s:%d: Warning: CCT node arena exhausted, call paths are "
+                "truncated\n",
+                __FILE__, __LINE__);
+      return nullptr;
+    }
+    if (!chunks[chunkIdx].load(std::memory_order_relaxed))
+      chunks[chunkIdx].store(new CPUCCTNode[kChunkSize],
+                             std::memory_order_release);
+    CPUCCTNode *node = at(nNodes);
+    node->reset(t);
+    node->idx = nNodes++;
+    return node;
+  }
+
+  CPUCCTNode *at(CCTNodeIdx idx) {
+    return &chunks[idx >> kChunkBits].load(
+        std::memory_order_acquire)[idx & (kChunkSize - 1)];
+  }
+
+  uint32_t size() { return nNodes; }
+
+  // nodes refused by full arenas, over all the trees
+  static uint64_t GetDroppedNodes() {
+    return GetDropped().load(std::memory_order_relaxed);
+  }
+
+  // bytes reserved by the slabs, not counting heap-allocated func names
+  size_t capacityBytes() {
+    return ((size_t)(nNodes + kChunkSize - 1) >> kChunkBits) * kChunkSize *
+           sizeof(CPUCCTNode);
+  }
+
+private:
+  static std::atomic<uint64_t> &GetDropped() {
+    static std::atomic<uint64_t> dropped(0);
+    return dropped;
   }
+
+  std::atomic<CPUCCTNode *> chunks[kMaxChunks];
+  uint32_t nNodes;
+};
+
+// Notified of the insertions into a CPUCCT, by the writer of the tree.
+class CPUCCTObserver {
+public:
+  virtual ~CPUCCTObserver(){};
+  virtual void onInsert(CPUCCTNode *parent, CPUCCTNode *child) = 0;
+  // node is the last frame of a call path, see CPUCCT::endPath
+  virtual void onPathEnd(CPUCCTNode *node) = 0;
+  // node got another name and type, see CPUCCT::renameNode
+  virtual void onRename(CPUCCTNode *node) = 0;
+  // id of the node that samples taken under node are attributed to
+  virtual uint64_t getAttributedId(CPUCCTNode *node) = 0;
 };
 
+// A CPUCCT has a single writer, normally the thread it belongs to, and any
+// number of concurrent readers walking it from the root (e.g., the RPC thread
+// exporting it). When other threads also insert into it (the cpu sampler
+// thread), the tree is created with sharedWriters and every writer has to
+// hold a CPUCCTWriteGuard.
 class CPUCCT {
 public:
   CPUCCTNode *root;
-  std::unordered_map<uint64_t, CPUCCTNode *> nodeMap;
+  CPUCCTNodeArena arena;
 
-  std::mutex cctMutex;
+  const bool sharedWriters;
+  std::mutex writerMutex;
+
+  CPUCCT(bool _sharedWriters = false)
+      : root(nullptr), sharedWriters(_sharedWriters), observer(nullptr){};
+
+  ~CPUCCT() { delete observer; }
+
+  // must be set before the tree is shared, the tree owns the observer
+  void setObserver(CPUCCTObserver *_observer) {
+    delete observer;
+    observer = _observer;
+  }
 
-  CPUCCT() : root(nullptr){};
-  CPUCCT(CPUCCTNode *_root) : root(_root){};
+  CPUCCTObserver *getObserver() { return observer; }
+
+  // nodes of a tree must be allocated from its own arena
+  // nullptr once the tree is full, see CPUCCTNodeArena
+  CPUCCTNode *newNode(CCTNodeType t = CCTNODE_TYPE_CXX) {
+    return arena.alloc(t);
+  }
+
+  CPUCCTNode *getNode(CCTNodeIdx idx) {
+    if (idx == CCT_NULL_IDX)
+      return nullptr;
+    return arena.at(idx);
+  }
+
+  CPUCCTNode *getParent(CPUCCTNode *node) { return getNode(node->parentIdx); }
+
+  // TODO check child by pc (offset) of the parent node
+  CPUCCTNode *getChildbyPC(CPUCCTNode *parent, uint64_t pc) {
+    return getNode(parent->childIndex.find(pc));
+  }
 
   int setRootNode(CPUCCTNode *rootNode) {
     if (root)
       return DUP_ROOT;
     root = rootNode;
-    nodeMap.insert(std::make_pair(root->id, root));
     return INSERT_SUCCESS;
   }
 
   int insertNode(CPUCCTNode *parent, CPUCCTNode *child,
                  bool ignoreDupPC = false) {
-    cctMutex.lock();
-    int insertStatus = parent->addChild(child, ignoreDupPC);
-    if (insertStatus != INSERT_SUCCESS) {
-      cctMutex.unlock();
-      return insertStatus;
-    }
-    nodeMap.insert(std::make_pair(child->id, child));
-    cctMutex.unlock();
+    if (!parent || !child)
+      return NULL_NODE;
+    if (child->parentIdx != CCT_NULL_IDX || child == root)
+      return DUP_NODE;
+    bool dupPC = parent->childIndex.find(child->pc) != CCT_NULL_IDX;
+    if (dupPC && !ignoreDupPC)
+      return DUP_PC;
+    // with ignoreDupPC, lookups keep resolving to the first child of a pc
+    if (!dupPC)
+      parent->childIndex.insert(child->pc, child->idx);
+    child->parentIdx = parent->idx;
+    child->nextSiblingIdx =
+        parent->firstChildIdx.load(std::memory_order_relaxed);
+    parent->firstChildIdx.store(child->idx, std::memory_order_release);
+    parent->nChilds.fetch_add(1, std::memory_order_relaxed);
+    touchNode(child);
+    if (observer)
+      observer->onInsert(parent, child);
     return INSERT_SUCCESS;
   }
 
+  // Mark node as the last frame of a newly inserted call path.
+  void endPath(CPUCCTNode *node) {
+    if (observer)
+      observer->onPathEnd(node);
+  }
+
+  // Give a published node another name and type, e.g., a C2P node found to
+  // be a python frame.
+  void renameNode(CPUCCTNode *node, CCTNodeType nodeType,
+                  const std::string &funcName) {
+    node->nodeType = nodeType;
+    node->setFuncName(funcName);
+    touchNode(node);
+    if (observer)
+      observer->onRename(node);
+  }
+
+  // id that gpu samples launched from node are attributed to
+  uint64_t getAttributedId(CPUCCTNode *node) {
+    return observer ? observer->getAttributedId(node) : node->id;
+  }
+
+  // Stamp a created or modified node with the current epoch, and its
+  // ancestors as having a changed subtree. Must be called by the writer after
+  // modifying a published node (e.g., its samples or its name).
+  void touchNode(CPUCCTNode *node) {
+    uint32_t epoch = CPUCCTEpoch::Current();
+    node->modifiedEpoch.store(epoch, std::memory_order_relaxed);
+    // the path above a stamped node is stamped already
+    for (CPUCCTNode *n = node;
+         n && n->subtreeEpoch.load(std::memory_order_relaxed) < epoch;
+         n = getParent(n))
+      n->subtreeEpoch.store(epoch, std::memory_order_relaxed);
+  }
+
+  // visit every published node, parents always come first
+  template <typename F> void forEachNode(F f) {
+    if (!root)
+      return;
+    std::vector<CPUCCTNode *> toVisit = {root};
+    while (!toVisit.empty()) {
+      CPUCCTNode *node = toVisit.back();
+      toVisit.pop_back();
+      f(node);
+      forEachChild(node,
+                   [&toVisit](CPUCCTNode *child) { toVisit.push_back(child); });
+    }
+  }
+
+  // visit the nodes created or modified in epoch sinceEpoch or later, only
+  // descending into subtrees that have changed
+  template <typename F> void forEachNodeChangedSince(uint32_t sinceEpoch, F f) {
+    if (!root)
+      return;
+    std::vector<CPUCCTNode *> toVisit = {root};
+    while (!toVisit.empty()) {
+      CPUCCTNode *node = toVisit.back();
+      toVisit.pop_back();
+      if (node->changedSince(sinceEpoch))
+        f(node);
+      forEachChild(node, [&toVisit, sinceEpoch](CPUCCTNode *child) {
+        if (child->subtreeChangedSince(sinceEpoch))
+          toVisit.push_back(child);
+      });
+    }
+  }
+
+  template <typename F> void forEachChild(CPUCCTNode *parent, F f) {
+    for (CCTNodeIdx i = parent->firstChildIdx.load(std::memory_order_acquire);
+         i != CCT_NULL_IDX;) {
+      CPUCCTNode *child = arena.at(i);
+      i = child->nextSiblingIdx;
+      f(child);
+    }
+  }
+
   void printTree() {
     std::cout << "************* Begin CCT ***********" << std::endl;
-    for (auto itr : nodeMap) {
-      std::cout << itr.first << ": pc=" << itr.second->pc
-                << ", parentID=" << itr.second->parentID
-                << ", funcName=" << itr.second->funcName << std::endl;
-    }
+    forEachNode([this](CPUCCTNode *node) {
+      CPUCCTNode *parent = getParent(node);
+      std::cout << node->id << ": pc=" << node->pc
+                << ", parentID=" << (parent ? parent->id : 0)
+                << ", funcName=" << node->getFuncName() << std::endl;
+    });
     std::cout << "************** End CCT ************" << std::endl;
   }
+
+private:
+  CPUCCTObserver *observer;
 };
 
-typedef std::unordered_map<pthread_t, CPUCCT *> CCTMAP_t;
-static CCTMAP_t *GetCPUCCTMap() {
-  static CCTMAP_t *CPUCCTMap = new CCTMAP_t();
-  return CPUCCTMap;
-}
-
-static bool HasExcludePatterns(std::string funcName) {
-  std::vector<std::string> excludePatterns = {
-      "cupti", "CUpti", "cuTexRefGetArray", "GenCallStack"};
-  for (auto pattern : excludePatterns) {
-    if (funcName.find(pattern) != std::string::npos) {
-      return true;
+class CPUCCTWriteGuard {
+public:
+  explicit CPUCCTWriteGuard(CPUCCT *_cct) : cct(_cct) {
+    if (cct->sharedWriters)
+      cct->writerMutex.lock();
+  }
+  ~CPUCCTWriteGuard() {
+    if (cct->sharedWriters)
+      cct->writerMutex.unlock();
+  }
+
+  CPUCCTWriteGuard(const CPUCCTWriteGuard &) = delete;
+  CPUCCTWriteGuard &operator=(const CPUCCTWriteGuard &) = delete;
+
+private:
+  CPUCCT *cct;
+};
+
+// Process-wide registry of the CPUCCT of every thread, keyed by kernel tid.
+// Entries are only ever prepended with a CAS on the head and never removed,
+// so readers iterate it without locking.
+class CPUCCTRegistry {
+public:
+  struct Entry {
+    pid_t tid;
+    CPUCCT *cct;
+    Entry *next;
+  };
+
+  CPUCCTRegistry() : head(nullptr){};
+
+  static CPUCCTRegistry *GetRegistry() {
+    static CPUCCTRegistry *registry = new CPUCCTRegistry();
+    return registry;
+  }
+
+  CPUCCT *find(pid_t tid) {
+    return findFrom(head.load(std::memory_order_acquire), nullptr, tid);
+  }
+
+  // Register cct for tid. If a tree has been registered for tid already, cct
+  // is left untouched and the registered tree is returned.
+  CPUCCT *registerCCT(pid_t tid, CPUCCT *cct) {
+    Entry *entry = new Entry{tid, cct, nullptr};
+    Entry *oldHead = head.load(std::memory_order_acquire);
+    Entry *scanned = nullptr;
+    while (true) {
+      CPUCCT *found = findFrom(oldHead, scanned, tid);
+      if (found) {
+        delete entry;
+        return found;
+      }
+      scanned = oldHead;
+      entry->next = oldHead;
+      if (head.compare_exchange_weak(oldHead, entry, std::memory_order_release,
+                                     std::memory_order_acquire))
+        return cct;
     }
   }
-  return false;
-}
+
+  template <typename F> void forEach(F f) {
+    for (Entry *e = head.load(std::memory_order_acquire); e; e = e->next)
+      f(e->tid, e->cct);
+  }
+
+private:
+  // search the entries in [from, until)
+  static CPUCCT *findFrom(Entry *from, Entry *until, pid_t tid) {
+    for (Entry *e = from; e != until; e = e->next) {
+      if (e->tid == tid)
+        return e->cct;
+    }
+    return nullptr;
+  }
+
+  std::atomic<Entry *> head;
+};
+
+typedef std::unordered_map<pid_t, CPUCCT *> CCTMAP_t;
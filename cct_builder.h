@@ -0,0 +1,395 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+#include "common.h"
+#include "main_py_stack.h"
+#include "py_frame_cache.h"
+#include "unwinder.h"
+
+// Call stack of a kernel launch as captured on the launching thread, before
+// any lookup in the CCT.
+struct RawCallStack {
+  uint32_t corId;
+  pid_t tid;
+  uint32_t nPCs;
+  // python frames of the launching thread, innermost first
+  uint32_t nPyFrames;
+  // python frames of the main thread, outermost first, taken when the
+  // launching thread has none
+  uint32_t nMainPyFrames;
+  uint64_t pcs[MAX_UNWIND_DEPTH];
+  PyFrameInfo pyFrames[MainPyStack::kMaxDepth];
+  PyFrameInfo mainPyFrames[MainPyStack::kMaxDepth];
+};
+
+// Single-producer single-consumer ring of RawCallStacks, each stored with
+// its used frames only. Positions count bytes since the creation of the ring
+// and only grow. A record never wraps around, the end of the buffer that it
+// does not fit in is skipped with a padding record.
+class RawCallStackRing {
+public:
+  // capacity is rounded up to a multiple of 8 bytes
+  explicit RawCallStackRing(uint64_t _capacity)
+      : capacity((std::max<uint64_t>(_capacity, sizeof(Header)) + 7) & ~7ull),
+        head(0), tail(0) {
+    data = new char[capacity];
+  }
+
+  ~RawCallStackRing() { delete[] data; }
+
+  RawCallStackRing(const RawCallStackRing &) = delete;
+  RawCallStackRing &operator=(const RawCallStackRing &) = delete;
+
+  // producer side, false if there is no room for stack
+  bool push(const RawCallStack &stack) {
+    uint64_t size = RecordSize(stack);
+    uint64_t h = head.load(std::memory_order_relaxed);
+    uint64_t t = tail.load(std::memory_order_acquire);
+    uint64_t pos = h % capacity;
+    uint64_t pad = pos + size > capacity ? capacity - pos : 0;
+    if (size > capacity || h + pad + size - t > capacity)
+      return false;
+    if (pad) {
+      // a zero size marks the padding, records are at least 8 bytes apart
+      uint32_t padding = 0;
+      memcpy(data + pos, &padding, sizeof(padding));
+      h += pad;
+      pos = 0;
+    }
+
+    Header header = {(uint32_t)size,      stack.corId,
+                     stack.tid,           stack.nPCs,
+                     stack.nPyFrames,     stack.nMainPyFrames};
+    char *p = data + pos;
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    memcpy(p, stack.pcs, stack.nPCs * sizeof(uint64_t));
+    p += stack.nPCs * sizeof(uint64_t);
+    memcpy(p, stack.pyFrames, stack.nPyFrames * sizeof(PyFrameInfo));
+    p += stack.nPyFrames * sizeof(PyFrameInfo);
+    memcpy(p, stack.mainPyFrames, stack.nMainPyFrames * sizeof(PyFrameInfo));
+    head.store(h + size, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side, false if the ring is empty
+  bool pop(RawCallStack &stack) {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    uint64_t h = head.load(std::memory_order_acquire);
+    if (t == h)
+      return false;
+    uint64_t pos = t % capacity;
+    uint32_t size;
+    memcpy(&size, data + pos, sizeof(size));
+    if (!size) {
+      // the record after the padding was published with it
+      t += capacity - pos;
+      pos = 0;
+    }
+
+    Header header;
+    const char *p = data + pos;
+    memcpy(&header, p, sizeof(header));
+    p += sizeof(header);
+    stack.corId = header.corId;
+    stack.tid = header.tid;
+    stack.nPCs = header.nPCs;
+    stack.nPyFrames = header.nPyFrames;
+    stack.nMainPyFrames = header.nMainPyFrames;
+    memcpy(stack.pcs, p, stack.nPCs * sizeof(uint64_t));
+    p += stack.nPCs * sizeof(uint64_t);
+    memcpy(stack.pyFrames, p, stack.nPyFrames * sizeof(PyFrameInfo));
+    p += stack.nPyFrames * sizeof(PyFrameInfo);
+    memcpy(stack.mainPyFrames, p, stack.nMainPyFrames * sizeof(PyFrameInfo));
+    tail.store(t + header.size, std::memory_order_release);
+    return true;
+  }
+
+  // no record is left to pop, as seen by the consumer
+  bool empty() {
+    return tail.load(std::memory_order_relaxed) ==
+           head.load(std::memory_order_acquire);
+  }
+
+  // bytes taken by the record of stack
+  static uint64_t RecordSize(const RawCallStack &stack) {
+    uint64_t size = sizeof(Header) + stack.nPCs * sizeof(uint64_t) +
+                    (stack.nPyFrames + stack.nMainPyFrames) *
+                        sizeof(PyFrameInfo);
+    return (size + 7) & ~7ull;
+  }
+
+private:
+  struct Header {
+    // bytes of the record, 0 for padding
+    uint32_t size;
+    uint32_t corId;
+    pid_t tid;
+    uint32_t nPCs;
+    uint32_t nPyFrames;
+    uint32_t nMainPyFrames;
+  };
+
+  const uint64_t capacity;
+  char *data;
+  std::atomic<uint64_t> head;
+  std::atomic<uint64_t> tail;
+};
+
+// Builds the CCT paths of kernel launches off the launching threads. A launch
+// only copies its RawCallStack to the ring of its thread, or drops it if the
+// ring is full. The builder thread drains the rings, inserts the paths and
+// remembers the id of the leaf of the path of each correlation id, so that
+// the gpu samples of a launch find their parent cpu pc afterwards.
+//
+// Leaf ids are kept in a direct-mapped table indexed by correlation id, a
+// launch is forgotten once corIdSlots later launches have been built.
+//
+// The ring of a thread is handed to the next new launching thread once the
+// thread exits, so a builder must outlive the threads pushing to it. The
+// builder thread sleeps while the rings are empty and the first push after
+// that wakes it up.
+class CCTBuilder {
+public:
+  // inserts the path of a call stack into the CCT, returns the id of its leaf
+  typedef std::function<uint64_t(const RawCallStack &)> InsertFunc;
+
+  CCTBuilder(uint64_t _ringSize, uint32_t corIdSlots)
+      : ringSize(_ringSize), leafIds(std::max(corIdSlots, 1u)),
+        running(false), sleeping(false), pushed(0), dropped(0), built(0),
+        unresolved(0) {
+    stack = new RawCallStack();
+  }
+
+  ~CCTBuilder() {
+    stop();
+    for (RawCallStackRing *ring : rings)
+      delete ring;
+    delete stack;
+  }
+
+  CCTBuilder(const CCTBuilder &) = delete;
+  CCTBuilder &operator=(const CCTBuilder &) = delete;
+
+  static CCTBuilder *GetCCTBuilder() {
+    static CCTBuilder *builder =
+        new CCTBuilder(GetProfilerConf()->asyncCCTRingSize,
+                       GetProfilerConf()->asyncCCTCorIdSlots);
+    return builder;
+  }
+
+  // start the builder thread, paths are inserted with _insert
+  void start(InsertFunc _insert) {
+    std::lock_guard<std::mutex> lock(drainMutex);
+    if (running)
+      return;
+    insert = _insert;
+    running = true;
+    thread = std::thread([this]() { run(); });
+  }
+
+  // stop the builder thread after building what has been pushed
+  void stop() {
+    if (!running.exchange(false))
+      return;
+    wake();
+    thread.join();
+    flush();
+  }
+
+  // called by the launching thread, false if the stack was dropped
+  bool push(const RawCallStack &stack) {
+    if (!getThreadRing()->push(stack)) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    pushed.fetch_add(1, std::memory_order_relaxed);
+    // pairs with the fence in run(), either the builder sees the stack before
+    // it sleeps or the stack sees it sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed))
+      wake();
+    return true;
+  }
+
+  // build every stack pushed so far, returns how many were built
+  uint64_t flush() {
+    std::lock_guard<std::mutex> lock(drainMutex);
+    if (!insert)
+      return 0;
+    {
+      std::lock_guard<std::mutex> ringsLock(ringsMutex);
+      drainingRings = rings;
+    }
+    uint64_t n = 0;
+    for (RawCallStackRing *ring : drainingRings) {
+      while (ring->pop(*stack)) {
+        setLeafId(stack->corId, insert(*stack));
+        ++n;
+      }
+    }
+    built.fetch_add(n, std::memory_order_relaxed);
+    return n;
+  }
+
+  // id of the leaf of the path of launch corId, building the pending stacks
+  // if it is not built yet; 0 if its stack was dropped or it is forgotten
+  uint64_t getLeafId(uint32_t corId) {
+    uint64_t leafId = 0;
+    if (findLeafId(corId, leafId))
+      return leafId;
+    flush();
+    if (findLeafId(corId, leafId))
+      return leafId;
+    unresolved.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+  }
+
+  uint64_t getPushed() { return pushed.load(std::memory_order_relaxed); }
+
+  // stacks left out of a full ring
+  uint64_t getDropped() { return dropped.load(std::memory_order_relaxed); }
+
+  uint64_t getBuilt() { return built.load(std::memory_order_relaxed); }
+
+  // rings created, at most the number of threads pushing at the same time
+  uint64_t getNRings() {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    return rings.size();
+  }
+
+  // correlation ids asked for without a known path
+  uint64_t getUnresolved() {
+    return unresolved.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct LeafIdSlot {
+    bool valid = false;
+    uint32_t corId = 0;
+    uint64_t leafId = 0;
+  };
+
+  // the ring taken by a thread, given back to its builder when the thread
+  // exits
+  struct ThreadRing {
+    CCTBuilder *owner = nullptr;
+    RawCallStackRing *ring = nullptr;
+
+    ~ThreadRing() { release(); }
+
+    void release() {
+      if (owner)
+        owner->releaseRing(ring);
+      owner = nullptr;
+      ring = nullptr;
+    }
+  };
+
+  // the ring of the calling thread, taken on its first launch from the rings
+  // of exited threads, or created if there is none
+  RawCallStackRing *getThreadRing() {
+    static thread_local ThreadRing threadRing;
+    if (threadRing.owner != this) {
+      threadRing.release();
+      std::lock_guard<std::mutex> lock(ringsMutex);
+      if (freeRings.empty()) {
+        threadRing.ring = new RawCallStackRing(ringSize);
+        rings.push_back(threadRing.ring);
+      } else {
+        // records left by the exited thread are still drained from it
+        threadRing.ring = freeRings.back();
+        freeRings.pop_back();
+      }
+      threadRing.owner = this;
+    }
+    return threadRing.ring;
+  }
+
+  void releaseRing(RawCallStackRing *ring) {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    freeRings.push_back(ring);
+  }
+
+  bool ringsEmpty() {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    for (RawCallStackRing *ring : rings) {
+      if (!ring->empty())
+        return false;
+    }
+    return true;
+  }
+
+  void wake() {
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    sleeping.store(false, std::memory_order_relaxed);
+    wakeCond.notify_one();
+  }
+
+  void run() {
+    RegisterProfilerThread();
+    while (running.load(std::memory_order_relaxed)) {
+      if (flush())
+        continue;
+      std::unique_lock<std::mutex> lock(wakeMutex);
+      sleeping.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!ringsEmpty() || !running.load(std::memory_order_relaxed)) {
+        sleeping.store(false, std::memory_order_relaxed);
+        continue;
+      }
+      wakeCond.wait(lock, [this]() {
+        return !sleeping.load(std::memory_order_relaxed);
+      });
+    }
+  }
+
+  void setLeafId(uint32_t corId, uint64_t leafId) {
+    std::lock_guard<std::mutex> lock(leafIdsMutex);
+    LeafIdSlot &slot = leafIds[corId % leafIds.size()];
+    slot.valid = true;
+    slot.corId = corId;
+    slot.leafId = leafId;
+  }
+
+  bool findLeafId(uint32_t corId, uint64_t &leafId) {
+    std::lock_guard<std::mutex> lock(leafIdsMutex);
+    LeafIdSlot &slot = leafIds[corId % leafIds.size()];
+    if (!slot.valid || slot.corId != corId)
+      return false;
+    leafId = slot.leafId;
+    return true;
+  }
+
+  uint64_t ringSize;
+  InsertFunc insert;
+  std::mutex ringsMutex;
+  std::vector<RawCallStackRing *> rings;
+  // rings of exited threads, ready for new threads
+  std::vector<RawCallStackRing *> freeRings;
+  // the single consumer of the rings, and its copies
+  std::mutex drainMutex;
+  std::vector<RawCallStackRing *> drainingRings;
+  RawCallStack *stack;
+  std::mutex leafIdsMutex;
+  std::vector<LeafIdSlot> leafIds;
+  std::atomic<bool> running;
+  // the builder thread waits for a push on wakeCond
+  std::mutex wakeMutex;
+  std::condition_variable wakeCond;
+  std::atomic<bool> sleeping;
+  std::thread thread;
+  std::atomic<uint64_t> pushed;
+  std::atomic<uint64_t> dropped;
+  std::atomic<uint64_t> built;
+  std::atomic<uint64_t> unresolved;
+};
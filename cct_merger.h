@@ -0,0 +1,245 @@
+#pragma once
+#include <algorithm>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "calling_ctx_tree.h"
+#include "utils.h"
+
+// Merges the per-thread CCTs into one process-wide CCT. Nodes are matched by
+// frame identity, i.e., the pc and the function name of the node, along the
+// path from the root, so the same call path reached from different threads
+// ends up in one node whose samples are the sum of the merged nodes.
+//
+// A merged node takes the smallest id of the nodes merged into it, and every
+// source id is mapped to its merged id so that GPU samples can be re-parented.
+// The upper levels of the trees are merged by the calling thread until there
+// are enough independent subtrees, which are then merged in parallel into
+// private trees and finally grafted under their merged parents.
+class CPUCCTMerger {
+public:
+  CPUCCTMerger(uint32_t _nWorkers, bool _annotateThreads)
+      : nWorkers(std::max(_nWorkers, 1u)), annotateThreads(_annotateThreads),
+        mergedTree(nullptr){};
+
+  ~CPUCCTMerger() { delete mergedTree; }
+
+  CPUCCTMerger(const CPUCCTMerger &) = delete;
+  CPUCCTMerger &operator=(const CPUCCTMerger &) = delete;
+
+  CPUCCT *merge(CCTMAP_t &cctMap) {
+    delete mergedTree;
+    mergedTree = new CPUCCT();
+    id2MergedId.clear();
+    leafThreadIds.clear();
+
+    // roots are virtual nodes of their threads, merged into a new one
+    Group rootGroup;
+    for (auto itr : cctMap) {
+      if (itr.second->root)
+        rootGroup.sources.push_back({itr.first, itr.second, itr.second->root});
+    }
+    CPUCCTNode *root = mergedTree->newNode();
+    root->id = CPUCCTNodeIdAllocator::NextId();
+    root->setFuncName("process:" + std::to_string(getpid()) +
+                      "::id:" + std::to_string(root->id));
+    root->samples.store(0, std::memory_order_relaxed);
+    mergedTree->setRootNode(root);
+    for (auto &source : rootGroup.sources)
+      id2MergedId[source.node->id] = root->id;
+
+    // merge level by level until there are enough subtrees to spread
+    std::vector<Task> frontier;
+    for (auto &group : groupChildren(rootGroup))
+      frontier.push_back({std::move(group), root});
+    for (uint32_t level = 0;
+         level < kMaxSerialLevels && frontier.size() &&
+         frontier.size() < kTasksPerWorker * nWorkers;
+         ++level) {
+      std::vector<Task> nextFrontier;
+      for (auto &task : frontier) {
+        CPUCCTNode *node = newMergedNode(mergedTree, task.group, id2MergedId);
+        if (!node)
+          continue;
+        mergedTree->insertNode(task.parent, node, true);
+        std::vector<Group> childGroups = groupChildren(task.group);
+        if (childGroups.empty())
+          annotateLeaf(node, task.group, leafThreadIds);
+        for (auto &group : childGroups)
+          nextFrontier.push_back({std::move(group), node});
+      }
+      frontier = std::move(nextFrontier);
+    }
+
+    // merge the remaining subtrees in parallel
+    std::vector<PartialResult> results(frontier.size());
+    ParallelFor(frontier.size(), nWorkers, [this, &frontier, &results](size_t i) {
+      mergeSubtree(frontier[i].group, results[i]);
+    });
+
+    for (size_t i = 0; i < frontier.size(); ++i) {
+      PartialResult &result = results[i];
+      graft(result.tree, result.tree->root, frontier[i].parent);
+      id2MergedId.insert(result.id2MergedId.begin(), result.id2MergedId.end());
+      leafThreadIds.insert(result.leafThreadIds.begin(),
+                           result.leafThreadIds.end());
+      delete result.tree;
+    }
+    return mergedTree;
+  }
+
+  // 0 if id is not a node of the merged trees
+  uint64_t getMergedId(uint64_t id) {
+    auto itr = id2MergedId.find(id);
+    return itr == id2MergedId.end() ? 0 : itr->second;
+  }
+
+  // threads whose trees reached a merged leaf, if annotated
+  const std::unordered_map<uint64_t, std::vector<pid_t>> &getLeafThreadIds() {
+    return leafThreadIds;
+  }
+
+private:
+  static const uint32_t kTasksPerWorker = 4;
+  static const uint32_t kMaxSerialLevels = 8;
+
+  struct Source {
+    pid_t tid;
+    CPUCCT *cct;
+    CPUCCTNode *node;
+  };
+
+  // nodes of different trees sharing a path
+  struct Group {
+    std::vector<Source> sources;
+  };
+
+  struct Task {
+    Group group;
+    CPUCCTNode *parent;
+  };
+
+  struct PartialResult {
+    CPUCCT *tree;
+    std::unordered_map<uint64_t, uint64_t> id2MergedId;
+    std::unordered_map<uint64_t, std::vector<pid_t>> leafThreadIds;
+  };
+
+  struct FrameKey {
+    uint64_t pc;
+    SymbolId funcNameId;
+    bool operator==(const FrameKey &other) const {
+      return pc == other.pc && funcNameId == other.funcNameId;
+    }
+  };
+
+  struct FrameKeyHash {
+    size_t operator()(const FrameKey &key) const {
+      return std::hash<uint64_t>()(key.pc * 31 + key.funcNameId);
+    }
+  };
+
+  // group the children of the sources by frame identity, in order of first
+  // appearance
+  static std::vector<Group> groupChildren(Group &group) {
+    std::vector<Group> childGroups;
+    std::unordered_map<FrameKey, size_t, FrameKeyHash> key2Group;
+    for (auto &source : group.sources) {
+      source.cct->forEachChild(source.node, [&](CPUCCTNode *child) {
+        FrameKey key = {child->pc, child->getFuncNameId()};
+        auto itr = key2Group.find(key);
+        if (itr == key2Group.end()) {
+          itr = key2Group.insert({key, childGroups.size()}).first;
+          childGroups.emplace_back();
+        }
+        childGroups[itr->second].sources.push_back(
+            {source.tid, source.cct, child});
+      });
+    }
+    return childGroups;
+  }
+
+  // nullptr if tree is full, the subtree of the group is left out
+  static CPUCCTNode *
+  newMergedNode(CPUCCT *tree, Group &group,
+                std::unordered_map<uint64_t, uint64_t> &id2MergedId) {
+    CPUCCTNode *first = group.sources[0].node;
+    CPUCCTNode *node = tree->newNode(first->nodeType);
+    // the merged tree is full
+    if (!node)
+      return nullptr;
+    CPUCCTNode::copyNodeWithoutRelation(first, node);
+    uint64_t samples = 0;
+    for (auto &source : group.sources) {
+      node->id = std::min(node->id, source.node->id);
+      samples += source.node->getSamples();
+    }
+    node->samples.store(samples, std::memory_order_relaxed);
+    for (auto &source : group.sources)
+      id2MergedId[source.node->id] = node->id;
+    return node;
+  }
+
+  void
+  annotateLeaf(CPUCCTNode *node, Group &group,
+               std::unordered_map<uint64_t, std::vector<pid_t>> &threadIds) {
+    if (!annotateThreads)
+      return;
+    std::vector<pid_t> &tids = threadIds[node->id];
+    for (auto &source : group.sources) {
+      if (std::find(tids.begin(), tids.end(), source.tid) == tids.end())
+        tids.push_back(source.tid);
+    }
+  }
+
+  void mergeSubtree(Group &rootGroup, PartialResult &result) {
+    result.tree = new CPUCCT();
+    result.tree->setRootNode(
+        newMergedNode(result.tree, rootGroup, result.id2MergedId));
+    std::vector<std::pair<Group, CPUCCTNode *>> toMerge;
+    toMerge.push_back({std::move(rootGroup), result.tree->root});
+    while (!toMerge.empty()) {
+      Group group = std::move(toMerge.back().first);
+      CPUCCTNode *node = toMerge.back().second;
+      toMerge.pop_back();
+      std::vector<Group> childGroups = groupChildren(group);
+      if (childGroups.empty())
+        annotateLeaf(node, group, result.leafThreadIds);
+      for (auto &childGroup : childGroups) {
+        CPUCCTNode *child =
+            newMergedNode(result.tree, childGroup, result.id2MergedId);
+        if (!child)
+          continue;
+        result.tree->insertNode(node, child, true);
+        toMerge.push_back({std::move(childGroup), child});
+      }
+    }
+  }
+
+  // copy the subtree of node in tree under parent in the merged tree
+  void graft(CPUCCT *tree, CPUCCTNode *node, CPUCCTNode *parent) {
+    std::vector<std::pair<CPUCCTNode *, CPUCCTNode *>> toCopy = {
+        {node, parent}};
+    while (!toCopy.empty()) {
+      CPUCCTNode *src = toCopy.back().first;
+      CPUCCTNode *dstParent = toCopy.back().second;
+      toCopy.pop_back();
+      CPUCCTNode *dst = mergedTree->newNode(src->nodeType);
+      if (!dst)
+        continue;
+      CPUCCTNode::copyNodeWithoutRelation(src, dst);
+      dst->samples.store(src->getSamples(), std::memory_order_relaxed);
+      mergedTree->insertNode(dstParent, dst, true);
+      tree->forEachChild(src, [&toCopy, dst](CPUCCTNode *child) {
+        toCopy.push_back({child, dst});
+      });
+    }
+  }
+
+  uint32_t nWorkers;
+  bool annotateThreads;
+  CPUCCT *mergedTree;
+  std::unordered_map<uint64_t, uint64_t> id2MergedId;
+  std::unordered_map<uint64_t, std::vector<pid_t>> leafThreadIds;
+};
@@ -0,0 +1,405 @@
+#pragma once
+#include <algorithm>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "calling_ctx_tree.h"
+#include "common.h"
+#include "symbol_table.h"
+#include "utils.h"
+
+typedef enum {
+  // OP nodes
+  CRITICAL_TYPE_TORCH_OP = 1,
+  CRITICAL_TYPE_TF_OP = 2,
+  // Leaf nodes
+  CRITICAL_TYPE_LEAF = 3,
+  // Py nodes
+  CRITICAL_TYPE_PY_FORWARD = 4,
+  CRITICAL_TYPE_PY_BACKWARD = 5,
+  CRITICAL_TYPE_PY_LOSS = 6,
+  // Not critical
+  NOT_CRITICAL_NODE = 0x7fffffff
+} CriticalNodeType;
+
+// Decides which CCT nodes are critical, i.e., kept by pruning. Apart from
+// leaves, the verdict only depends on the function name and on whether the
+// node is a python frame, so it is computed once per interned name and kind
+// and cached for the lifetime of the process. The OP patterns are compiled
+// once.
+class CriticalNodeClassifier {
+public:
+  static const uint32_t kNumShards = 64;
+
+  explicit CriticalNodeClassifier(const std::string &_pyFileName)
+      : pyFileName(_pyFileName),
+        torchOPRegex("at::_ops::(\\S+)::call(\\S+)", std::regex::optimize),
+        tfOPRegex("(\\S+)Op(Kernel)?.+::Compute", std::regex::optimize){};
+
+  CriticalNodeClassifier(const CriticalNodeClassifier &) = delete;
+  CriticalNodeClassifier &operator=(const CriticalNodeClassifier &) = delete;
+
+  static CriticalNodeClassifier *GetClassifier() {
+    static CriticalNodeClassifier *classifier =
+        new CriticalNodeClassifier(GetProfilerConf()->pyFileName);
+    return classifier;
+  }
+
+  CriticalNodeType classify(CPUCCTNode *node) {
+    CriticalNodeType type = classifyName(node->getFuncNameId(),
+                                         node->nodeType == CCTNODE_TYPE_PY);
+    if (type == NOT_CRITICAL_NODE && node->getNChilds() == 0)
+      return CRITICAL_TYPE_LEAF;
+    return type;
+  }
+
+  // verdict of the name rules, leaves are not detected
+  CriticalNodeType classifyName(SymbolId funcNameId, bool isPy) {
+    uint64_t key = (uint64_t)funcNameId << 1 | isPy;
+    Shard &shard = shards[key % kNumShards];
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto itr = shard.verdicts.find(key);
+      if (itr != shard.verdicts.end())
+        return itr->second;
+    }
+    // threads racing on a new name compute the same verdict
+    CriticalNodeType type = matchRules(GetSymbol(funcNameId), isPy);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.verdicts[key] = type;
+    return type;
+  }
+
+private:
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<uint64_t, CriticalNodeType> verdicts;
+  };
+
+  CriticalNodeType matchRules(const std::string &funcName, bool isPy) {
+    // keep python nodes
+    if (isPy && funcName.find("python3") == std::string::npos) {
+      if (funcName.find("backward") != std::string::npos) {
+        DEBUG_LOG("critical name, kind=backward, funcName=%s\n",
+                  funcName.c_str());
+        return CRITICAL_TYPE_PY_BACKWARD;
+      }
+      if (funcName.find(pyFileName) != std::string::npos &&
+          funcName.find("loss") != std::string::npos) {
+        DEBUG_LOG("critical name, kind=loss, funcName=%s\n", funcName.c_str());
+        return CRITICAL_TYPE_PY_LOSS;
+      }
+      if (funcName.find("forward") != std::string::npos) {
+        DEBUG_LOG("critical name, kind=forward, funcName=%s\n",
+                  funcName.c_str());
+        return CRITICAL_TYPE_PY_FORWARD;
+      }
+    }
+
+    // Pytorch OP regex
+    if (std::regex_search(funcName, torchOPRegex)) {
+      DEBUG_LOG("critical name, kind=torch regex, funcName=%s\n",
+                funcName.c_str());
+      return CRITICAL_TYPE_TORCH_OP;
+    }
+
+    // TF OP regex
+    if (std::regex_search(funcName, tfOPRegex)) {
+      DEBUG_LOG("critical name, kind=tf regex, funcName=%s\n",
+                funcName.c_str());
+      return CRITICAL_TYPE_TF_OP;
+    }
+
+    return NOT_CRITICAL_NODE;
+  }
+
+  std::string pyFileName;
+  std::regex torchOPRegex;
+  std::regex tfOPRegex;
+  Shard shards[kNumShards];
+};
+
+// Builds pruned copies of CCTs, which only keep the critical nodes. A kept
+// node hangs under its nearest kept ancestor, and a torch op that is the only
+// child of a torch op is folded into the name of its kept ancestor.
+//
+// Trees are walked iteratively in pre-order, so deep python stacks do not
+// grow the C++ stack, and different trees are pruned in parallel. Pruned
+// views (CPUCCTPrunedView) are pruned by the same rules, only walking the
+// nodes the view kept.
+class CPUCCTPruner {
+public:
+  explicit CPUCCTPruner(uint32_t _nWorkers)
+      : nWorkers(std::max(_nWorkers, 1u)){};
+
+  ~CPUCCTPruner() { clear(); }
+
+  CPUCCTPruner(const CPUCCTPruner &) = delete;
+  CPUCCTPruner &operator=(const CPUCCTPruner &) = delete;
+
+  // the pruned trees are owned by the pruner until the next prune
+  void prune(CCTMAP_t &cctMap, CCTMAP_t &prunedMap) {
+    clear();
+    std::vector<std::pair<pid_t, CPUCCT *>> trees;
+    for (auto itr : cctMap) {
+      if (itr.second->root)
+        trees.push_back(itr);
+    }
+    prunedTrees.resize(trees.size(), nullptr);
+    ParallelFor(trees.size(), nWorkers, [this, &trees](size_t i) {
+      prunedTrees[i] = PruneTree(trees[i].second);
+    });
+    for (size_t i = 0; i < trees.size(); ++i)
+      prunedMap.insert(std::make_pair(trees[i].first, prunedTrees[i]));
+  }
+
+  // prune the views of the trees of viewMap, which have a CPUCCTPrunedView,
+  // the pruned trees are owned by the pruner until the next prune
+  void pruneViews(CCTMAP_t &viewMap, CCTMAP_t &prunedMap);
+
+  // tree must have a root, the caller owns the returned tree. If tree is the
+  // pruned view of rawTree, the op chains are told by the childs of the raw
+  // parents, and the copies left behind by CPUCCTPrunedView::onRename are
+  // skipped.
+  static CPUCCT *PruneTree(CPUCCT *tree, CPUCCT *rawTree = nullptr) {
+    CriticalNodeClassifier *classifier =
+        CriticalNodeClassifier::GetClassifier();
+    CPUCCT *prunedTree = new CPUCCT();
+    CPUCCTNode *prunedRoot = prunedTree->newNode();
+    CPUCCTNode::copyNodeWithoutRelation(tree->root, prunedRoot);
+    prunedTree->setRootNode(prunedRoot);
+
+    std::vector<Visit> toVisit;
+    std::vector<CPUCCTNode *> childs;
+    pushChildren(tree, rawTree, tree->root, prunedRoot, childs, toVisit);
+    while (!toVisit.empty()) {
+      Visit visit = toVisit.back();
+      toVisit.pop_back();
+      CPUCCTNode *node = visit.node;
+      CPUCCTNode *kept = visit.prunedParent;
+      CriticalNodeType type = classifier->classify(node);
+      if (type != NOT_CRITICAL_NODE) {
+        CPUCCTNode *parent =
+            rawTree ? rawTree->getParent(rawTree->getNode(node->prunedIdx))
+                    : visit.parent;
+        // for continus op calling, keep the first one/merge them?
+        if (type == CRITICAL_TYPE_TORCH_OP && parent->getNChilds() == 1 &&
+            classifier->classify(kept) == CRITICAL_TYPE_TORCH_OP) {
+          kept->setFuncName(kept->getFuncName() +
+                            "::" + node->getFuncName().substr(10));
+        } else {
+          kept = prunedTree->newNode();
+          // the pruned tree is full, node is folded into its kept ancestor
+          if (!kept) {
+            kept = visit.prunedParent;
+          } else {
+            CPUCCTNode::copyNodeWithoutRelation(node, kept);
+            prunedTree->insertNode(visit.prunedParent, kept, true);
+          }
+        }
+      }
+      pushChildren(tree, rawTree, node, kept, childs, toVisit);
+    }
+    return prunedTree;
+  }
+
+  // a node of the pruned view of rawTree that was copied again under another
+  // parent, see CPUCCTPrunedView::onRename
+  static bool IsStaleViewNode(CPUCCT *rawTree, CPUCCTNode *node) {
+    return rawTree->getNode(node->prunedIdx)->prunedIdx != node->idx;
+  }
+
+private:
+  struct Visit {
+    CPUCCTNode *node;
+    CPUCCTNode *parent;
+    // nearest kept ancestor of node, in the pruned tree
+    CPUCCTNode *prunedParent;
+  };
+
+  // children are pushed in reverse so that they are visited in order
+  static void pushChildren(CPUCCT *tree, CPUCCT *rawTree, CPUCCTNode *node,
+                           CPUCCTNode *kept, std::vector<CPUCCTNode *> &childs,
+                           std::vector<Visit> &toVisit) {
+    childs.clear();
+    tree->forEachChild(node, [rawTree, &childs](CPUCCTNode *child) {
+      if (!rawTree || !IsStaleViewNode(rawTree, child))
+        childs.push_back(child);
+    });
+    for (auto itr = childs.rbegin(); itr != childs.rend(); ++itr)
+      toVisit.push_back({*itr, node, kept});
+  }
+
+  void clear() {
+    for (CPUCCT *tree : prunedTrees)
+      delete tree;
+    prunedTrees.clear();
+  }
+
+  uint32_t nWorkers;
+  std::vector<CPUCCT *> prunedTrees;
+};
+
+// Pruned view of a CPUCCT, maintained while call paths are inserted into the
+// tree, so that pruning at export only walks the nodes of the view instead of
+// the whole tree. Every node of the tree carries the index of the view node
+// it is attributed to: its own copy if it is kept, else the copy of its
+// nearest kept ancestor.
+//
+// The view keeps a superset of what CPUCCTPruner keeps: nodes critical by
+// the name rules on insertion or on a rename, and the last frame of every
+// inserted path, since whether a node stays a leaf is not known on insertion.
+// CPUCCTPruner::pruneViews applies the rules of PRUNE_CCT to the view at
+// export, which drops the frames that are no longer leaves and folds the op
+// chains.
+class CPUCCTPrunedView : public CPUCCTObserver {
+public:
+  // rawTree must have its root and no other node yet
+  explicit CPUCCTPrunedView(CPUCCT *_rawTree) : rawTree(_rawTree) {
+    CPUCCTNode *root = tree.newNode();
+    CPUCCTNode::copyNodeWithoutRelation(rawTree->root, root);
+    tree.setRootNode(root);
+    root->prunedIdx = rawTree->root->idx;
+    rawTree->root->prunedIdx = root->idx;
+  }
+
+  // written by the writer of the raw tree, may be read concurrently
+  CPUCCT *getTree() { return &tree; }
+
+  void onInsert(CPUCCTNode *parent, CPUCCTNode *child) override {
+    child->prunedIdx = parent->prunedIdx;
+    CriticalNodeType type =
+        CriticalNodeClassifier::GetClassifier()->classifyName(
+            child->getFuncNameId(), child->nodeType == CCTNODE_TYPE_PY);
+    if (type != NOT_CRITICAL_NODE)
+      keep(child);
+  }
+
+  void onPathEnd(CPUCCTNode *node) override {
+    if (tree.getNode(node->prunedIdx)->id != node->id)
+      keep(node);
+  }
+
+  // A copy follows the name of its node. A node becoming critical is kept,
+  // and the nodes below it that were attributed past it are attributed to
+  // it. Their copies cannot move while the view is read, so they are copied
+  // again under it and the old copies are left out at export.
+  void onRename(CPUCCTNode *node) override {
+    CPUCCTNode *attributed = tree.getNode(node->prunedIdx);
+    if (attributed->id == node->id) {
+      attributed->nodeType = node->nodeType;
+      attributed->funcNameId.store(node->getFuncNameId(),
+                                   std::memory_order_release);
+      tree.touchNode(attributed);
+      return;
+    }
+    CriticalNodeType type =
+        CriticalNodeClassifier::GetClassifier()->classifyName(
+            node->getFuncNameId(), node->nodeType == CCTNODE_TYPE_PY);
+    if (type == NOT_CRITICAL_NODE)
+      return;
+    keep(node);
+    if (node->prunedIdx == attributed->idx)
+      return;
+
+    std::vector<CPUCCTNode *> toVisit;
+    auto pushChilds = [this, &toVisit](CPUCCTNode *n) {
+      rawTree->forEachChild(
+          n, [&toVisit](CPUCCTNode *child) { toVisit.push_back(child); });
+    };
+    pushChilds(node);
+    while (!toVisit.empty()) {
+      CPUCCTNode *n = toVisit.back();
+      toVisit.pop_back();
+      CPUCCTNode *viewParent = tree.getNode(rawTree->getParent(n)->prunedIdx);
+      CPUCCTNode *copy = tree.getNode(n->prunedIdx);
+      if (copy->id != n->id) {
+        // attributed to its nearest kept ancestor
+        if (copy == viewParent)
+          continue;
+        n->prunedIdx = viewParent->idx;
+      } else {
+        // the subtree of a copy in place is attributed in place
+        if (tree.getParent(copy) == viewParent)
+          continue;
+        n->prunedIdx = viewParent->idx;
+        keep(n);
+      }
+      pushChilds(n);
+    }
+  }
+
+  uint64_t getAttributedId(CPUCCTNode *node) override {
+    return tree.getNode(node->prunedIdx)->id;
+  }
+
+private:
+  // copy node under the view node it is attributed to so far
+  void keep(CPUCCTNode *node) {
+    CPUCCTNode *copy = tree.newNode();
+    // the view is full, node stays attributed to its kept ancestor
+    if (!copy)
+      return;
+    CPUCCTNode::copyNodeWithoutRelation(node, copy);
+    copy->prunedIdx = node->idx;
+    tree.insertNode(tree.getNode(node->prunedIdx), copy, true);
+    node->prunedIdx = copy->idx;
+  }
+
+  CPUCCT *rawTree;
+  CPUCCT tree;
+};
+
+inline void CPUCCTPruner::pruneViews(CCTMAP_t &viewMap, CCTMAP_t &prunedMap) {
+  clear();
+  std::vector<std::pair<pid_t, CPUCCT *>> trees(viewMap.begin(),
+                                                viewMap.end());
+  prunedTrees.resize(trees.size(), nullptr);
+  ParallelFor(trees.size(), nWorkers, [this, &trees](size_t i) {
+    CPUCCT *rawTree = trees[i].second;
+    CPUCCTPrunedView *view =
+        dynamic_cast<CPUCCTPrunedView *>(rawTree->getObserver());
+    prunedTrees[i] = PruneTree(view->getTree(), rawTree);
+  });
+  for (size_t i = 0; i < trees.size(); ++i)
+    prunedMap.insert(std::make_pair(trees[i].first, prunedTrees[i]));
+}
+
+/**
+ * @brief Get the CCT of thread tid, create and register it if not exists.
+ * Trees are created with a pruned view when PRUNE_CCT_INCREMENTAL is set.
+ *
+ * @param tid kernel thread id
+ * @return CPUCCT*
+ */
+static inline CPUCCT *GetThreadCPUCCT(pid_t tid) {
+  auto registry = CPUCCTRegistry::GetRegistry();
+  CPUCCT *cpuCCT = registry->find(tid);
+  if (cpuCCT)
+    return cpuCCT;
+
+  DEBUG_LOG("new CCT, tid=%d\n", tid);
+  // the cpu sampler thread inserts into the trees of other threads
+  CPUCCT *newCCT = new CPUCCT(GetProfilerConf()->enableCPUSampling);
+  // Set a virtual root node.
+  CPUCCTNode *vRootNode = newCCT->newNode();
+
+  vRootNode->id = CPUCCTNodeIdAllocator::NextId();
+
+  vRootNode->setFuncName("thread:" + std::to_string(tid) +
+                         "::id:" + std::to_string(vRootNode->id));
+  vRootNode->pc = 0;
+  vRootNode->offset = 0;
+  vRootNode->nodeType = CCTNODE_TYPE_CXX;
+
+  newCCT->setRootNode(vRootNode);
+  if (GetProfilerConf()->pruneCCT && GetProfilerConf()->pruneCCTIncremental)
+    newCCT->setObserver(new CPUCCTPrunedView(newCCT));
+  cpuCCT = registry->registerCCT(tid, newCCT);
+  if (cpuCCT != newCCT)
+    delete newCCT;
+  return cpuCCT;
+}
@@ -1,6 +1,36 @@
 #include "common.h"
 
+#include <atomic>
+#include <unistd.h>
+
+namespace {
+const uint32_t kMaxProfilerThreads = 64;
+std::atomic<pid_t> profilerTids[kMaxProfilerThreads];
+std::atomic<uint32_t> nProfilerTids(0);
+} // namespace
+
 ProfilerConf *GetProfilerConf() {
   static ProfilerConf *conf = new ProfilerConf();
   return conf;
-}
\ No newline at end of file
+}
+
+void RegisterProfilerThread() {
+  pid_t tid = gettid();
+  if (IsProfilerThread(tid))
+    return;
+  uint32_t idx = nProfilerTids.fetch_add(1);
+  if (idx < kMaxProfilerThreads)
+    profilerTids[idx].store(tid, std::memory_order_release);
+  else
+    DEBUG_LOG("too many profiler threads, thread %d is sampled\n", tid);
+}
+
+bool IsProfilerThread(pid_t tid) {
+  uint32_t n = std::min(nProfilerTids.load(std::memory_order_acquire),
+                        kMaxProfilerThreads);
+  for (uint32_t i = 0; i < n; ++i) {
+    if (profilerTids[i].load(std::memory_order_acquire) == tid)
+      return true;
+  }
+  return false;
+}
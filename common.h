@@ -89,22 +89,61 @@ public:
   uint64_t cpuSamplingPages = 128;
   int32_t cpuSamplingTimeout = -1;
   uint64_t cpuSamplingMaxDepth = 256;
+  // samples of the same stack are applied to the CCT once per window
+  uint64_t cpuSampleAggregationMs = 100;
+  // sample every thread of the process with per-cpu events instead of the
+  // threads launching kernels
+  bool cpuSamplingPerCPU = false;
 
   // event-driven cpu cct contruction configurations
   bool fakeBT = false;
   bool doCPUCallStackUnwinding = true;
   bool pruneCCT = false;
+  uint32_t pruneCCTWorkers = 4;
+  // maintain a pruned view of the cct while inserting, pruned at export
+  // instead of the whole cct
+  bool pruneCCTIncremental = false;
   bool checkRSP = true;
+  // per-thread stack signature cache of CHECK_RSP
+  uint32_t stackCacheSize = 1024;
+  uint32_t stackSignatureDepth = 4;
+  // unwind one in this many cache hits to detect false hits, 0 never
+  uint32_t stackCacheVerifyInterval = 64;
+  // build the cct of kernel launches in a background thread (pc sampling)
+  bool asyncCCTBuild = false;
+  // bytes of the per-thread ring of raw launch call stacks
+  uint64_t asyncCCTRingSize = 1 << 20;
+  // correlation ids whose call path is remembered for the gpu samples
+  uint32_t asyncCCTCorIdSlots = 1 << 16;
   bool syncBeforeStart = false;
   bool backTraceVerbose = false;
   bool doPyUnwinding = false;
   bool noRPC = false;
   bool noSampling = false;
   bool enableCPUSampling = false;
+  // comma-separated substrings of the paths of the objects whose frames are
+  // left out of call stacks
+  std::string excludeModules = "libcupti,libcuda.so";
+  bool excludeProfilerModule = true;
+  // native unwinder backend: cursor, backtrace or fp
+  std::string unwinder = "cursor";
+  // slots of the pc to symbol cache of unwinding, 0 disables it
+  uint64_t pcSymbolCacheSize = 1 << 16;
+  // slots of the (python code object, line) to frame names cache
+  uint64_t pyFrameCacheSize = 1 << 14;
+  // keep raw pcs in the cct and resolve their names at export
+  bool deferSymbolization = false;
+  uint32_t symbolizationWorkers = 4;
+  // merge the per-thread ccts into one at export
+  bool mergeCCT = false;
+  bool mergeCCTThreadIds = false;
+  uint32_t mergeCCTWorkers = 4;
 
   std::string backEnd = "TORCH";
   std::string pyFileName = "main.py";
   std::string dumpFileName = "profiling_response.pb.gz";
+  // "pb" for a serialized response, "mmap" for tools/profile_file.h
+  std::string dumpFormat = "pb";
 
   pthread_t mainThreadTid;
 
@@ -131,12 +170,38 @@ public:
               << std::endl;
     std::cout << "cpu pc sampling max depth    : " << cpuSamplingMaxDepth
               << std::endl;
+    std::cout << "cpu sample aggregation (ms)  : " << cpuSampleAggregationMs
+              << std::endl;
+    std::cout << "cpu sampling per cpu         : " << cpuSamplingPerCPU
+              << std::endl;
 
     std::cout << "fake CCT                     : " << fakeBT << std::endl;
     std::cout << "do CPU call stack unwinding  : " << doCPUCallStackUnwinding
               << std::endl;
     std::cout << "check rsp                    : " << checkRSP << std::endl;
+    if (checkRSP) {
+      std::cout << "stack cache size             : " << stackCacheSize
+                << std::endl;
+      std::cout << "stack signature depth        : " << stackSignatureDepth
+                << std::endl;
+      std::cout << "stack cache verify interval  : "
+                << stackCacheVerifyInterval << std::endl;
+    }
+    std::cout << "async cct build              : " << asyncCCTBuild
+              << std::endl;
+    if (asyncCCTBuild) {
+      std::cout << "async cct ring size          : " << asyncCCTRingSize
+                << std::endl;
+      std::cout << "async cct corid slots        : " << asyncCCTCorIdSlots
+                << std::endl;
+    }
     std::cout << "prune cct                    : " << pruneCCT << std::endl;
+    if (pruneCCT) {
+      std::cout << "prune cct workers            : " << pruneCCTWorkers
+                << std::endl;
+      std::cout << "prune cct incrementally      : " << pruneCCTIncremental
+                << std::endl;
+    }
     std::cout << "sync before start/stop       : " << syncBeforeStart
               << std::endl;
     std::cout << "backtrace verbose            : " << backTraceVerbose
@@ -148,11 +213,36 @@ public:
     std::cout << "enable CPU sampling          : " << enableCPUSampling
               << std::endl;
 
+    std::cout << "exclude modules              : " << excludeModules
+              << std::endl;
+    std::cout << "exclude profiler module      : " << excludeProfilerModule
+              << std::endl;
+    std::cout << "unwinder                     : " << unwinder << std::endl;
+    std::cout << "pc symbol cache size         : " << pcSymbolCacheSize
+              << std::endl;
+    std::cout << "py frame cache size          : " << pyFrameCacheSize
+              << std::endl;
+    std::cout << "defer symbolization          : " << deferSymbolization
+              << std::endl;
+    if (deferSymbolization) {
+      std::cout << "symbolization workers        : " << symbolizationWorkers
+                << std::endl;
+    }
+    std::cout << "merge cct                    : " << mergeCCT << std::endl;
+    if (mergeCCT) {
+      std::cout << "merge cct thread ids         : " << mergeCCTThreadIds
+                << std::endl;
+      std::cout << "merge cct workers            : " << mergeCCTWorkers
+                << std::endl;
+    }
+
     std::cout << "dl backend                   : " << backEnd << std::endl;
     std::cout << "python file name             : " << pyFileName << std::endl;
     if (noRPC) {
       std::cout << "dump file name (no)          : " << dumpFileName
                 << std::endl;
+      std::cout << "dump format                  : " << dumpFormat
+                << std::endl;
     }
 
     std::cout << "main thread tid              : " << mainThreadTid
@@ -192,12 +282,36 @@ private:
     if ((s = getenv("PRUNE_CCT")) != nullptr) {
       pruneCCT = std::strtol(s, nullptr, 10);
     }
+    if ((s = getenv("PRUNE_CCT_WORKERS")) != nullptr) {
+      pruneCCTWorkers = std::strtoul(s, nullptr, 10);
+    }
+    if ((s = getenv("PRUNE_CCT_INCREMENTAL")) != nullptr) {
+      pruneCCTIncremental = std::strtol(s, nullptr, 10);
+    }
     if ((s = getenv("DL_BACKEND")) != nullptr) {
       backEnd = s;
     }
     if ((s = getenv("CHECK_RSP")) != nullptr) {
       checkRSP = std::strtol(s, nullptr, 10);
     }
+    if ((s = getenv("STACK_CACHE_SIZE")) != nullptr) {
+      stackCacheSize = std::strtoul(s, nullptr, 10);
+    }
+    if ((s = getenv("STACK_SIGNATURE_DEPTH")) != nullptr) {
+      stackSignatureDepth = std::strtoul(s, nullptr, 10);
+    }
+    if ((s = getenv("STACK_CACHE_VERIFY_INTERVAL")) != nullptr) {
+      stackCacheVerifyInterval = std::strtoul(s, nullptr, 10);
+    }
+    if ((s = getenv("ASYNC_CCT_BUILD")) != nullptr) {
+      asyncCCTBuild = std::strtol(s, nullptr, 10);
+    }
+    if ((s = getenv("ASYNC_CCT_RING_SIZE")) != nullptr) {
+      asyncCCTRingSize = std::strtoull(s, nullptr, 10);
+    }
+    if ((s = getenv("ASYNC_CCT_CORID_SLOTS")) != nullptr) {
+      asyncCCTCorIdSlots = std::strtoul(s, nullptr, 10);
+    }
     if ((s = getenv("SYNC_BEFORE_START")) != nullptr) {
       syncBeforeStart = std::strtol(s, nullptr, 10);
     }
@@ -217,6 +331,9 @@ private:
     if ((s = getenv("DUMP_FN")) != nullptr) {
       dumpFileName = s;
     }
+    if ((s = getenv("DUMP_FORMAT")) != nullptr) {
+      dumpFormat = s;
+    }
     if ((s = getenv("NO_SAMPLING")) != nullptr) {
       noSampling = std::strtol(s, nullptr, 10);
     }
@@ -235,7 +352,60 @@ private:
     if ((s = getenv("CPU_SAMPLING_MAX_DEPTH")) != nullptr) {
       cpuSamplingMaxDepth = std::strtoul(s, nullptr, 10);
     }
+    if ((s = getenv("CPU_SAMPLE_AGGREGATION_MS")) != nullptr) {
+      cpuSampleAggregationMs = std::strtoul(s, nullptr, 10);
+    }
+    if ((s = getenv("CPU_SAMPLING_PER_CPU")) != nullptr) {
+      cpuSamplingPerCPU = std::strtol(s, nullptr, 10);
+    }
+    if ((s = getenv("EXCLUDE_MODULES")) != nullptr) {
+      excludeModules = s;
+    }
+    if ((s = getenv("EXCLUDE_PROFILER_MODULE")) != nullptr) {
+      excludeProfilerModule = std::strtol(s, nullptr, 10);
+    }
+    if ((s = getenv("UNWINDER")) != nullptr) {
+      std::string name = s;
+      if (name == "cursor" || name == "backtrace" || name == "fp")
+        unwinder = name;
+      else
+        std::cout << "unknown unwinder " << name << ", using " << unwinder
+                  << std::endl;
+    }
+    if ((s = getenv("PC_SYMBOL_CACHE_SIZE")) != nullptr) {
+      pcSymbolCacheSize = std::strtoull(s, nullptr, 10);
+    }
+    if ((s = getenv("PY_FRAME_CACHE_SIZE")) != nullptr) {
+      pyFrameCacheSize = std::strtoull(s, nullptr, 10);
+    }
+    if ((s = getenv("DEFER_SYMBOLIZATION")) != nullptr) {
+      deferSymbolization = std::strtol(s, nullptr, 10);
+    }
+    if ((s = getenv("SYMBOLIZATION_WORKERS")) != nullptr) {
+      symbolizationWorkers = std::strtoul(s, nullptr, 10);
+    }
+    if ((s = getenv("MERGE_CCT")) != nullptr) {
+      mergeCCT = std::strtol(s, nullptr, 10);
+    }
+    if ((s = getenv("MERGE_CCT_THREADS")) != nullptr) {
+      mergeCCTThreadIds = std::strtol(s, nullptr, 10);
+    }
+    if ((s = getenv("MERGE_CCT_WORKERS")) != nullptr) {
+      mergeCCTWorkers = std::strtoul(s, nullptr, 10);
+    }
+    // the incremental pruned view classifies the nodes by name on insertion
+    if (pruneCCT && pruneCCTIncremental)
+      deferSymbolization = false;
+    // tracing times kernels by call path at launch, and fake ccts have no
+    // call paths to build
+    if (noSampling || fakeBT)
+      asyncCCTBuild = false;
   }
 };
 
-ProfilerConf *GetProfilerConf();
\ No newline at end of file
+ProfilerConf *GetProfilerConf();
+
+// Threads of the profiler, left out of cpu sampling. A thread registers
+// itself, lookups take no lock.
+void RegisterProfilerThread();
+bool IsProfilerThread(pid_t tid);
\ No newline at end of file
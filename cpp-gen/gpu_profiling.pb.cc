@@ -50,13 +50,16 @@ constexpr CPUCallingContextNode::CPUCallingContextNode(
   , _childids_cached_byte_size_(0)
   , childpcs_()
   , _childpcs_cached_byte_size_(0)
+  , threadids_()
+  , _threadids_cached_byte_size_(0)
   , funcname_(&::PROTOBUF_NAMESPACE_ID::internal::fixed_address_empty_string)
   , id_(uint64_t{0u})
   , pc_(uint64_t{0u})
   , offset_(uint64_t{0u})
   , parentid_(uint64_t{0u})
   , parentpc_(uint64_t{0u})
-  , samples_(uint64_t{0u}){}
+  , samples_(uint64_t{0u})
+  , funcnameid_(0u){}
 struct CPUCallingContextNodeDefaultTypeInternal {
   constexpr CPUCallingContextNodeDefaultTypeInternal()
     : _instance(::PROTOBUF_NAMESPACE_ID::internal::ConstantInitialized{}) {}
@@ -167,7 +170,9 @@ struct CUptiPCSamplingDataDefaultTypeInternal {
 PROTOBUF_ATTRIBUTE_NO_DESTROY PROTOBUF_CONSTINIT CUptiPCSamplingDataDefaultTypeInternal _CUptiPCSamplingData_default_instance_;
 constexpr GPUProfilingRequest::GPUProfilingRequest(
   ::PROTOBUF_NAMESPACE_ID::internal::ConstantInitialized)
-  : duration_(0u){}
+  : sinceepoch_(uint64_t{0u})
+  , duration_(0u)
+  , inlinefuncnames_(false){}
 struct GPUProfilingRequestDefaultTypeInternal {
   constexpr GPUProfilingRequestDefaultTypeInternal()
     : _instance(::PROTOBUF_NAMESPACE_ID::internal::ConstantInitialized{}) {}
@@ -181,7 +186,11 @@ constexpr GPUProfilingResponse::GPUProfilingResponse(
   ::PROTOBUF_NAMESPACE_ID::internal::ConstantInitialized)
   : pcsamplingdata_()
   , cpucallingctxtree_()
+  , stringtable_()
   , message_(&::PROTOBUF_NAMESPACE_ID::internal::fixed_address_empty_string)
+  , epoch_(uint64_t{0u})
+  , cpusamples_(uint64_t{0u})
+  , cpulostsamples_(uint64_t{0u})
   , version_(false){}
 struct GPUProfilingResponseDefaultTypeInternal {
   constexpr GPUProfilingResponseDefaultTypeInternal()
@@ -234,6 +243,8 @@ const uint32_t TableStruct_gpu_5fprofiling_2eproto::offsets[] PROTOBUF_SECTION_V
   PROTOBUF_FIELD_OFFSET(::gpuprofiling::CPUCallingContextNode, childs_),
   PROTOBUF_FIELD_OFFSET(::gpuprofiling::CPUCallingContextNode, childids_),
   PROTOBUF_FIELD_OFFSET(::gpuprofiling::CPUCallingContextNode, childpcs_),
+  PROTOBUF_FIELD_OFFSET(::gpuprofiling::CPUCallingContextNode, funcnameid_),
+  PROTOBUF_FIELD_OFFSET(::gpuprofiling::CPUCallingContextNode, threadids_),
   ~0u,  // no _has_bits_
   PROTOBUF_FIELD_OFFSET(::gpuprofiling::GPUCallingGraphNode, _internal_metadata_),
   ~0u,  // no _extensions_
@@ -310,6 +321,8 @@ const uint32_t TableStruct_gpu_5fprofiling_2eproto::offsets[] PROTOBUF_SECTION_V
   ~0u,  // no _weak_field_map_
   ~0u,  // no _inlined_string_donated_
   PROTOBUF_FIELD_OFFSET(::gpuprofiling::GPUProfilingRequest, duration_),
+  PROTOBUF_FIELD_OFFSET(::gpuprofiling::GPUProfilingRequest, sinceepoch_),
+  PROTOBUF_FIELD_OFFSET(::gpuprofiling::GPUProfilingRequest, inlinefuncnames_),
   ~0u,  // no _has_bits_
   PROTOBUF_FIELD_OFFSET(::gpuprofiling::GPUProfilingResponse, _internal_metadata_),
   ~0u,  // no _extensions_
@@ -320,19 +333,23 @@ const uint32_t TableStruct_gpu_5fprofiling_2eproto::offsets[] PROTOBUF_SECTION_V
   PROTOBUF_FIELD_OFFSET(::gpuprofiling::GPUProfilingResponse, version_),
   PROTOBUF_FIELD_OFFSET(::gpuprofiling::GPUProfilingResponse, pcsamplingdata_),
   PROTOBUF_FIELD_OFFSET(::gpuprofiling::GPUProfilingResponse, cpucallingctxtree_),
+  PROTOBUF_FIELD_OFFSET(::gpuprofiling::GPUProfilingResponse, stringtable_),
+  PROTOBUF_FIELD_OFFSET(::gpuprofiling::GPUProfilingResponse, epoch_),
+  PROTOBUF_FIELD_OFFSET(::gpuprofiling::GPUProfilingResponse, cpusamples_),
+  PROTOBUF_FIELD_OFFSET(::gpuprofiling::GPUProfilingResponse, cpulostsamples_),
 };
 static const ::PROTOBUF_NAMESPACE_ID::internal::MigrationSchema schemas[] PROTOBUF_SECTION_VARIABLE(protodesc_cold) = {
   { 0, 8, -1, sizeof(::gpuprofiling::CPUCallingContextTree_NodeMapEntry_DoNotUse)},
   { 10, -1, -1, sizeof(::gpuprofiling::CPUCallingContextTree)},
   { 20, -1, -1, sizeof(::gpuprofiling::CPUCallingContextNode)},
-  { 36, -1, -1, sizeof(::gpuprofiling::GPUCallingGraphNode)},
-  { 47, -1, -1, sizeof(::gpuprofiling::GPUCallingGraphEdge)},
-  { 58, -1, -1, sizeof(::gpuprofiling::GPUCallingGraph)},
-  { 66, -1, -1, sizeof(::gpuprofiling::PCSamplingStallReason)},
-  { 74, -1, -1, sizeof(::gpuprofiling::CUptiPCSamplingPCData)},
-  { 90, -1, -1, sizeof(::gpuprofiling::CUptiPCSamplingData)},
-  { 105, -1, -1, sizeof(::gpuprofiling::GPUProfilingRequest)},
-  { 112, -1, -1, sizeof(::gpuprofiling::GPUProfilingResponse)},
+  { 38, -1, -1, sizeof(::gpuprofiling::GPUCallingGraphNode)},
+  { 49, -1, -1, sizeof(::gpuprofiling::GPUCallingGraphEdge)},
+  { 60, -1, -1, sizeof(::gpuprofiling::GPUCallingGraph)},
+  { 68, -1, -1, sizeof(::gpuprofiling::PCSamplingStallReason)},
+  { 76, -1, -1, sizeof(::gpuprofiling::CUptiPCSamplingPCData)},
+  { 92, -1, -1, sizeof(::gpuprofiling::CUptiPCSamplingData)},
+  { 107, -1, -1, sizeof(::gpuprofiling::GPUProfilingRequest)},
+  { 116, -1, -1, sizeof(::gpuprofiling::GPUProfilingResponse)},
 };
 
 static ::PROTOBUF_NAMESPACE_ID::Message const * const file_default_instances[] = {
@@ -357,49 +374,54 @@ const char descriptor_table_protodef_gpu_5fprofiling_2eproto[] PROTOBUF_SECTION_
   "\01320.gpuprofiling.CPUCallingContextTree.N"
   "odeMapEntry\032S\n\014NodeMapEntry\022\013\n\003key\030\001 \001(\003"
   "\0222\n\005value\030\002 \001(\0132#.gpuprofiling.CPUCallin"
-  "gContextNode:\0028\001\"\337\001\n\025CPUCallingContextNo"
+  "gContextNode:\0028\001\"\206\002\n\025CPUCallingContextNo"
   "de\022\n\n\002id\030\001 \001(\004\022\n\n\002pc\030\002 \001(\004\022\016\n\006offset\030\003 \001"
   "(\004\022\020\n\010funcName\030\004 \001(\t\022\020\n\010parentID\030\005 \001(\004\022\020"
   "\n\010parentPC\030\006 \001(\004\022\017\n\007samples\030\007 \001(\004\0223\n\006chi"
   "lds\030\010 \003(\0132#.gpuprofiling.CPUCallingConte"
   "xtNode\022\020\n\010childIDs\030\t \003(\004\022\020\n\010childPCs\030\n \003"
-  "(\004\"m\n\023GPUCallingGraphNode\022\020\n\010cubinCrc\030\001 "
-  "\001(\004\022\020\n\010funcName\030\002 \001(\t\022\021\n\taddrBegin\030\003 \001(\004"
-  "\022\017\n\007addrEnd\030\004 \001(\004\022\016\n\006weight\030\005 \001(\004\"y\n\023GPU"
-  "CallingGraphEdge\022\023\n\013srcFuncName\030\001 \001(\t\022\023\n"
-  "\013srcPCOffset\030\002 \001(\004\022\023\n\013dstFuncName\030\003 \001(\t\022"
-  "\023\n\013dstPCOffset\030\004 \001(\004\022\016\n\006weight\030\005 \001(\004\"u\n\017"
-  "GPUCallingGraph\0220\n\005nodes\030\001 \003(\0132!.gpuprof"
-  "iling.GPUCallingGraphNode\0220\n\005edges\030\002 \003(\013"
-  "2!.gpuprofiling.GPUCallingGraphEdge\"L\n\025P"
-  "CSamplingStallReason\022\"\n\032pcSamplingStallR"
-  "easonIndex\030\001 \001(\r\022\017\n\007samples\030\002 \001(\r\"\205\002\n\025CU"
-  "ptiPCSamplingPCData\022\014\n\004size\030\001 \001(\r\022\020\n\010cub"
-  "inCrc\030\002 \001(\004\022\020\n\010pcOffset\030\003 \001(\004\022\025\n\rfunctio"
-  "nIndex\030\004 \001(\r\022\013\n\003pad\030\005 \001(\r\022\024\n\014functionNam"
-  "e\030\006 \001(\t\022\030\n\020stallReasonCount\030\007 \001(\r\0228\n\013sta"
-  "llReason\030\010 \003(\0132#.gpuprofiling.PCSampling"
-  "StallReason\022\025\n\rparentCPUPCID\030\t \001(\003\022\025\n\rco"
-  "rrelationId\030\n \001(\r\"\200\002\n\023CUptiPCSamplingDat"
-  "a\022\014\n\004size\030\001 \001(\r\022\025\n\rcollectNumPcs\030\002 \001(\r\022\024"
-  "\n\014totalSamples\030\003 \001(\004\022\026\n\016droppedSamples\030\004"
-  " \001(\004\022\023\n\013totalNumPcs\030\005 \001(\r\022\027\n\017remainingNu"
-  "mPcs\030\006 \001(\r\022\017\n\007rangeId\030\007 \001(\004\0224\n\007pPcData\030\010"
-  " \003(\0132#.gpuprofiling.CUptiPCSamplingPCDat"
-  "a\022!\n\031nonUsrKernelsTotalSamples\030\t \001(\004\"\'\n\023"
-  "GPUProfilingRequest\022\020\n\010duration\030\001 \001(\r\"\263\001"
-  "\n\024GPUProfilingResponse\022\017\n\007message\030\001 \001(\t\022"
-  "\017\n\007version\030\002 \001(\010\0229\n\016pcSamplingData\030\003 \003(\013"
-  "2!.gpuprofiling.CUptiPCSamplingData\022>\n\021c"
-  "puCallingCtxTree\030\004 \003(\0132#.gpuprofiling.CP"
-  "UCallingContextTree2u\n\023GPUProfilingServi"
-  "ce\022^\n\023PerformGPUProfiling\022!.gpuprofiling"
-  ".GPUProfilingRequest\032\".gpuprofiling.GPUP"
-  "rofilingResponse\"\000B\n\242\002\007GPUPROFb\006proto3"
+  "(\004\022\022\n\nfuncNameID\030\013 \001(\r\022\021\n\tthreadIDs\030\014 \003("
+  "\r\"m\n\023GPUCallingGraphNode\022\020\n\010cubinCrc\030\001 \001"
+  "(\004\022\020\n\010funcName\030\002 \001(\t\022\021\n\taddrBegin\030\003 \001(\004\022"
+  "\017\n\007addrEnd\030\004 \001(\004\022\016\n\006weight\030\005 \001(\004\"y\n\023GPUC"
+  "allingGraphEdge\022\023\n\013srcFuncName\030\001 \001(\t\022\023\n\013"
+  "srcPCOffset\030\002 \001(\004\022\023\n\013dstFuncName\030\003 \001(\t\022\023"
+  "\n\013dstPCOffset\030\004 \001(\004\022\016\n\006weight\030\005 \001(\004\"u\n\017G"
+  "PUCallingGraph\0220\n\005nodes\030\001 \003(\0132!.gpuprofi"
+  "ling.GPUCallingGraphNode\0220\n\005edges\030\002 \003(\0132"
+  "!.gpuprofiling.GPUCallingGraphEdge\"L\n\025PC"
+  "SamplingStallReason\022\"\n\032pcSamplingStallRe"
+  "asonIndex\030\001 \001(\r\022\017\n\007samples\030\002 \001(\r\"\205\002\n\025CUp"
+  "tiPCSamplingPCData\022\014\n\004size\030\001 \001(\r\022\020\n\010cubi"
+  "nCrc\030\002 \001(\004\022\020\n\010pcOffset\030\003 \001(\004\022\025\n\rfunction"
+  "Index\030\004 \001(\r\022\013\n\003pad\030\005 \001(\r\022\024\n\014functionName"
+  "\030\006 \001(\t\022\030\n\020stallReasonCount\030\007 \001(\r\0228\n\013stal"
+  "lReason\030\010 \003(\0132#.gpuprofiling.PCSamplingS"
+  "tallReason\022\025\n\rparentCPUPCID\030\t \001(\003\022\025\n\rcor"
+  "relationId\030\n \001(\r\"\200\002\n\023CUptiPCSamplingData"
+  "\022\014\n\004size\030\001 \001(\r\022\025\n\rcollectNumPcs\030\002 \001(\r\022\024\n"
+  "\014totalSamples\030\003 \001(\004\022\026\n\016droppedSamples\030\004 "
+  "\001(\004\022\023\n\013totalNumPcs\030\005 \001(\r\022\027\n\017remainingNum"
+  "Pcs\030\006 \001(\r\022\017\n\007rangeId\030\007 \001(\004\0224\n\007pPcData\030\010 "
+  "\003(\0132#.gpuprofiling.CUptiPCSamplingPCData"
+  "\022!\n\031nonUsrKernelsTotalSamples\030\t \001(\004\"T\n\023G"
+  "PUProfilingRequest\022\020\n\010duration\030\001 \001(\r\022\022\n\n"
+  "sinceEpoch\030\002 \001(\004\022\027\n\017inlineFuncNames\030\003 \001("
+  "\010\"\203\002\n\024GPUProfilingResponse\022\017\n\007message\030\001 "
+  "\001(\t\022\017\n\007version\030\002 \001(\010\0229\n\016pcSamplingData\030\003"
+  " \003(\0132!.gpuprofiling.CUptiPCSamplingData\022"
+  ">\n\021cpuCallingCtxTree\030\004 \003(\0132#.gpuprofilin"
+  "g.CPUCallingContextTree\022\023\n\013stringTable\030\005"
+  " \003(\t\022\r\n\005epoch\030\006 \001(\004\022\022\n\ncpuSamples\030\007 \001(\004\022"
+  "\026\n\016cpuLostSamples\030\010 \001(\0042u\n\023GPUProfilingS"
+  "ervice\022^\n\023PerformGPUProfiling\022!.gpuprofi"
+  "ling.GPUProfilingRequest\032\".gpuprofiling."
+  "GPUProfilingResponse\"\000B\n\242\002\007GPUPROFb\006prot"
+  "o3"
   ;
 static ::PROTOBUF_NAMESPACE_ID::internal::once_flag descriptor_table_gpu_5fprofiling_2eproto_once;
 const ::PROTOBUF_NAMESPACE_ID::internal::DescriptorTable descriptor_table_gpu_5fprofiling_2eproto = {
-  false, false, 1838, descriptor_table_protodef_gpu_5fprofiling_2eproto, "gpu_profiling.proto", 
+  false, false, 2002, descriptor_table_protodef_gpu_5fprofiling_2eproto, "gpu_profiling.proto", 
   &descriptor_table_gpu_5fprofiling_2eproto_once, nullptr, 0, 11,
   schemas, file_default_instances, TableStruct_gpu_5fprofiling_2eproto::offsets,
   file_level_metadata_gpu_5fprofiling_2eproto, file_level_enum_descriptors_gpu_5fprofiling_2eproto, file_level_service_descriptors_gpu_5fprofiling_2eproto,
@@ -752,7 +774,8 @@ CPUCallingContextNode::CPUCallingContextNode(::PROTOBUF_NAMESPACE_ID::Arena* are
   : ::PROTOBUF_NAMESPACE_ID::Message(arena, is_message_owned),
   childs_(arena),
   childids_(arena),
-  childpcs_(arena) {
+  childpcs_(arena),
+  threadids_(arena) {
   SharedCtor();
   if (!is_message_owned) {
     RegisterArenaDtor(arena);
@@ -763,7 +786,8 @@ CPUCallingContextNode::CPUCallingContextNode(const CPUCallingContextNode& from)
   : ::PROTOBUF_NAMESPACE_ID::Message(),
       childs_(from.childs_),
       childids_(from.childids_),
-      childpcs_(from.childpcs_) {
+      childpcs_(from.childpcs_),
+      threadids_(from.threadids_) {
   _internal_metadata_.MergeFrom<::PROTOBUF_NAMESPACE_ID::UnknownFieldSet>(from._internal_metadata_);
   funcname_.UnsafeSetDefault(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited());
   #ifdef PROTOBUF_FORCE_COPY_DEFAULT_STRING
@@ -774,8 +798,8 @@ CPUCallingContextNode::CPUCallingContextNode(const CPUCallingContextNode& from)
       GetArenaForAllocation());
   }
   ::memcpy(&id_, &from.id_,
-    static_cast<size_t>(reinterpret_cast<char*>(&samples_) -
-    reinterpret_cast<char*>(&id_)) + sizeof(samples_));
+    static_cast<size_t>(reinterpret_cast<char*>(&funcnameid_) -
+    reinterpret_cast<char*>(&id_)) + sizeof(funcnameid_));
   // @@protoc_insertion_point(copy_constructor:gpuprofiling.CPUCallingContextNode)
 }
 
@@ -786,8 +810,8 @@ funcname_.UnsafeSetDefault(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlr
 #endif // PROTOBUF_FORCE_COPY_DEFAULT_STRING
 ::memset(reinterpret_cast<char*>(this) + static_cast<size_t>(
     reinterpret_cast<char*>(&id_) - reinterpret_cast<char*>(this)),
-    0, static_cast<size_t>(reinterpret_cast<char*>(&samples_) -
-    reinterpret_cast<char*>(&id_)) + sizeof(samples_));
+    0, static_cast<size_t>(reinterpret_cast<char*>(&funcnameid_) -
+    reinterpret_cast<char*>(&id_)) + sizeof(funcnameid_));
 }
 
 CPUCallingContextNode::~CPUCallingContextNode() {
@@ -821,10 +845,11 @@ void CPUCallingContextNode::Clear() {
   childs_.Clear();
   childids_.Clear();
   childpcs_.Clear();
+  threadids_.Clear();
   funcname_.ClearToEmpty();
   ::memset(&id_, 0, static_cast<size_t>(
-      reinterpret_cast<char*>(&samples_) -
-      reinterpret_cast<char*>(&id_)) + sizeof(samples_));
+      reinterpret_cast<char*>(&funcnameid_) -
+      reinterpret_cast<char*>(&id_)) + sizeof(funcnameid_));
   _internal_metadata_.Clear<::PROTOBUF_NAMESPACE_ID::UnknownFieldSet>();
 }
 
@@ -927,6 +952,25 @@ const char* CPUCallingContextNode::_InternalParse(const char* ptr, ::PROTOBUF_NA
         } else
           goto handle_unusual;
         continue;
+      // uint32 funcNameID = 11;
+      case 11:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<uint8_t>(tag) == 88)) {
+          funcnameid_ = ::PROTOBUF_NAMESPACE_ID::internal::ReadVarint32(&ptr);
+          CHK_(ptr);
+        } else
+          goto handle_unusual;
+        continue;
+      // repeated uint32 threadIDs = 12;
+      case 12:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<uint8_t>(tag) == 98)) {
+          ptr = ::PROTOBUF_NAMESPACE_ID::internal::PackedUInt32Parser(_internal_mutable_threadids(), ptr, ctx);
+          CHK_(ptr);
+        } else if (static_cast<uint8_t>(tag) == 96) {
+          _internal_add_threadids(::PROTOBUF_NAMESPACE_ID::internal::ReadVarint32(&ptr));
+          CHK_(ptr);
+        } else
+          goto handle_unusual;
+        continue;
       default:
         goto handle_unusual;
     }  // switch
@@ -1028,6 +1072,21 @@ uint8_t* CPUCallingContextNode::_InternalSerialize(
     }
   }
 
+  // uint32 funcNameID = 11;
+  if (this->_internal_funcnameid() != 0) {
+    target = stream->EnsureSpace(target);
+    target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::WriteUInt32ToArray(11, this->_internal_funcnameid(), target);
+  }
+
+  // repeated uint32 threadIDs = 12;
+  {
+    int byte_size = _threadids_cached_byte_size_.load(std::memory_order_relaxed);
+    if (byte_size > 0) {
+      target = stream->WriteUInt32Packed(
+          12, _internal_threadids(), byte_size, target);
+    }
+  }
+
   if (PROTOBUF_PREDICT_FALSE(_internal_metadata_.have_unknown_fields())) {
     target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormat::InternalSerializeUnknownFieldsToArray(
         _internal_metadata_.unknown_fields<::PROTOBUF_NAMESPACE_ID::UnknownFieldSet>(::PROTOBUF_NAMESPACE_ID::UnknownFieldSet::default_instance), target, stream);
@@ -1081,6 +1140,21 @@ size_t CPUCallingContextNode::ByteSizeLong() const {
     total_size += data_size;
   }
 
+  // repeated uint32 threadIDs = 12;
+  {
+    size_t data_size = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::
+      UInt32Size(this->threadids_);
+    if (data_size > 0) {
+      total_size += 1 +
+        ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::Int32Size(
+            static_cast<int32_t>(data_size));
+    }
+    int cached_size = ::PROTOBUF_NAMESPACE_ID::internal::ToCachedSize(data_size);
+    _threadids_cached_byte_size_.store(cached_size,
+                                    std::memory_order_relaxed);
+    total_size += data_size;
+  }
+
   // string funcName = 4;
   if (!this->_internal_funcname().empty()) {
     total_size += 1 +
@@ -1118,6 +1192,11 @@ size_t CPUCallingContextNode::ByteSizeLong() const {
     total_size += ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::UInt64SizePlusOne(this->_internal_samples());
   }
 
+  // uint32 funcNameID = 11;
+  if (this->_internal_funcnameid() != 0) {
+    total_size += ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::UInt32SizePlusOne(this->_internal_funcnameid());
+  }
+
   return MaybeComputeUnknownFieldsSize(total_size, &_cached_size_);
 }
 
@@ -1143,6 +1222,7 @@ void CPUCallingContextNode::MergeFrom(const CPUCallingContextNode& from) {
   childs_.MergeFrom(from.childs_);
   childids_.MergeFrom(from.childids_);
   childpcs_.MergeFrom(from.childpcs_);
+  threadids_.MergeFrom(from.threadids_);
   if (!from._internal_funcname().empty()) {
     _internal_set_funcname(from._internal_funcname());
   }
@@ -1164,6 +1244,9 @@ void CPUCallingContextNode::MergeFrom(const CPUCallingContextNode& from) {
   if (from._internal_samples() != 0) {
     _internal_set_samples(from._internal_samples());
   }
+  if (from._internal_funcnameid() != 0) {
+    _internal_set_funcnameid(from._internal_funcnameid());
+  }
   _internal_metadata_.MergeFrom<::PROTOBUF_NAMESPACE_ID::UnknownFieldSet>(from._internal_metadata_);
 }
 
@@ -1186,14 +1269,15 @@ void CPUCallingContextNode::InternalSwap(CPUCallingContextNode* other) {
   childs_.InternalSwap(&other->childs_);
   childids_.InternalSwap(&other->childids_);
   childpcs_.InternalSwap(&other->childpcs_);
+  threadids_.InternalSwap(&other->threadids_);
   ::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr::InternalSwap(
       &::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited(),
       &funcname_, lhs_arena,
       &other->funcname_, rhs_arena
   );
   ::PROTOBUF_NAMESPACE_ID::internal::memswap<
-      PROTOBUF_FIELD_OFFSET(CPUCallingContextNode, samples_)
-      + sizeof(CPUCallingContextNode::samples_)
+      PROTOBUF_FIELD_OFFSET(CPUCallingContextNode, funcnameid_)
+      + sizeof(CPUCallingContextNode::funcnameid_)
       - PROTOBUF_FIELD_OFFSET(CPUCallingContextNode, id_)>(
           reinterpret_cast<char*>(&id_),
           reinterpret_cast<char*>(&other->id_));
@@ -3099,12 +3183,17 @@ GPUProfilingRequest::GPUProfilingRequest(::PROTOBUF_NAMESPACE_ID::Arena* arena,
 GPUProfilingRequest::GPUProfilingRequest(const GPUProfilingRequest& from)
   : ::PROTOBUF_NAMESPACE_ID::Message() {
   _internal_metadata_.MergeFrom<::PROTOBUF_NAMESPACE_ID::UnknownFieldSet>(from._internal_metadata_);
-  duration_ = from.duration_;
+  ::memcpy(&sinceepoch_, &from.sinceepoch_,
+    static_cast<size_t>(reinterpret_cast<char*>(&inlinefuncnames_) -
+    reinterpret_cast<char*>(&sinceepoch_)) + sizeof(inlinefuncnames_));
   // @@protoc_insertion_point(copy_constructor:gpuprofiling.GPUProfilingRequest)
 }
 
 inline void GPUProfilingRequest::SharedCtor() {
-duration_ = 0u;
+::memset(reinterpret_cast<char*>(this) + static_cast<size_t>(
+    reinterpret_cast<char*>(&sinceepoch_) - reinterpret_cast<char*>(this)),
+    0, static_cast<size_t>(reinterpret_cast<char*>(&inlinefuncnames_) -
+    reinterpret_cast<char*>(&sinceepoch_)) + sizeof(inlinefuncnames_));
 }
 
 GPUProfilingRequest::~GPUProfilingRequest() {
@@ -3134,7 +3223,9 @@ void GPUProfilingRequest::Clear() {
   // Prevent compiler warnings about cached_has_bits being unused
   (void) cached_has_bits;
 
-  duration_ = 0u;
+  ::memset(&sinceepoch_, 0, static_cast<size_t>(
+      reinterpret_cast<char*>(&inlinefuncnames_) -
+      reinterpret_cast<char*>(&sinceepoch_)) + sizeof(inlinefuncnames_));
   _internal_metadata_.Clear<::PROTOBUF_NAMESPACE_ID::UnknownFieldSet>();
 }
 
@@ -3152,6 +3243,22 @@ const char* GPUProfilingRequest::_InternalParse(const char* ptr, ::PROTOBUF_NAME
         } else
           goto handle_unusual;
         continue;
+      // uint64 sinceEpoch = 2;
+      case 2:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<uint8_t>(tag) == 16)) {
+          sinceepoch_ = ::PROTOBUF_NAMESPACE_ID::internal::ReadVarint64(&ptr);
+          CHK_(ptr);
+        } else
+          goto handle_unusual;
+        continue;
+      // bool inlineFuncNames = 3;
+      case 3:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<uint8_t>(tag) == 24)) {
+          inlinefuncnames_ = ::PROTOBUF_NAMESPACE_ID::internal::ReadVarint64(&ptr);
+          CHK_(ptr);
+        } else
+          goto handle_unusual;
+        continue;
       default:
         goto handle_unusual;
     }  // switch
@@ -3187,6 +3294,18 @@ uint8_t* GPUProfilingRequest::_InternalSerialize(
     target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::WriteUInt32ToArray(1, this->_internal_duration(), target);
   }
 
+  // uint64 sinceEpoch = 2;
+  if (this->_internal_sinceepoch() != 0) {
+    target = stream->EnsureSpace(target);
+    target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::WriteUInt64ToArray(2, this->_internal_sinceepoch(), target);
+  }
+
+  // bool inlineFuncNames = 3;
+  if (this->_internal_inlinefuncnames() != 0) {
+    target = stream->EnsureSpace(target);
+    target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::WriteBoolToArray(3, this->_internal_inlinefuncnames(), target);
+  }
+
   if (PROTOBUF_PREDICT_FALSE(_internal_metadata_.have_unknown_fields())) {
     target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormat::InternalSerializeUnknownFieldsToArray(
         _internal_metadata_.unknown_fields<::PROTOBUF_NAMESPACE_ID::UnknownFieldSet>(::PROTOBUF_NAMESPACE_ID::UnknownFieldSet::default_instance), target, stream);
@@ -3203,11 +3322,21 @@ size_t GPUProfilingRequest::ByteSizeLong() const {
   // Prevent compiler warnings about cached_has_bits being unused
   (void) cached_has_bits;
 
+  // uint64 sinceEpoch = 2;
+  if (this->_internal_sinceepoch() != 0) {
+    total_size += ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::UInt64SizePlusOne(this->_internal_sinceepoch());
+  }
+
   // uint32 duration = 1;
   if (this->_internal_duration() != 0) {
     total_size += ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::UInt32SizePlusOne(this->_internal_duration());
   }
 
+  // bool inlineFuncNames = 3;
+  if (this->_internal_inlinefuncnames() != 0) {
+    total_size += 1 + 1;
+  }
+
   return MaybeComputeUnknownFieldsSize(total_size, &_cached_size_);
 }
 
@@ -3230,9 +3359,15 @@ void GPUProfilingRequest::MergeFrom(const GPUProfilingRequest& from) {
   uint32_t cached_has_bits = 0;
   (void) cached_has_bits;
 
+  if (from._internal_sinceepoch() != 0) {
+    _internal_set_sinceepoch(from._internal_sinceepoch());
+  }
   if (from._internal_duration() != 0) {
     _internal_set_duration(from._internal_duration());
   }
+  if (from._internal_inlinefuncnames() != 0) {
+    _internal_set_inlinefuncnames(from._internal_inlinefuncnames());
+  }
   _internal_metadata_.MergeFrom<::PROTOBUF_NAMESPACE_ID::UnknownFieldSet>(from._internal_metadata_);
 }
 
@@ -3250,7 +3385,12 @@ bool GPUProfilingRequest::IsInitialized() const {
 void GPUProfilingRequest::InternalSwap(GPUProfilingRequest* other) {
   using std::swap;
   _internal_metadata_.InternalSwap(&other->_internal_metadata_);
-  swap(duration_, other->duration_);
+  ::PROTOBUF_NAMESPACE_ID::internal::memswap<
+      PROTOBUF_FIELD_OFFSET(GPUProfilingRequest, inlinefuncnames_)
+      + sizeof(GPUProfilingRequest::inlinefuncnames_)
+      - PROTOBUF_FIELD_OFFSET(GPUProfilingRequest, sinceepoch_)>(
+          reinterpret_cast<char*>(&sinceepoch_),
+          reinterpret_cast<char*>(&other->sinceepoch_));
 }
 
 ::PROTOBUF_NAMESPACE_ID::Metadata GPUProfilingRequest::GetMetadata() const {
@@ -3269,7 +3409,8 @@ GPUProfilingResponse::GPUProfilingResponse(::PROTOBUF_NAMESPACE_ID::Arena* arena
                          bool is_message_owned)
   : ::PROTOBUF_NAMESPACE_ID::Message(arena, is_message_owned),
   pcsamplingdata_(arena),
-  cpucallingctxtree_(arena) {
+  cpucallingctxtree_(arena),
+  stringtable_(arena) {
   SharedCtor();
   if (!is_message_owned) {
     RegisterArenaDtor(arena);
@@ -3279,7 +3420,8 @@ GPUProfilingResponse::GPUProfilingResponse(::PROTOBUF_NAMESPACE_ID::Arena* arena
 GPUProfilingResponse::GPUProfilingResponse(const GPUProfilingResponse& from)
   : ::PROTOBUF_NAMESPACE_ID::Message(),
       pcsamplingdata_(from.pcsamplingdata_),
-      cpucallingctxtree_(from.cpucallingctxtree_) {
+      cpucallingctxtree_(from.cpucallingctxtree_),
+      stringtable_(from.stringtable_) {
   _internal_metadata_.MergeFrom<::PROTOBUF_NAMESPACE_ID::UnknownFieldSet>(from._internal_metadata_);
   message_.UnsafeSetDefault(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited());
   #ifdef PROTOBUF_FORCE_COPY_DEFAULT_STRING
@@ -3289,7 +3431,9 @@ GPUProfilingResponse::GPUProfilingResponse(const GPUProfilingResponse& from)
     message_.Set(::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr::EmptyDefault{}, from._internal_message(), 
       GetArenaForAllocation());
   }
-  version_ = from.version_;
+  ::memcpy(&epoch_, &from.epoch_,
+    static_cast<size_t>(reinterpret_cast<char*>(&version_) -
+    reinterpret_cast<char*>(&epoch_)) + sizeof(version_));
   // @@protoc_insertion_point(copy_constructor:gpuprofiling.GPUProfilingResponse)
 }
 
@@ -3298,7 +3442,10 @@ message_.UnsafeSetDefault(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlre
 #ifdef PROTOBUF_FORCE_COPY_DEFAULT_STRING
   message_.Set(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited(), "", GetArenaForAllocation());
 #endif // PROTOBUF_FORCE_COPY_DEFAULT_STRING
-version_ = false;
+::memset(reinterpret_cast<char*>(this) + static_cast<size_t>(
+    reinterpret_cast<char*>(&epoch_) - reinterpret_cast<char*>(this)),
+    0, static_cast<size_t>(reinterpret_cast<char*>(&version_) -
+    reinterpret_cast<char*>(&epoch_)) + sizeof(version_));
 }
 
 GPUProfilingResponse::~GPUProfilingResponse() {
@@ -3331,8 +3478,11 @@ void GPUProfilingResponse::Clear() {
 
   pcsamplingdata_.Clear();
   cpucallingctxtree_.Clear();
+  stringtable_.Clear();
   message_.ClearToEmpty();
-  version_ = false;
+  ::memset(&epoch_, 0, static_cast<size_t>(
+      reinterpret_cast<char*>(&version_) -
+      reinterpret_cast<char*>(&epoch_)) + sizeof(version_));
   _internal_metadata_.Clear<::PROTOBUF_NAMESPACE_ID::UnknownFieldSet>();
 }
 
@@ -3386,6 +3536,45 @@ const char* GPUProfilingResponse::_InternalParse(const char* ptr, ::PROTOBUF_NAM
         } else
           goto handle_unusual;
         continue;
+      // repeated string stringTable = 5;
+      case 5:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<uint8_t>(tag) == 42)) {
+          ptr -= 1;
+          do {
+            ptr += 1;
+            auto str = _internal_add_stringtable();
+            ptr = ::PROTOBUF_NAMESPACE_ID::internal::InlineGreedyStringParser(str, ptr, ctx);
+            CHK_(::PROTOBUF_NAMESPACE_ID::internal::VerifyUTF8(str, "gpuprofiling.GPUProfilingResponse.stringTable"));
+            CHK_(ptr);
+            if (!ctx->DataAvailable(ptr)) break;
+          } while (::PROTOBUF_NAMESPACE_ID::internal::ExpectTag<42>(ptr));
+        } else
+          goto handle_unusual;
+        continue;
+      // uint64 epoch = 6;
+      case 6:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<uint8_t>(tag) == 48)) {
+          epoch_ = ::PROTOBUF_NAMESPACE_ID::internal::ReadVarint64(&ptr);
+          CHK_(ptr);
+        } else
+          goto handle_unusual;
+        continue;
+      // uint64 cpuSamples = 7;
+      case 7:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<uint8_t>(tag) == 56)) {
+          cpusamples_ = ::PROTOBUF_NAMESPACE_ID::internal::ReadVarint64(&ptr);
+          CHK_(ptr);
+        } else
+          goto handle_unusual;
+        continue;
+      // uint64 cpuLostSamples = 8;
+      case 8:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<uint8_t>(tag) == 64)) {
+          cpulostsamples_ = ::PROTOBUF_NAMESPACE_ID::internal::ReadVarint64(&ptr);
+          CHK_(ptr);
+        } else
+          goto handle_unusual;
+        continue;
       default:
         goto handle_unusual;
     }  // switch
@@ -3447,6 +3636,34 @@ uint8_t* GPUProfilingResponse::_InternalSerialize(
       InternalWriteMessage(4, this->_internal_cpucallingctxtree(i), target, stream);
   }
 
+  // repeated string stringTable = 5;
+  for (int i = 0, n = this->_internal_stringtable_size(); i < n; i++) {
+    const auto& s = this->_internal_stringtable(i);
+    ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::VerifyUtf8String(
+      s.data(), static_cast<int>(s.length()),
+      ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::SERIALIZE,
+      "gpuprofiling.GPUProfilingResponse.stringTable");
+    target = stream->WriteString(5, s, target);
+  }
+
+  // uint64 epoch = 6;
+  if (this->_internal_epoch() != 0) {
+    target = stream->EnsureSpace(target);
+    target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::WriteUInt64ToArray(6, this->_internal_epoch(), target);
+  }
+
+  // uint64 cpuSamples = 7;
+  if (this->_internal_cpusamples() != 0) {
+    target = stream->EnsureSpace(target);
+    target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::WriteUInt64ToArray(7, this->_internal_cpusamples(), target);
+  }
+
+  // uint64 cpuLostSamples = 8;
+  if (this->_internal_cpulostsamples() != 0) {
+    target = stream->EnsureSpace(target);
+    target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::WriteUInt64ToArray(8, this->_internal_cpulostsamples(), target);
+  }
+
   if (PROTOBUF_PREDICT_FALSE(_internal_metadata_.have_unknown_fields())) {
     target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormat::InternalSerializeUnknownFieldsToArray(
         _internal_metadata_.unknown_fields<::PROTOBUF_NAMESPACE_ID::UnknownFieldSet>(::PROTOBUF_NAMESPACE_ID::UnknownFieldSet::default_instance), target, stream);
@@ -3477,6 +3694,14 @@ size_t GPUProfilingResponse::ByteSizeLong() const {
       ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::MessageSize(msg);
   }
 
+  // repeated string stringTable = 5;
+  total_size += 1 *
+      ::PROTOBUF_NAMESPACE_ID::internal::FromIntSize(stringtable_.size());
+  for (int i = 0, n = stringtable_.size(); i < n; i++) {
+    total_size += ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::StringSize(
+      stringtable_.Get(i));
+  }
+
   // string message = 1;
   if (!this->_internal_message().empty()) {
     total_size += 1 +
@@ -3484,6 +3709,21 @@ size_t GPUProfilingResponse::ByteSizeLong() const {
         this->_internal_message());
   }
 
+  // uint64 epoch = 6;
+  if (this->_internal_epoch() != 0) {
+    total_size += ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::UInt64SizePlusOne(this->_internal_epoch());
+  }
+
+  // uint64 cpuSamples = 7;
+  if (this->_internal_cpusamples() != 0) {
+    total_size += ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::UInt64SizePlusOne(this->_internal_cpusamples());
+  }
+
+  // uint64 cpuLostSamples = 8;
+  if (this->_internal_cpulostsamples() != 0) {
+    total_size += ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::UInt64SizePlusOne(this->_internal_cpulostsamples());
+  }
+
   // bool version = 2;
   if (this->_internal_version() != 0) {
     total_size += 1 + 1;
@@ -3513,9 +3753,19 @@ void GPUProfilingResponse::MergeFrom(const GPUProfilingResponse& from) {
 
   pcsamplingdata_.MergeFrom(from.pcsamplingdata_);
   cpucallingctxtree_.MergeFrom(from.cpucallingctxtree_);
+  stringtable_.MergeFrom(from.stringtable_);
   if (!from._internal_message().empty()) {
     _internal_set_message(from._internal_message());
   }
+  if (from._internal_epoch() != 0) {
+    _internal_set_epoch(from._internal_epoch());
+  }
+  if (from._internal_cpusamples() != 0) {
+    _internal_set_cpusamples(from._internal_cpusamples());
+  }
+  if (from._internal_cpulostsamples() != 0) {
+    _internal_set_cpulostsamples(from._internal_cpulostsamples());
+  }
   if (from._internal_version() != 0) {
     _internal_set_version(from._internal_version());
   }
@@ -3540,12 +3790,18 @@ void GPUProfilingResponse::InternalSwap(GPUProfilingResponse* other) {
   _internal_metadata_.InternalSwap(&other->_internal_metadata_);
   pcsamplingdata_.InternalSwap(&other->pcsamplingdata_);
   cpucallingctxtree_.InternalSwap(&other->cpucallingctxtree_);
+  stringtable_.InternalSwap(&other->stringtable_);
   ::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr::InternalSwap(
       &::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited(),
       &message_, lhs_arena,
       &other->message_, rhs_arena
   );
-  swap(version_, other->version_);
+  ::PROTOBUF_NAMESPACE_ID::internal::memswap<
+      PROTOBUF_FIELD_OFFSET(GPUProfilingResponse, version_)
+      + sizeof(GPUProfilingResponse::version_)
+      - PROTOBUF_FIELD_OFFSET(GPUProfilingResponse, epoch_)>(
+          reinterpret_cast<char*>(&epoch_),
+          reinterpret_cast<char*>(&other->epoch_));
 }
 
 ::PROTOBUF_NAMESPACE_ID::Metadata GPUProfilingResponse::GetMetadata() const {
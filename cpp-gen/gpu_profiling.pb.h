@@ -457,6 +457,7 @@ class CPUCallingContextNode final :
     kChildsFieldNumber = 8,
     kChildIDsFieldNumber = 9,
     kChildPCsFieldNumber = 10,
+    kThreadIDsFieldNumber = 12,
     kFuncNameFieldNumber = 4,
     kIdFieldNumber = 1,
     kPcFieldNumber = 2,
@@ -464,6 +465,7 @@ class CPUCallingContextNode final :
     kParentIDFieldNumber = 5,
     kParentPCFieldNumber = 6,
     kSamplesFieldNumber = 7,
+    kFuncNameIDFieldNumber = 11,
   };
   // repeated .gpuprofiling.CPUCallingContextNode childs = 8;
   int childs_size() const;
@@ -527,6 +529,28 @@ class CPUCallingContextNode final :
   ::PROTOBUF_NAMESPACE_ID::RepeatedField< uint64_t >*
       mutable_childpcs();
 
+  // repeated uint32 threadIDs = 12;
+  int threadids_size() const;
+  private:
+  int _internal_threadids_size() const;
+  public:
+  void clear_threadids();
+  private:
+  uint32_t _internal_threadids(int index) const;
+  const ::PROTOBUF_NAMESPACE_ID::RepeatedField< uint32_t >&
+      _internal_threadids() const;
+  void _internal_add_threadids(uint32_t value);
+  ::PROTOBUF_NAMESPACE_ID::RepeatedField< uint32_t >*
+      _internal_mutable_threadids();
+  public:
+  uint32_t threadids(int index) const;
+  void set_threadids(int index, uint32_t value);
+  void add_threadids(uint32_t value);
+  const ::PROTOBUF_NAMESPACE_ID::RepeatedField< uint32_t >&
+      threadids() const;
+  ::PROTOBUF_NAMESPACE_ID::RepeatedField< uint32_t >*
+      mutable_threadids();
+
   // string funcName = 4;
   void clear_funcname();
   const std::string& funcname() const;
@@ -595,6 +619,15 @@ class CPUCallingContextNode final :
   void _internal_set_samples(uint64_t value);
   public:
 
+  // uint32 funcNameID = 11;
+  void clear_funcnameid();
+  uint32_t funcnameid() const;
+  void set_funcnameid(uint32_t value);
+  private:
+  uint32_t _internal_funcnameid() const;
+  void _internal_set_funcnameid(uint32_t value);
+  public:
+
   // @@protoc_insertion_point(class_scope:gpuprofiling.CPUCallingContextNode)
  private:
   class _Internal;
@@ -607,6 +640,8 @@ class CPUCallingContextNode final :
   mutable std::atomic<int> _childids_cached_byte_size_;
   ::PROTOBUF_NAMESPACE_ID::RepeatedField< uint64_t > childpcs_;
   mutable std::atomic<int> _childpcs_cached_byte_size_;
+  ::PROTOBUF_NAMESPACE_ID::RepeatedField< uint32_t > threadids_;
+  mutable std::atomic<int> _threadids_cached_byte_size_;
   ::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr funcname_;
   uint64_t id_;
   uint64_t pc_;
@@ -614,6 +649,7 @@ class CPUCallingContextNode final :
   uint64_t parentid_;
   uint64_t parentpc_;
   uint64_t samples_;
+  uint32_t funcnameid_;
   mutable ::PROTOBUF_NAMESPACE_ID::internal::CachedSize _cached_size_;
   friend struct ::TableStruct_gpu_5fprofiling_2eproto;
 };
@@ -1970,8 +2006,19 @@ class GPUProfilingRequest final :
   // accessors -------------------------------------------------------
 
   enum : int {
+    kSinceEpochFieldNumber = 2,
     kDurationFieldNumber = 1,
+    kInlineFuncNamesFieldNumber = 3,
   };
+  // uint64 sinceEpoch = 2;
+  void clear_sinceepoch();
+  uint64_t sinceepoch() const;
+  void set_sinceepoch(uint64_t value);
+  private:
+  uint64_t _internal_sinceepoch() const;
+  void _internal_set_sinceepoch(uint64_t value);
+  public:
+
   // uint32 duration = 1;
   void clear_duration();
   uint32_t duration() const;
@@ -1981,6 +2028,15 @@ class GPUProfilingRequest final :
   void _internal_set_duration(uint32_t value);
   public:
 
+  // bool inlineFuncNames = 3;
+  void clear_inlinefuncnames();
+  bool inlinefuncnames() const;
+  void set_inlinefuncnames(bool value);
+  private:
+  bool _internal_inlinefuncnames() const;
+  void _internal_set_inlinefuncnames(bool value);
+  public:
+
   // @@protoc_insertion_point(class_scope:gpuprofiling.GPUProfilingRequest)
  private:
   class _Internal;
@@ -1988,7 +2044,9 @@ class GPUProfilingRequest final :
   template <typename T> friend class ::PROTOBUF_NAMESPACE_ID::Arena::InternalHelper;
   typedef void InternalArenaConstructable_;
   typedef void DestructorSkippable_;
+  uint64_t sinceepoch_;
   uint32_t duration_;
+  bool inlinefuncnames_;
   mutable ::PROTOBUF_NAMESPACE_ID::internal::CachedSize _cached_size_;
   friend struct ::TableStruct_gpu_5fprofiling_2eproto;
 };
@@ -2118,7 +2176,11 @@ class GPUProfilingResponse final :
   enum : int {
     kPcSamplingDataFieldNumber = 3,
     kCpuCallingCtxTreeFieldNumber = 4,
+    kStringTableFieldNumber = 5,
     kMessageFieldNumber = 1,
+    kEpochFieldNumber = 6,
+    kCpuSamplesFieldNumber = 7,
+    kCpuLostSamplesFieldNumber = 8,
     kVersionFieldNumber = 2,
   };
   // repeated .gpuprofiling.CUptiPCSamplingData pcSamplingData = 3;
@@ -2157,6 +2219,30 @@ class GPUProfilingResponse final :
   const ::PROTOBUF_NAMESPACE_ID::RepeatedPtrField< ::gpuprofiling::CPUCallingContextTree >&
       cpucallingctxtree() const;
 
+  // repeated string stringTable = 5;
+  int stringtable_size() const;
+  private:
+  int _internal_stringtable_size() const;
+  public:
+  void clear_stringtable();
+  const std::string& stringtable(int index) const;
+  std::string* mutable_stringtable(int index);
+  void set_stringtable(int index, const std::string& value);
+  void set_stringtable(int index, std::string&& value);
+  void set_stringtable(int index, const char* value);
+  void set_stringtable(int index, const char* value, size_t size);
+  std::string* add_stringtable();
+  void add_stringtable(const std::string& value);
+  void add_stringtable(std::string&& value);
+  void add_stringtable(const char* value);
+  void add_stringtable(const char* value, size_t size);
+  const ::PROTOBUF_NAMESPACE_ID::RepeatedPtrField<std::string>& stringtable() const;
+  ::PROTOBUF_NAMESPACE_ID::RepeatedPtrField<std::string>* mutable_stringtable();
+  private:
+  const std::string& _internal_stringtable(int index) const;
+  std::string* _internal_add_stringtable();
+  public:
+
   // string message = 1;
   void clear_message();
   const std::string& message() const;
@@ -2171,6 +2257,33 @@ class GPUProfilingResponse final :
   std::string* _internal_mutable_message();
   public:
 
+  // uint64 epoch = 6;
+  void clear_epoch();
+  uint64_t epoch() const;
+  void set_epoch(uint64_t value);
+  private:
+  uint64_t _internal_epoch() const;
+  void _internal_set_epoch(uint64_t value);
+  public:
+
+  // uint64 cpuSamples = 7;
+  void clear_cpusamples();
+  uint64_t cpusamples() const;
+  void set_cpusamples(uint64_t value);
+  private:
+  uint64_t _internal_cpusamples() const;
+  void _internal_set_cpusamples(uint64_t value);
+  public:
+
+  // uint64 cpuLostSamples = 8;
+  void clear_cpulostsamples();
+  uint64_t cpulostsamples() const;
+  void set_cpulostsamples(uint64_t value);
+  private:
+  uint64_t _internal_cpulostsamples() const;
+  void _internal_set_cpulostsamples(uint64_t value);
+  public:
+
   // bool version = 2;
   void clear_version();
   bool version() const;
@@ -2189,7 +2302,11 @@ class GPUProfilingResponse final :
   typedef void DestructorSkippable_;
   ::PROTOBUF_NAMESPACE_ID::RepeatedPtrField< ::gpuprofiling::CUptiPCSamplingData > pcsamplingdata_;
   ::PROTOBUF_NAMESPACE_ID::RepeatedPtrField< ::gpuprofiling::CPUCallingContextTree > cpucallingctxtree_;
+  ::PROTOBUF_NAMESPACE_ID::RepeatedPtrField<std::string> stringtable_;
   ::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr message_;
+  uint64_t epoch_;
+  uint64_t cpusamples_;
+  uint64_t cpulostsamples_;
   bool version_;
   mutable ::PROTOBUF_NAMESPACE_ID::internal::CachedSize _cached_size_;
   friend struct ::TableStruct_gpu_5fprofiling_2eproto;
@@ -2675,6 +2792,73 @@ CPUCallingContextNode::mutable_childpcs() {
   return _internal_mutable_childpcs();
 }
 
+// uint32 funcNameID = 11;
+inline void CPUCallingContextNode::clear_funcnameid() {
+  funcnameid_ = 0u;
+}
+inline uint32_t CPUCallingContextNode::_internal_funcnameid() const {
+  return funcnameid_;
+}
+inline uint32_t CPUCallingContextNode::funcnameid() const {
+  // @@protoc_insertion_point(field_get:gpuprofiling.CPUCallingContextNode.funcNameID)
+  return _internal_funcnameid();
+}
+inline void CPUCallingContextNode::_internal_set_funcnameid(uint32_t value) {
+  
+  funcnameid_ = value;
+}
+inline void CPUCallingContextNode::set_funcnameid(uint32_t value) {
+  _internal_set_funcnameid(value);
+  // @@protoc_insertion_point(field_set:gpuprofiling.CPUCallingContextNode.funcNameID)
+}
+
+// repeated uint32 threadIDs = 12;
+inline int CPUCallingContextNode::_internal_threadids_size() const {
+  return threadids_.size();
+}
+inline int CPUCallingContextNode::threadids_size() const {
+  return _internal_threadids_size();
+}
+inline void CPUCallingContextNode::clear_threadids() {
+  threadids_.Clear();
+}
+inline uint32_t CPUCallingContextNode::_internal_threadids(int index) const {
+  return threadids_.Get(index);
+}
+inline uint32_t CPUCallingContextNode::threadids(int index) const {
+  // @@protoc_insertion_point(field_get:gpuprofiling.CPUCallingContextNode.threadIDs)
+  return _internal_threadids(index);
+}
+inline void CPUCallingContextNode::set_threadids(int index, uint32_t value) {
+  threadids_.Set(index, value);
+  // @@protoc_insertion_point(field_set:gpuprofiling.CPUCallingContextNode.threadIDs)
+}
+inline void CPUCallingContextNode::_internal_add_threadids(uint32_t value) {
+  threadids_.Add(value);
+}
+inline void CPUCallingContextNode::add_threadids(uint32_t value) {
+  _internal_add_threadids(value);
+  // @@protoc_insertion_point(field_add:gpuprofiling.CPUCallingContextNode.threadIDs)
+}
+inline const ::PROTOBUF_NAMESPACE_ID::RepeatedField< uint32_t >&
+CPUCallingContextNode::_internal_threadids() const {
+  return threadids_;
+}
+inline const ::PROTOBUF_NAMESPACE_ID::RepeatedField< uint32_t >&
+CPUCallingContextNode::threadids() const {
+  // @@protoc_insertion_point(field_list:gpuprofiling.CPUCallingContextNode.threadIDs)
+  return _internal_threadids();
+}
+inline ::PROTOBUF_NAMESPACE_ID::RepeatedField< uint32_t >*
+CPUCallingContextNode::_internal_mutable_threadids() {
+  return &threadids_;
+}
+inline ::PROTOBUF_NAMESPACE_ID::RepeatedField< uint32_t >*
+CPUCallingContextNode::mutable_threadids() {
+  // @@protoc_insertion_point(field_mutable_list:gpuprofiling.CPUCallingContextNode.threadIDs)
+  return _internal_mutable_threadids();
+}
+
 // -------------------------------------------------------------------
 
 // GPUCallingGraphNode
@@ -3587,6 +3771,46 @@ inline void GPUProfilingRequest::set_duration(uint32_t value) {
   // @@protoc_insertion_point(field_set:gpuprofiling.GPUProfilingRequest.duration)
 }
 
+// uint64 sinceEpoch = 2;
+inline void GPUProfilingRequest::clear_sinceepoch() {
+  sinceepoch_ = uint64_t{0u};
+}
+inline uint64_t GPUProfilingRequest::_internal_sinceepoch() const {
+  return sinceepoch_;
+}
+inline uint64_t GPUProfilingRequest::sinceepoch() const {
+  // @@protoc_insertion_point(field_get:gpuprofiling.GPUProfilingRequest.sinceEpoch)
+  return _internal_sinceepoch();
+}
+inline void GPUProfilingRequest::_internal_set_sinceepoch(uint64_t value) {
+  
+  sinceepoch_ = value;
+}
+inline void GPUProfilingRequest::set_sinceepoch(uint64_t value) {
+  _internal_set_sinceepoch(value);
+  // @@protoc_insertion_point(field_set:gpuprofiling.GPUProfilingRequest.sinceEpoch)
+}
+
+// bool inlineFuncNames = 3;
+inline void GPUProfilingRequest::clear_inlinefuncnames() {
+  inlinefuncnames_ = false;
+}
+inline bool GPUProfilingRequest::_internal_inlinefuncnames() const {
+  return inlinefuncnames_;
+}
+inline bool GPUProfilingRequest::inlinefuncnames() const {
+  // @@protoc_insertion_point(field_get:gpuprofiling.GPUProfilingRequest.inlineFuncNames)
+  return _internal_inlinefuncnames();
+}
+inline void GPUProfilingRequest::_internal_set_inlinefuncnames(bool value) {
+  
+  inlinefuncnames_ = value;
+}
+inline void GPUProfilingRequest::set_inlinefuncnames(bool value) {
+  _internal_set_inlinefuncnames(value);
+  // @@protoc_insertion_point(field_set:gpuprofiling.GPUProfilingRequest.inlineFuncNames)
+}
+
 // -------------------------------------------------------------------
 
 // GPUProfilingResponse
@@ -3742,6 +3966,141 @@ GPUProfilingResponse::cpucallingctxtree() const {
   return cpucallingctxtree_;
 }
 
+// repeated string stringTable = 5;
+inline int GPUProfilingResponse::_internal_stringtable_size() const {
+  return stringtable_.size();
+}
+inline int GPUProfilingResponse::stringtable_size() const {
+  return _internal_stringtable_size();
+}
+inline void GPUProfilingResponse::clear_stringtable() {
+  stringtable_.Clear();
+}
+inline std::string* GPUProfilingResponse::add_stringtable() {
+  std::string* _s = _internal_add_stringtable();
+  // @@protoc_insertion_point(field_add_mutable:gpuprofiling.GPUProfilingResponse.stringTable)
+  return _s;
+}
+inline const std::string& GPUProfilingResponse::_internal_stringtable(int index) const {
+  return stringtable_.Get(index);
+}
+inline const std::string& GPUProfilingResponse::stringtable(int index) const {
+  // @@protoc_insertion_point(field_get:gpuprofiling.GPUProfilingResponse.stringTable)
+  return _internal_stringtable(index);
+}
+inline std::string* GPUProfilingResponse::mutable_stringtable(int index) {
+  // @@protoc_insertion_point(field_mutable:gpuprofiling.GPUProfilingResponse.stringTable)
+  return stringtable_.Mutable(index);
+}
+inline void GPUProfilingResponse::set_stringtable(int index, const std::string& value) {
+  stringtable_.Mutable(index)->assign(value);
+  // @@protoc_insertion_point(field_set:gpuprofiling.GPUProfilingResponse.stringTable)
+}
+inline void GPUProfilingResponse::set_stringtable(int index, std::string&& value) {
+  stringtable_.Mutable(index)->assign(std::move(value));
+  // @@protoc_insertion_point(field_set:gpuprofiling.GPUProfilingResponse.stringTable)
+}
+inline void GPUProfilingResponse::set_stringtable(int index, const char* value) {
+  GOOGLE_DCHECK(value != nullptr);
+  stringtable_.Mutable(index)->assign(value);
+  // @@protoc_insertion_point(field_set_char:gpuprofiling.GPUProfilingResponse.stringTable)
+}
+inline void GPUProfilingResponse::set_stringtable(int index, const char* value, size_t size) {
+  stringtable_.Mutable(index)->assign(
+    reinterpret_cast<const char*>(value), size);
+  // @@protoc_insertion_point(field_set_pointer:gpuprofiling.GPUProfilingResponse.stringTable)
+}
+inline std::string* GPUProfilingResponse::_internal_add_stringtable() {
+  return stringtable_.Add();
+}
+inline void GPUProfilingResponse::add_stringtable(const std::string& value) {
+  stringtable_.Add()->assign(value);
+  // @@protoc_insertion_point(field_add:gpuprofiling.GPUProfilingResponse.stringTable)
+}
+inline void GPUProfilingResponse::add_stringtable(std::string&& value) {
+  stringtable_.Add(std::move(value));
+  // @@protoc_insertion_point(field_add:gpuprofiling.GPUProfilingResponse.stringTable)
+}
+inline void GPUProfilingResponse::add_stringtable(const char* value) {
+  GOOGLE_DCHECK(value != nullptr);
+  stringtable_.Add()->assign(value);
+  // @@protoc_insertion_point(field_add_char:gpuprofiling.GPUProfilingResponse.stringTable)
+}
+inline void GPUProfilingResponse::add_stringtable(const char* value, size_t size) {
+  stringtable_.Add()->assign(reinterpret_cast<const char*>(value), size);
+  // @@protoc_insertion_point(field_add_pointer:gpuprofiling.GPUProfilingResponse.stringTable)
+}
+inline const ::PROTOBUF_NAMESPACE_ID::RepeatedPtrField<std::string>&
+GPUProfilingResponse::stringtable() const {
+  // @@protoc_insertion_point(field_list:gpuprofiling.GPUProfilingResponse.stringTable)
+  return stringtable_;
+}
+inline ::PROTOBUF_NAMESPACE_ID::RepeatedPtrField<std::string>*
+GPUProfilingResponse::mutable_stringtable() {
+  // @@protoc_insertion_point(field_mutable_list:gpuprofiling.GPUProfilingResponse.stringTable)
+  return &stringtable_;
+}
+
+// uint64 epoch = 6;
+inline void GPUProfilingResponse::clear_epoch() {
+  epoch_ = uint64_t{0u};
+}
+inline uint64_t GPUProfilingResponse::_internal_epoch() const {
+  return epoch_;
+}
+inline uint64_t GPUProfilingResponse::epoch() const {
+  // @@protoc_insertion_point(field_get:gpuprofiling.GPUProfilingResponse.epoch)
+  return _internal_epoch();
+}
+inline void GPUProfilingResponse::_internal_set_epoch(uint64_t value) {
+  
+  epoch_ = value;
+}
+inline void GPUProfilingResponse::set_epoch(uint64_t value) {
+  _internal_set_epoch(value);
+  // @@protoc_insertion_point(field_set:gpuprofiling.GPUProfilingResponse.epoch)
+}
+
+// uint64 cpuSamples = 7;
+inline void GPUProfilingResponse::clear_cpusamples() {
+  cpusamples_ = uint64_t{0u};
+}
+inline uint64_t GPUProfilingResponse::_internal_cpusamples() const {
+  return cpusamples_;
+}
+inline uint64_t GPUProfilingResponse::cpusamples() const {
+  // @@protoc_insertion_point(field_get:gpuprofiling.GPUProfilingResponse.cpuSamples)
+  return _internal_cpusamples();
+}
+inline void GPUProfilingResponse::_internal_set_cpusamples(uint64_t value) {
+  
+  cpusamples_ = value;
+}
+inline void GPUProfilingResponse::set_cpusamples(uint64_t value) {
+  _internal_set_cpusamples(value);
+  // @@protoc_insertion_point(field_set:gpuprofiling.GPUProfilingResponse.cpuSamples)
+}
+
+// uint64 cpuLostSamples = 8;
+inline void GPUProfilingResponse::clear_cpulostsamples() {
+  cpulostsamples_ = uint64_t{0u};
+}
+inline uint64_t GPUProfilingResponse::_internal_cpulostsamples() const {
+  return cpulostsamples_;
+}
+inline uint64_t GPUProfilingResponse::cpulostsamples() const {
+  // @@protoc_insertion_point(field_get:gpuprofiling.GPUProfilingResponse.cpuLostSamples)
+  return _internal_cpulostsamples();
+}
+inline void GPUProfilingResponse::_internal_set_cpulostsamples(uint64_t value) {
+  
+  cpulostsamples_ = value;
+}
+inline void GPUProfilingResponse::set_cpulostsamples(uint64_t value) {
+  _internal_set_cpulostsamples(value);
+  // @@protoc_insertion_point(field_set:gpuprofiling.GPUProfilingResponse.cpuLostSamples)
+}
+
 #ifdef __GNUC__
   #pragma GCC diagnostic pop
 #endif  // __GNUC__
@@ -0,0 +1,106 @@
+#pragma once
+#include <functional>
+#include <stdint.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+#include "cpu_sampler.h"
+#include "utils.h"
+
+// Samples of the cpu sampler counted by thread and call stack over a window
+// of windowMs, so that a stack sampled over and over is applied to the CCT
+// once with its count instead of walking the CCT from the root per sample.
+//
+// The first sample of a stack in the window is kept, later ones only bump its
+// count. Entries are looked up by a hash of the tid and the pcs, and compared
+// in full on a hash match.
+class CPUSampleAggregator {
+public:
+  // applies a distinct stack of thread tid, sampled count times, to the CCT
+  typedef std::function<void(pid_t tid, CPUCallStackSampler::CallStack &,
+                             uint64_t count)>
+      ApplyFunc;
+
+  // windowMs 0 applies the stacks of each round of collection
+  explicit CPUSampleAggregator(uint64_t _windowMs)
+      : windowMs(_windowMs), windowStart(Timer::GetMilliSeconds()),
+        samples(0), stacks(0) {}
+
+  CPUSampleAggregator(const CPUSampleAggregator &) = delete;
+  CPUSampleAggregator &operator=(const CPUSampleAggregator &) = delete;
+
+  // count callStack, which is moved from if its stack is new in the window
+  void add(CPUCallStackSampler::CallStack &callStack) {
+    ++samples;
+    uint64_t hash = Hash(callStack);
+    auto itr = index.find(hash);
+    if (itr != index.end()) {
+      for (uint32_t idx = itr->second; idx != kNull; idx = entries[idx].next) {
+        if (SameStack(entries[idx].stack, callStack)) {
+          ++entries[idx].count;
+          return;
+        }
+      }
+    }
+    Entry entry;
+    entry.count = 1;
+    entry.next = itr != index.end() ? itr->second : kNull;
+    entry.stack = std::move(callStack);
+    index[hash] = entries.size();
+    entries.push_back(std::move(entry));
+    ++stacks;
+  }
+
+  // the window has elapsed since the last flush
+  bool due() { return Timer::GetMilliSeconds() - windowStart >= windowMs; }
+
+  // apply every distinct stack of the window with its count and start a new
+  // window
+  void flush(ApplyFunc apply) {
+    for (Entry &entry : entries)
+      apply(entry.stack.tid, entry.stack, entry.count);
+    entries.clear();
+    index.clear();
+    windowStart = Timer::GetMilliSeconds();
+  }
+
+  // samples added, and distinct stacks applied or pending, over all windows
+  uint64_t getSamples() { return samples; }
+  uint64_t getStacks() { return stacks; }
+
+private:
+  static const uint32_t kNull = UINT32_MAX;
+
+  struct Entry {
+    uint64_t count;
+    // entry of the next stack with the same hash
+    uint32_t next;
+    CPUCallStackSampler::CallStack stack;
+  };
+
+  static uint64_t Hash(const CPUCallStackSampler::CallStack &callStack) {
+    uint64_t h = callStack.tid * 0x9e3779b97f4a7c15ull;
+    for (uint64_t pc : callStack.pcs)
+      h = (h ^ pc) * 0x100000001b3ull;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  static bool SameStack(const CPUCallStackSampler::CallStack &a,
+                        const CPUCallStackSampler::CallStack &b) {
+    size_t size = a.pcs.size() * sizeof(uint64_t);
+    return a.tid == b.tid && a.pcs.size() == b.pcs.size() &&
+           memcmp(a.pcs.data(), b.pcs.data(), size) == 0;
+  }
+
+  uint64_t windowMs;
+  uint64_t windowStart;
+  std::vector<Entry> entries;
+  std::unordered_map<uint64_t, uint32_t> index;
+  uint64_t samples;
+  uint64_t stacks;
+};
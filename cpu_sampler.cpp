@@ -1,41 +1,36 @@
 #include "cpu_sampler.h"
 
+#include "elf_symbolizer.h"
+#include "module_filter.h"
 #include "utils.h"
-#include <dlfcn.h>
-#include <execinfo.h>
+#include <dirent.h>
+#include <sys/eventfd.h>
 
 namespace {
-std::vector<std::string> GetCallStackSymbols(const uint64_t *stack,
-                                             uint64_t depth) {
-  void *stackPointers[depth];
-  char **symbols;
-  std::vector<std::string> ret;
-
-  for (int i = 0; i < depth; ++i) {
-    stackPointers[i] = (void *)stack[i];
-  }
-  symbols = backtrace_symbols(stackPointers, depth);
-
-  if (symbols) {
-    for (int i = 0; i < depth; ++i) {
-      ret.push_back(ParseBTSymbol(std::string(symbols[i])));
-      // free(symbols[i]);
-    }
-  }
-  free(symbols);
-
-  return ret;
-}
-
 int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu,
                     int group_fd, uint64_t flags) {
   return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
 }
 
+// threads of the process, from /proc/self/task
+std::vector<pid_t> ListThreads() {
+  std::vector<pid_t> tids;
+  DIR *dir = opendir("/proc/self/task");
+  if (!dir)
+    return tids;
+  while (struct dirent *entry = readdir(dir)) {
+    pid_t tid = std::strtol(entry->d_name, nullptr, 10);
+    if (tid > 0)
+      tids.push_back(tid);
+  }
+  closedir(dir);
+  return tids;
+}
+
 } // namespace
 
 CPUCallStackSampler::CPUCallStackSampler(pid_t pid, uint64_t period,
-                                         uint64_t pages) {
+                                         uint64_t pages, int cpu) {
   struct perf_event_attr attr;
   memset(&attr, 0, sizeof(struct perf_event_attr));
 
@@ -46,22 +41,31 @@ CPUCallStackSampler::CPUCallStackSampler(pid_t pid, uint64_t period,
   attr.config = PERF_COUNT_SW_CPU_CLOCK;
   attr.sample_period = period;
   attr.sample_type = PERF_SAMPLE_TIME | PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN;
+  // only user space frames make it to the CCT
+  attr.exclude_callchain_kernel = 1;
   // notify every one overflow
   attr.wakeup_events = 1;
+  // a per-cpu event follows the threads created later, a per-thread one
+  // cannot be mapped with inherit
+  attr.inherit = cpu >= 0;
 
-  fd = perf_event_open(&attr, pid, -1, -1, 0);
+  fd = perf_event_open(&attr, pid, cpu, -1, 0);
   if (fd < 0) {
     throw std::runtime_error("perf_event_open() failed");
   }
 
-  // create a shared memory to read perf samples from kernel
-  mem = mmap(0, (1 + pages) * 4096, PROT_READ, MAP_SHARED, fd, 0);
-  if (mem == 0) {
+  // create a shared memory to read perf samples from kernel, writable to
+  // hand the consumed records back through data_tail
+  mem = mmap(0, (1 + pages) * 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+             0);
+  if (mem == MAP_FAILED) {
+    close(fd);
     throw std::runtime_error("mmap() failed");
   }
 
   this->pages = pages;
-  this->offset = 0;
+  this->samples = 0;
+  this->lostSamples = 0;
 }
 
 CPUCallStackSampler::~CPUCallStackSampler() {
@@ -79,13 +83,18 @@ void CPUCallStackSampler::DisableSampling() {
 }
 
 int CPUCallStackSampler::CollectData(int32_t timeout, uint64_t maxDepth,
-                                     struct CallStack &callStack) {
+                                     std::vector<CallStack> &callStacks) {
   struct pollfd pfd;
   pfd.fd = fd;
   pfd.events = POLLIN;
 
   uint64_t start = Timer::GetMilliSeconds();
   while (true) {
+    // samples left from the last wakeup are read without waiting
+    if (Drain(maxDepth, callStacks)) {
+      return 0;
+    }
+
     uint64_t now = Timer::GetMilliSeconds();
     int32_t toWait;
     if (timeout < 0) {
@@ -104,50 +113,209 @@ int CPUCallStackSampler::CollectData(int32_t timeout, uint64_t maxDepth,
     } else if (ret == -1) {
       return errno;
     }
+  }
+}
+
+size_t CPUCallStackSampler::Drain(uint64_t maxDepth,
+                                  std::vector<CallStack> &callStacks,
+                                  bool symbolize) {
+  struct perf_event_mmap_page *info = (struct perf_event_mmap_page *)mem;
+  const uint8_t *data = (const uint8_t *)mem + 4096;
+  const uint64_t size = pages * 4096;
+
+  // records up to data_head are complete once it is read
+  uint64_t head = __atomic_load_n(&info->data_head, __ATOMIC_ACQUIRE);
+  uint64_t tail = info->data_tail;
+  size_t nSamples = 0;
+  while (head - tail >= sizeof(struct perf_event_header)) {
+    const uint8_t *rec = data + tail % size;
+    struct perf_event_header header;
+    memcpy(&header, rec, sizeof(header));
+    if (header.size < sizeof(header) || head - tail < header.size) {
+      DEBUG_LOG("corrupted perf record of size %u, dropping the ring\n",
+                header.size);
+      tail = head;
+      break;
+    }
+    // a record wrapping around the end of the ring is copied out
+    uint64_t toEnd = size - tail % size;
+    if (header.size > toEnd) {
+      record.resize(header.size);
+      memcpy(record.data(), rec, toEnd);
+      memcpy(record.data() + toEnd, data, header.size - toEnd);
+      rec = record.data();
+    }
+
+    if (header.type == PERF_RECORD_SAMPLE) {
+      struct sample {
+        struct perf_event_header header;
+        uint32_t pid, tid;
+        uint64_t time;
+        uint64_t nr;
+        uint64_t pcs[0];
+      } *sample = (struct sample *)rec;
+
+      CallStack callStack;
+      callStack.time = sample->time;
+      callStack.pid = sample->pid;
+      callStack.tid = sample->tid;
+      if (symbolize)
+        SymbolizeCallChain(sample->pcs, sample->nr, maxDepth, callStack);
+      else
+        callStack.pcs.assign(sample->pcs, sample->pcs + sample->nr);
+      callStacks.push_back(std::move(callStack));
+      ++nSamples;
+    } else if (header.type == PERF_RECORD_LOST) {
+      struct lost {
+        struct perf_event_header header;
+        uint64_t id;
+        uint64_t lost;
+      } *lost = (struct lost *)rec;
+      lostSamples += lost->lost;
+    }
+    tail += header.size;
+  }
 
-    struct sample {
-      struct perf_event_header header;
-      uint32_t pid, tid;
-      uint64_t time;
-      uint64_t nr;
-      uint64_t pcs[0];
-    } *sample = (struct sample *)((uint8_t *)mem + 4096 + offset);
-
-    struct perf_event_mmap_page *info = (struct perf_event_mmap_page *)mem;
-    offset = info->data_head % (pages * 4096);
-    if (sample->header.type != PERF_RECORD_SAMPLE) {
+  // the records are read before the kernel may overwrite them
+  __atomic_store_n(&info->data_tail, tail, __ATOMIC_RELEASE);
+  samples += nSamples;
+  return nSamples;
+}
+
+void CPUCallStackSampler::SymbolizeCallStack(uint64_t maxDepth,
+                                             CallStack &callStack) {
+  std::vector<uint64_t> chain;
+  chain.swap(callStack.pcs);
+  SymbolizeCallChain(chain.data(), chain.size(), maxDepth, callStack);
+}
+
+void CPUCallStackSampler::SymbolizeCallChain(const uint64_t *chain,
+                                             uint64_t nr, uint64_t maxDepth,
+                                             CallStack &callStack) {
+  ModuleFilter *moduleFilter = ModuleFilter::GetModuleFilter();
+  bool deferSymbolization = GetProfilerConf()->deferSymbolization;
+  // kernel frames, if any, come first after PERF_CONTEXT_KERNEL
+  bool user = true;
+  for (uint64_t i = 0; i < nr && callStack.pcs.size() < maxDepth; ++i) {
+    uint64_t pc = chain[i];
+    if (pc >= (uint64_t)PERF_CONTEXT_MAX) {
+      user = pc == (uint64_t)PERF_CONTEXT_USER;
       continue;
     }
+    if (!user)
+      continue;
 
-    callStack.time = sample->time;
-    callStack.pid = sample->pid;
-    callStack.tid = sample->tid;
-    callStack.depth = min2(maxDepth, sample->nr);
-    callStack.pcs = sample->pcs;
-    callStack.fnames = GetCallStackSymbols(callStack.pcs, callStack.depth);
+    // skip the frames of cupti, cuda and the profiler before symbolizing
+    PCSymbol symbol;
+    symbol.funcNameId = EMPTY_SYMBOL_ID;
+    symbol.offset = 0;
+    symbol.excluded = moduleFilter->isExcluded(pc);
+    symbol.pyEval = false;
+    // named at export when deferred, see SymbolizeCPUCCTs
+    if (!symbol.excluded && !deferSymbolization)
+      symbol = ResolvePCSymbol(pc);
+    callStack.pcs.push_back(pc);
+    callStack.symbols.push_back(symbol);
+  }
+  callStack.depth = callStack.pcs.size();
+}
 
-    return 0;
+CPUCallStackSamplerCollection::CPUCallStackSamplerCollection()
+    : running(false) {
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  wakeupFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (epollFd < 0 || wakeupFd < 0) {
+    throw std::runtime_error("epoll_create1() or eventfd() failed");
   }
+  // the wakeup fd is told from the samplers by pid 0
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = 0;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &event);
 }
 
 CPUCallStackSamplerCollection::~CPUCallStackSamplerCollection() {
   for (auto itr : samplers) {
     delete itr.second;
   }
+  for (auto sampler : cpuSamplers) {
+    delete sampler;
+  }
+  close(wakeupFd);
+  close(epollFd);
 }
 
 void CPUCallStackSamplerCollection::RegisterSampler(pid_t pid) {
+  std::lock_guard<std::mutex> lock(statusMutex);
   if (samplers.find(pid) == samplers.end()) {
     auto sampler = GetOrCreateCPUCallStackSampler(pid);
     samplers.insert({pid, sampler});
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = (uint64_t)pid;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, sampler->GetFd(), &event)) {
+      DEBUG_LOG("failed to watch the sampler of %d, errno=%d\n", pid, errno);
+    }
   }
 }
 
+bool CPUCallStackSamplerCollection::RegisterProcess() {
+  std::lock_guard<std::mutex> lock(statusMutex);
+  auto profilerConf = GetProfilerConf();
+  pid_t mainTid = getpid();
+  long nCPUs = sysconf(_SC_NPROCESSORS_CONF);
+  int nFailed = 0, failedErrno = 0;
+  for (int cpu = 0; cpu < nCPUs; ++cpu) {
+    CPUCallStackSampler *sampler;
+    try {
+      sampler = new CPUCallStackSampler(mainTid,
+                                        profilerConf->cpuSamplingPeriod,
+                                        profilerConf->cpuSamplingPages, cpu);
+    } catch (std::runtime_error &e) {
+      // offline cpus are expected
+      if (errno != ENODEV) {
+        ++nFailed;
+        failedErrno = errno;
+      }
+      continue;
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = kCPURingKey | cpuSamplers.size();
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, sampler->GetFd(), &event);
+    cpuSamplers.push_back(sampler);
+  }
+  if (nFailed)
+    std::cout << "WARNING: per-cpu cpu sampling failed on " << nFailed
+              << " cpus, errno=" << failedErrno << std::endl;
+
+  for (pid_t tid : ListThreads()) {
+    if (tid != mainTid)
+      uncoveredTids.insert(tid);
+  }
+  if (!cpuSamplers.empty() && !uncoveredTids.empty())
+    std::cout << "WARNING: " << uncoveredTids.size()
+              << " threads started before per-cpu cpu sampling are only "
+                 "sampled once they launch kernels"
+              << std::endl;
+  DEBUG_LOG("per-cpu cpu sampling on %lu cpus\n", cpuSamplers.size());
+  return !cpuSamplers.empty();
+}
+
+bool CPUCallStackSamplerCollection::NeedsThreadSampler(pid_t pid) {
+  std::lock_guard<std::mutex> lock(statusMutex);
+  return cpuSamplers.empty() || uncoveredTids.count(pid);
+}
+
 // TODO(yanli): buggy? delete here but not in the static map in
 // GetOrCreateCPUCallStackSampler.
 void CPUCallStackSamplerCollection::DeleteSampler(pid_t pid) {
+  std::lock_guard<std::mutex> lock(statusMutex);
   auto itr = samplers.find(pid);
   if (itr != samplers.end()) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, itr->second->GetFd(), nullptr);
+    deletedSamples += itr->second->GetSamples();
+    deletedLostSamples += itr->second->GetLostSamples();
     delete itr->second;
     samplers.erase(pid);
   } else {
@@ -160,6 +328,10 @@ void CPUCallStackSamplerCollection::EnableSampling() {
   for (auto itr : samplers) {
     itr.second->EnableSampling();
   }
+  // the inherited events follow their parents
+  for (auto sampler : cpuSamplers) {
+    sampler->EnableSampling();
+  }
   running = true;
   statusMutex.unlock();
 }
@@ -169,25 +341,78 @@ void CPUCallStackSamplerCollection::DisableSampling() {
   for (auto itr : samplers) {
     itr.second->DisableSampling();
   }
+  for (auto sampler : cpuSamplers) {
+    sampler->DisableSampling();
+  }
   running = false;
   statusMutex.unlock();
+  // wake the collection waiting for samples
+  uint64_t one = 1;
+  if (write(wakeupFd, &one, sizeof(one)) < 0) {
+    DEBUG_LOG("failed to wake the cpu sampler collection, errno=%d\n", errno);
+  }
 }
 
 bool CPUCallStackSamplerCollection::IsRunning() { return running; }
 
-std::unordered_map<pid_t, CPUCallStackSampler::CallStack>
-CPUCallStackSamplerCollection::CollectData() {
-  statusMutex.lock();
-  std::unordered_map<pid_t, CPUCallStackSampler::CallStack> ret;
-  for (auto itr : samplers) {
-    CPUCallStackSampler::CallStack callStack;
-    itr.second->CollectData(GetProfilerConf()->cpuSamplingTimeout,
-                            GetProfilerConf()->cpuSamplingMaxDepth, callStack);
-    ret.insert({itr.first, callStack});
+size_t CPUCallStackSamplerCollection::CollectData(
+    std::vector<CPUCallStackSampler::CallStack> &callStacks) {
+  callStacks.clear();
+  // samplers are registered and deleted while waiting, so the events carry
+  // pids that are looked up afterwards
+  int nEvents = epoll_wait(epollFd, events, kMaxEvents,
+                           GetProfilerConf()->cpuSamplingTimeout);
+  if (nEvents < 0) {
+    if (errno != EINTR)
+      DEBUG_LOG("epoll_wait() failed, errno=%d\n", errno);
+    return 0;
   }
-  statusMutex.unlock();
 
-  return ret;
+  uint64_t maxDepth = GetProfilerConf()->cpuSamplingMaxDepth;
+  {
+    // only the raw records are read under the lock
+    std::lock_guard<std::mutex> lock(statusMutex);
+    for (int i = 0; i < nEvents; ++i) {
+      uint64_t key = events[i].data.u64;
+      if (key & kCPURingKey) {
+        cpuSamplers[(uint32_t)key]->Drain(maxDepth, callStacks, false);
+        continue;
+      }
+      pid_t pid = (pid_t)key;
+      if (!pid) {
+        uint64_t count;
+        if (read(wakeupFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+          DEBUG_LOG("failed to read the wakeup fd, errno=%d\n", errno);
+        continue;
+      }
+      auto itr = samplers.find(pid);
+      if (itr != samplers.end())
+        itr->second->Drain(maxDepth, callStacks, false);
+    }
+  }
+  for (auto &callStack : callStacks)
+    CPUCallStackSampler::SymbolizeCallStack(maxDepth, callStack);
+  return callStacks.size();
+}
+
+uint64_t CPUCallStackSamplerCollection::GetSamples() {
+  std::lock_guard<std::mutex> lock(statusMutex);
+  uint64_t n = deletedSamples;
+  for (auto itr : samplers)
+    n += itr.second->GetSamples();
+  for (auto sampler : cpuSamplers)
+    n += sampler->GetSamples();
+  return n;
+}
+
+uint64_t CPUCallStackSamplerCollection::GetLostSamples() {
+  std::lock_guard<std::mutex> lock(statusMutex);
+  uint64_t n = deletedLostSamples;
+  for (auto itr : samplers)
+    n += itr.second->GetLostSamples();
+  for (auto sampler : cpuSamplers)
+    n += sampler->GetLostSamples();
+  return n;
 }
 
 CPUCallStackSampler *GetOrCreateCPUCallStackSampler(pid_t pid) {
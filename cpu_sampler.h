@@ -1,34 +1,66 @@
 #pragma once
-#include <cxxabi.h>
+#include <atomic>
 #include <linux/hw_breakpoint.h>
 #include <linux/perf_event.h>
 #include <memory.h>
 #include <mutex>
 #include <poll.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 
 #include "common.h"
+#include "pc_symbol_cache.h"
 
 class CPUCallStackSampler {
 public:
   struct CallStack {
     uint64_t time;
     uint32_t pid, tid;
+    // user space frames, innermost first
     uint64_t depth;
-    const uint64_t *pcs;
-    std::vector<std::string> fnames;
+    std::vector<uint64_t> pcs;
+    std::vector<PCSymbol> symbols;
   };
 
-  explicit CPUCallStackSampler(pid_t pid, uint64_t period, uint64_t pages);
+  // Sample thread pid wherever it runs if cpu is -1. Otherwise sample it and
+  // the threads it creates later (inherit) on cpu only.
+  explicit CPUCallStackSampler(pid_t pid, uint64_t period, uint64_t pages,
+                               int cpu = -1);
   ~CPUCallStackSampler();
 
   void EnableSampling();
   void DisableSampling();
+  // Wait up to timeout ms (-1 for ever) for samples, then append every
+  // sample in the ring to callStacks. 0 if samples were read, -1 on timeout,
+  // errno if poll failed.
   int CollectData(int32_t timeout, uint64_t maxDepth,
-                  struct CallStack &callStack);
+                  std::vector<CallStack> &callStacks);
+
+  // consume the records between data_tail and data_head without waiting,
+  // returns the number of samples appended to callStacks. Without symbolize
+  // the stacks only hold their raw perf callchains, see SymbolizeCallStack.
+  size_t Drain(uint64_t maxDepth, std::vector<CallStack> &callStacks,
+               bool symbolize = true);
+
+  // replace the raw perf callchain in the pcs of a stack drained without
+  // symbolize with its symbolized user space frames
+  static void SymbolizeCallStack(uint64_t maxDepth, CallStack &callStack);
+
+  // append the user space frames of a perf callchain of nr entries to
+  // callStack, with their symbols from the pc symbol cache; the context
+  // markers and the frames of the other contexts are skipped
+  static void SymbolizeCallChain(const uint64_t *chain, uint64_t nr,
+                                 uint64_t maxDepth, CallStack &callStack);
+
+  // readable when samples are in the ring
+  int GetFd() { return fd; }
+
+  // samples read, and samples lost by the kernel on a full ring
+  uint64_t GetSamples() { return samples; }
+  uint64_t GetLostSamples() { return lostSamples; }
 
   CPUCallStackSampler(const CPUCallStackSampler &) = delete;
   CPUCallStackSampler &operator=(const CPUCallStackSampler) = delete;
@@ -36,49 +68,69 @@ private:
   int fd;
   void *mem;
   uint64_t pages;
-  uint64_t offset;
+  // records wrapping around the end of the ring are copied here
+  std::vector<uint8_t> record;
+  std::atomic<uint64_t> samples;
+  std::atomic<uint64_t> lostSamples;
 };
 
 CPUCallStackSampler *GetOrCreateCPUCallStackSampler(pid_t pid);
 
+// Samplers of the registered threads, whose fds are watched by one epoll
+// set, so that a collection drains the rings that are ready however many of
+// the threads are idle. An eventfd in the set wakes a waiting collection when
+// sampling is disabled.
+//
+// With RegisterProcess, the threads of the process are sampled by one sampler
+// per cpu on the main thread, inherited by every thread it creates from then
+// on, directly or not. Samples carry their tid, so the fds and rings scale
+// with the cpus, not the threads. Threads alive at registration are not
+// covered and still need a sampler of their own, see NeedsThreadSampler.
 class CPUCallStackSamplerCollection {
 public:
-  CPUCallStackSamplerCollection(){};
+  static const int kMaxEvents = 64;
+  // epoll key of the ring of a cpu, pids fit in 32 bits
+  static const uint64_t kCPURingKey = 1ull << 32;
+
+  CPUCallStackSamplerCollection();
   ~CPUCallStackSamplerCollection();
 
   void RegisterSampler(pid_t pid);
+  // sample the threads of the process created from now on, on every cpu;
+  // false if no cpu could be sampled
+  bool RegisterProcess();
+  // thread pid is not sampled by the per-cpu samplers
+  bool NeedsThreadSampler(pid_t pid);
   void DeleteSampler(pid_t pid);
   void EnableSampling();
   void DisableSampling();
   bool IsRunning();
 
-  std::unordered_map<pid_t, CPUCallStackSampler::CallStack> CollectData();
+  // Wait up to cpuSamplingTimeout ms for samples of any sampler, then
+  // replace the content of callStacks with the samples of the ready ones.
+  // Returns the number of samples. The rings are drained under statusMutex
+  // and the samples symbolized after it is released, so that registering a
+  // thread on its first launch does not wait for a batch of symbolization.
+  size_t CollectData(std::vector<CPUCallStackSampler::CallStack> &callStacks);
+
+  // counts of all samplers, deleted ones included
+  uint64_t GetSamples();
+  uint64_t GetLostSamples();
 
   CPUCallStackSamplerCollection(const CPUCallStackSamplerCollection &) = delete;
   CPUCallStackSamplerCollection &
   operator=(const CPUCallStackSamplerCollection) = delete;
 private:
   std::unordered_map<pid_t, CPUCallStackSampler *> samplers;
+  // per cpu, on the main thread
+  std::vector<CPUCallStackSampler *> cpuSamplers;
+  // threads alive at RegisterProcess, other than the main thread
+  std::unordered_set<pid_t> uncoveredTids;
   bool running;
   std::mutex statusMutex;
+  int epollFd;
+  int wakeupFd;
+  struct epoll_event events[kMaxEvents];
+  uint64_t deletedSamples = 0;
+  uint64_t deletedLostSamples = 0;
 };
-
-static std::string ParseBTSymbol(std::string rawStr) {
-  std::string s;
-  if (rawStr.length() && rawStr[0] != '[') {
-    auto pos1 = rawStr.find('(');
-    auto pos2 = rawStr.find('+');
-    if (pos2 - pos1 > 1) {
-      auto rawFuncName = rawStr.substr(pos1 + 1, pos2 - pos1 - 1);
-      char *realFuncName;
-      int status = 99;
-      if ((realFuncName = abi::__cxa_demangle(rawFuncName.c_str(), nullptr,
-                                              nullptr, &status)) != 0) {
-        s = std::string(realFuncName);
-      } else {
-        s = rawFuncName;
-      }
-    }
-  }
-  return s;
-}
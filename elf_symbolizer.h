@@ -0,0 +1,334 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "calling_ctx_tree.h"
+#include "module_filter.h"
+#include "pc_symbol_cache.h"
+#include "symbol_table.h"
+
+// the function of the python interpreter loop
+#define PY_EVAL_FUNC_NAME "_PyEval_EvalFrameDefault"
+
+// Resolves native pcs to function names with the ELF symbol tables (.symtab
+// and .dynsym) of the objects loaded in the process, as listed by
+// dl_iterate_phdr. It does not need an unwinding cursor, so pcs collected
+// earlier can be symbolized in a batch, by any number of threads.
+//
+// The symbols of an object are read from its file the first time one of its
+// pcs is resolved. The list of objects is an immutable snapshot replaced by
+// refresh(), so looking up the object of a pc never locks. A pc outside every
+// object refreshes the list if the loader opened or closed objects since it
+// was taken, as in ModuleFilter.
+class ElfSymbolizer {
+public:
+  ElfSymbolizer() : modules(nullptr), pyEvalBegin(0), pyEvalEnd(0) {
+    refresh();
+    // frames of the python interpreter loop, recognized without their names
+    void *pyEval = dlsym(RTLD_DEFAULT, PY_EVAL_FUNC_NAME);
+    Dl_info info;
+    const ElfW(Sym) *sym = nullptr;
+    if (pyEval && dladdr1(pyEval, &info, (void **)&sym, RTLD_DL_SYMENT) &&
+        sym)
+      setPyEvalRange((uint64_t)pyEval, sym->st_size);
+  }
+
+  ~ElfSymbolizer() {
+    for (ModuleList *list : retiredLists)
+      delete list;
+    delete modules.load(std::memory_order_relaxed);
+    for (Module *module : allModules)
+      delete module;
+  }
+
+  ElfSymbolizer(const ElfSymbolizer &) = delete;
+  ElfSymbolizer &operator=(const ElfSymbolizer &) = delete;
+
+  static ElfSymbolizer *GetElfSymbolizer() {
+    static ElfSymbolizer *symbolizer = new ElfSymbolizer();
+    return symbolizer;
+  }
+
+  // pick up the objects loaded since the last refresh
+  void refresh() {
+    std::lock_guard<std::mutex> lock(refreshMutex);
+    std::vector<ModuleInfo> infos;
+    ModuleList *newList = new ModuleList();
+    ModuleFilter::LoaderCounters(newList->adds, newList->subs);
+    dl_iterate_phdr(CollectModule, &infos);
+    ModuleList *oldList = modules.load(std::memory_order_relaxed);
+    for (auto &info : infos) {
+      Module *module = nullptr;
+      for (size_t i = 0; oldList && i < oldList->modules.size() && !module;
+           ++i) {
+        Module *old = oldList->modules[i];
+        if (old->base == info.base && old->path == info.path)
+          module = old;
+      }
+      if (!module) {
+        module = new Module(info);
+        allModules.push_back(module);
+      }
+      newList->modules.push_back(module);
+    }
+    std::sort(newList->modules.begin(), newList->modules.end(),
+              [](Module *a, Module *b) { return a->begin < b->begin; });
+    modules.store(newList, std::memory_order_release);
+    // readers may still hold the old list
+    if (oldList)
+      retiredLists.push_back(oldList);
+  }
+
+  // pc is in an object whose frames are left out of call stacks, see
+  // ModuleFilter
+  bool isExcludedPC(uint64_t pc) {
+    return ModuleFilter::GetModuleFilter()->isExcluded(pc);
+  }
+
+  // pc is in _PyEval_EvalFrameDefault. Its range is known from dlsym, or
+  // else from its first resolution, e.g., in a python linked statically
+  // without dynamic symbols.
+  bool isPyEvalPC(uint64_t pc) {
+    return pc - 1 < pyEvalEnd.load(std::memory_order_acquire) &&
+           pc - 1 >= pyEvalBegin.load(std::memory_order_relaxed);
+  }
+
+  // pc is a return address, it is looked up as pc - 1 so that calls at the
+  // end of a function resolve to that function. named is set if a symbol
+  // covers pc, otherwise the name is made of the object and the offset, or
+  // of pc alone.
+  PCSymbol resolve(uint64_t pc, bool *named = nullptr) {
+    std::string funcName;
+    uint64_t offset = 0;
+    Module *module = findModule(pc);
+    if (!module && loaderChanged()) {
+      refresh();
+      module = findModule(pc);
+    }
+    const Symbol *symbol = module ? module->lookup(pc - 1) : nullptr;
+    if (named)
+      *named = symbol != nullptr;
+    if (symbol) {
+      int status = 99;
+      char *demangled =
+          abi::__cxa_demangle(symbol->name, nullptr, nullptr, &status);
+      funcName = demangled ? demangled : symbol->name;
+      free(demangled);
+      offset = pc - symbol->start;
+      if (!pyEvalEnd.load(std::memory_order_relaxed) &&
+          strcmp(symbol->name, PY_EVAL_FUNC_NAME) == 0)
+        setPyEvalRange(symbol->start, symbol->size);
+    } else {
+      char buf[64];
+      if (module) {
+        snprintf(buf, sizeof(buf), "+0x%lx]", pc - module->base);
+        size_t slash = module->path.rfind('/');
+        funcName = "[" + module->path.substr(slash == std::string::npos
+                                                  ? 0
+                                                  : slash + 1) +
+                   buf;
+      } else {
+        snprintf(buf, sizeof(buf), "[0x%lx]", pc);
+        funcName = buf;
+      }
+    }
+    PCSymbol pcSymbol;
+    pcSymbol.funcNameId = InternSymbol(funcName);
+    pcSymbol.offset = offset;
+    pcSymbol.excluded = isExcludedPC(pc);
+    pcSymbol.pyEval = isPyEvalPC(pc);
+    return pcSymbol;
+  }
+
+private:
+  // the end is published last, a reader seeing it sees the begin
+  void setPyEvalRange(uint64_t begin, uint64_t size) {
+    pyEvalBegin.store(begin, std::memory_order_relaxed);
+    pyEvalEnd.store(begin + std::max<uint64_t>(size, 1),
+                    std::memory_order_release);
+  }
+
+  struct Symbol {
+    uint64_t start;
+    uint64_t size;
+    const char *name;
+  };
+
+  struct ModuleInfo {
+    std::string path;
+    uint64_t base, begin, end;
+  };
+
+  // a loaded object, its symbols are read on the first lookup
+  struct Module {
+    std::string path;
+    uint64_t base, begin, end;
+    std::once_flag loadFlag;
+    std::vector<Symbol> symbols;
+    void *image;
+    size_t imageSize;
+
+    explicit Module(const ModuleInfo &info)
+        : path(info.path), base(info.base), begin(info.begin), end(info.end),
+          image(nullptr), imageSize(0) {}
+
+    ~Module() {
+      if (image)
+        munmap(image, imageSize);
+    }
+
+    const Symbol *lookup(uint64_t addr) {
+      std::call_once(loadFlag, [this]() { load(); });
+      auto itr = std::upper_bound(
+          symbols.begin(), symbols.end(), addr,
+          [](uint64_t a, const Symbol &s) { return a < s.start; });
+      if (itr == symbols.begin())
+        return nullptr;
+      --itr;
+      // symbols without a size (e.g., in assembly) cover up to the next one
+      if (itr->size && addr >= itr->start + itr->size)
+        return nullptr;
+      return &*itr;
+    }
+
+    // the names point into the mapped file, which stays mapped
+    void load() {
+      std::string file = path.empty() ? "/proc/self/exe" : path;
+      int fd = open(file.c_str(), O_RDONLY);
+      if (fd < 0)
+        return;
+      struct stat st;
+      if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ElfW(Ehdr))) {
+        imageSize = st.st_size;
+        image = mmap(nullptr, imageSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (image == MAP_FAILED)
+          image = nullptr;
+      }
+      close(fd);
+      if (!image)
+        return;
+
+      const char *data = (const char *)image;
+      const ElfW(Ehdr) *ehdr = (const ElfW(Ehdr) *)data;
+      if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+          ehdr->e_ident[EI_CLASS] != ELFCLASS64 || !ehdr->e_shoff ||
+          ehdr->e_shoff + ehdr->e_shnum * sizeof(ElfW(Shdr)) > imageSize)
+        return;
+      const ElfW(Shdr) *shdrs = (const ElfW(Shdr) *)(data + ehdr->e_shoff);
+      for (uint32_t i = 0; i < ehdr->e_shnum; ++i) {
+        const ElfW(Shdr) &shdr = shdrs[i];
+        if ((shdr.sh_type != SHT_SYMTAB && shdr.sh_type != SHT_DYNSYM) ||
+            shdr.sh_link >= ehdr->e_shnum ||
+            shdr.sh_offset + shdr.sh_size > imageSize)
+          continue;
+        const ElfW(Shdr) &strShdr = shdrs[shdr.sh_link];
+        if (strShdr.sh_offset + strShdr.sh_size > imageSize)
+          continue;
+        const char *strtab = data + strShdr.sh_offset;
+        const ElfW(Sym) *syms = (const ElfW(Sym) *)(data + shdr.sh_offset);
+        size_t nSyms = shdr.sh_size / sizeof(ElfW(Sym));
+        for (size_t j = 0; j < nSyms; ++j) {
+          const ElfW(Sym) &sym = syms[j];
+          int type = ELF64_ST_TYPE(sym.st_info);
+          if ((type != STT_FUNC && type != STT_GNU_IFUNC) ||
+              sym.st_shndx == SHN_UNDEF || !sym.st_value ||
+              sym.st_name >= strShdr.sh_size)
+            continue;
+          symbols.push_back({sym.st_value + base, sym.st_size,
+                             strtab + sym.st_name});
+        }
+      }
+      // one symbol per address, sized ones first
+      std::sort(symbols.begin(), symbols.end(),
+                [](const Symbol &a, const Symbol &b) {
+                  if (a.start != b.start)
+                    return a.start < b.start;
+                  return a.size > b.size;
+                });
+      symbols.erase(std::unique(symbols.begin(), symbols.end(),
+                                [](const Symbol &a, const Symbol &b) {
+                                  return a.start == b.start;
+                                }),
+                    symbols.end());
+    }
+  };
+
+  struct ModuleList {
+    // sorted by begin
+    std::vector<Module *> modules;
+    // objects loaded and unloaded before the list was taken
+    uint64_t adds, subs;
+  };
+
+  static int CollectModule(struct dl_phdr_info *info, size_t, void *data) {
+    auto infos = (std::vector<ModuleInfo> *)data;
+    uint64_t begin = UINT64_MAX, end = 0;
+    for (int i = 0; i < info->dlpi_phnum; ++i) {
+      const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+      if (phdr.p_type != PT_LOAD)
+        continue;
+      begin = std::min<uint64_t>(begin, info->dlpi_addr + phdr.p_vaddr);
+      end = std::max<uint64_t>(end,
+                               info->dlpi_addr + phdr.p_vaddr + phdr.p_memsz);
+    }
+    // the vdso has no file to read the symbols from
+    std::string path = info->dlpi_name ? info->dlpi_name : "";
+    if (begin < end && path.find("linux-vdso") == std::string::npos)
+      infos->push_back({path, info->dlpi_addr, begin, end});
+    return 0;
+  }
+
+  Module *findModule(uint64_t pc) {
+    ModuleList *list = modules.load(std::memory_order_acquire);
+    auto itr =
+        std::upper_bound(list->modules.begin(), list->modules.end(), pc,
+                         [](uint64_t a, Module *m) { return a < m->begin; });
+    if (itr == list->modules.begin())
+      return nullptr;
+    --itr;
+    return pc < (*itr)->end ? *itr : nullptr;
+  }
+
+  // the loader opened or closed objects since the last refresh
+  bool loaderChanged() {
+    ModuleList *list = modules.load(std::memory_order_acquire);
+    uint64_t adds, subs;
+    ModuleFilter::LoaderCounters(adds, subs);
+    return adds != list->adds || subs != list->subs;
+  }
+
+  std::atomic<ModuleList *> modules;
+  std::mutex refreshMutex;
+  std::vector<ModuleList *> retiredLists;
+  std::vector<Module *> allModules;
+  std::atomic<uint64_t> pyEvalBegin, pyEvalEnd;
+};
+
+// Symbolize the native frame returning to pc, through the pc symbol cache.
+// Frames without a symbol are not cached, they may be named later, e.g.,
+// jitted code or an object loaded meanwhile.
+static inline PCSymbol ResolvePCSymbol(uint64_t pc) {
+  PCSymbolCache *cache = PCSymbolCache::GetPCSymbolCache();
+  PCSymbol symbol;
+  if (!cache->lookup(pc, symbol)) {
+    bool named = false;
+    symbol = ElfSymbolizer::GetElfSymbolizer()->resolve(pc, &named);
+    if (named)
+      cache->insert(pc, symbol);
+  }
+  return symbol;
+}
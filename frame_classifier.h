@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+
+#include "elf_symbolizer.h"
+
+// Interpretation of the frames of a call stack for a deep learning backend.
+// The unwinding loops take a classifier as a template parameter, which is
+// chosen once for DL_BACKEND, so no backend test is left on their frames.
+//
+//   kCapturesPyFrames   python frames of the unwinding thread are captured
+//                       and stand in for the frames of the interpreter loop
+//   IsInterpreterFrame  the frame returning to pc is in the interpreter loop
+//
+// Interpreter frames are known by the address range of their function, see
+// ElfSymbolizer::isPyEvalPC, never by name.
+
+// plain C++ applications
+struct CxxFrameClassifier {
+  static const bool kCapturesPyFrames = false;
+
+  static bool IsInterpreterFrame(uint64_t) { return false; }
+};
+
+// TensorFlow, python frames are not captured
+struct TFFrameClassifier : CxxFrameClassifier {};
+
+// PyTorch, python frames are interleaved with the native ones
+struct TorchFrameClassifier {
+  static const bool kCapturesPyFrames = true;
+
+  static bool IsInterpreterFrame(uint64_t pc) {
+    return ElfSymbolizer::GetElfSymbolizer()->isPyEvalPC(pc);
+  }
+};
+
+typedef enum {
+  FRAME_CLASSIFIER_CXX = 0,
+  FRAME_CLASSIFIER_TORCH = 1,
+  FRAME_CLASSIFIER_TF = 2
+} FrameClassifierKind;
+
+static inline FrameClassifierKind
+GetFrameClassifierKind(const std::string &backEnd) {
+  if (backEnd == "TORCH")
+    return FRAME_CLASSIFIER_TORCH;
+  if (backEnd == "TF")
+    return FRAME_CLASSIFIER_TF;
+  return FRAME_CLASSIFIER_CXX;
+}
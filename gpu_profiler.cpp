@@ -59,126 +59,112 @@ inline void PrintUNWValue(UNWValue &val) {
             (uint32_t)tid, val.pc, val.funcName.c_str(), val.offset);
 }
 
-const char *PyObj2Str(PyObject *obj) {
-  return (const char *)PyBytes_AS_STRING(
-      PyUnicode_AsEncodedString(obj, "utf-8", "~E~"));
-}
-
-std::string GetPyLine(std::string pyFileName, int pyLineNumer) {
-  std::fstream inFile;
-  std::string lineStr;
-  inFile.open(pyFileName);
-  int i = 1;
-  while (std::getline(inFile, lineStr) && i < pyLineNumer)
-    ++i;
-  inFile.close();
-  lineStr.erase(std::remove(lineStr.begin(), lineStr.end(), ' '),
-                lineStr.end());
-  return lineStr;
-}
-
 } // namespace
 
-void pyBackTrace(std::queue<UNWValue> &pyFrameQueue) {
+// Python frames of the calling thread, innermost first.
+uint32_t pyBackTrace(PyFrameInfo *infos, uint32_t maxDepth) {
   // DEBUG_LOG("[py back trace] entered\n");
-  PyInterpreterState *mainInterpState = PyInterpreterState_Main();
-  // PyThreadState* pyState = PyInterpreterState_ThreadHead(mainInterpState);
-  // //PyGILState_GetThisThreadState();
   PyThreadState *pyState = PyGILState_GetThisThreadState();
   PyFrameObject *frame = pyState->frame;
-  while (frame) {
-    PyObject *fileNameObj = frame->f_code->co_filename;
-    PyObject *funcNameObj = frame->f_code->co_name;
-    const char *fileNameStr = PyObj2Str(fileNameObj);
-    const char *funcNameStr = PyObj2Str(funcNameObj);
-    int lineNumber = PyFrame_GetLineNumber(frame);
-    std::string lineContent = GetPyLine(fileNameStr, lineNumber);
-    // DEBUG_LOG("[py back trace] fileName: %s, funcName:%s, lineNumber:%d,
-    // lineContent:%s\n", fileNameStr, funcNameStr, lineNumber,
-    // lineContent.c_str());
-    pyFrameQueue.push(UNWValue(fileNameStr,
-                               std::string(funcNameStr) + "::" + lineContent,
-                               lineNumber));
+  uint32_t n = 0;
+  while (frame && n < maxDepth) {
+    infos[n++] = PyFrameCache::GetPyFrameCache()->resolve(frame);
     frame = frame->f_back;
   }
-}
-
-void getRSP(uint64_t *rsp) {
-  __asm__ __volatile__("mov %%rsp, %0" : "=m"(*rsp)::"memory");
+  return n;
 }
 
 namespace {
 
 void PrintCCTMap() {
-  for (auto itr : g_CPUCCTMap) {
-    itr.second->printTree();
+  CPUCCTRegistry::GetRegistry()->forEach(
+      [](pid_t tid, CPUCCT *cct) { cct->printTree(); });
+}
+
+/**
+ * @brief Capture the call stack of the caller of CaptureCallStack: its native
+ * pcs and python frames, without looking them up in the CCT.
+ *
+ * @tparam Classifier frame classifier of the backend, see frame_classifier.h
+ * @param stack
+ */
+template <typename Classifier>
+__attribute__((noinline)) void CaptureCallStack(RawCallStack &stack) {
+  // Get python stack traces.
+  stack.nPyFrames = 0;
+  if (Classifier::kCapturesPyFrames) {
+    stack.nPyFrames = pyBackTrace(stack.pyFrames, MainPyStack::kMaxDepth);
   }
+
+  // if the backend is Pytorch, and current thread has not PyFrame
+  // take the python frames of the main thread
+  stack.nMainPyFrames = 0;
+  if (GetProfilerConf()->doPyUnwinding && !stack.nPyFrames &&
+      !MainPyStack::GetMainPyStack()->read(stack.mainPyFrames,
+                                           stack.nMainPyFrames)) {
+    DEBUG_LOG("python stack of the main thread not available\n");
+  }
+
+  // skip the frame of CaptureCallStack
+  stack.nPCs = GetUnwinder()->unwind(stack.pcs, MAX_UNWIND_DEPTH, 1);
 }
 
 /**
  * @brief
  *
+ * @tparam Classifier frame classifier of the backend, see frame_classifier.h
+ * @tparam kDeferSymbolization native frames are left unnamed until export
+ * @param stack
  * @param q
  * @param verbose
  * @return CallStackStatus
  */
-CallStackStatus GenerateCallStacks(std::stack<UNWValue> &q,
-                                   bool verbose = false) {
+template <typename Classifier, bool kDeferSymbolization>
+CallStackStatus GenerateCallStacks(const RawCallStack &stack,
+                                   std::stack<UNWValue> &q, bool verbose) {
 #if DEBUG
   Timer *genCallStackTimer = Timer::GetGlobalTimer("gen_call_stack");
   genCallStackTimer->start();
 #endif
 
   CallStackStatus status;
-
-  // Get python stack traces.
-  std::queue<UNWValue> pyFrameQueue;
-  if (GetProfilerConf()->backEnd == "TORCH") {
-    pyBackTrace(pyFrameQueue);
-  }
-
-  if (pyFrameQueue.size()) {
+  if (stack.nPyFrames) {
     status = CALL_STACK_HAS_PY;
   } else {
     status = CALL_STACK_NOT_HAS_PY;
   }
 
-  unw_cursor_t cursor;
-  unw_context_t context;
-
-  unw_getcontext(&context);
-  unw_init_local(&cursor, &context);
-
-  while (unw_step(&cursor) > 0) {
-    unw_word_t offset, pc;
-    char fname[FUNC_NAME_LENGTH];
-    char *outer_name;
-
-    unw_get_reg(&cursor, UNW_REG_IP, &pc);
-    auto getProcTimer = Timer::GetGlobalTimer("unwinding_get_proc_name");
-    getProcTimer->start();
-    unw_get_proc_name(&cursor, fname, sizeof(fname), &offset);
-    getProcTimer->stop();
+  uint32_t nextPyFrame = 0;
+  ModuleFilter *moduleFilter = ModuleFilter::GetModuleFilter();
+  for (size_t i = 0; i < stack.nPCs; ++i) {
+    uint64_t pc = stack.pcs[i];
+    // skip the frames of cupti, cuda and the profiler before symbolizing
+    if (moduleFilter->isExcluded(pc))
+      continue;
 
-    int status_demangle = 99;
-    if ((outer_name = abi::__cxa_demangle(fname, nullptr, nullptr,
-                                          &status_demangle)) == 0) {
-      outer_name = fname;
+    PCSymbol symbol;
+    if (kDeferSymbolization) {
+      // named at export, see SymbolizeCPUCCTs
+      symbol.funcNameId = EMPTY_SYMBOL_ID;
+      symbol.offset = 0;
+      symbol.excluded = false;
+      symbol.pyEval = false;
+    } else {
+      auto getProcTimer = Timer::GetGlobalTimer("unwinding_get_proc_name");
+      getProcTimer->start();
+      symbol = ResolvePCSymbol(pc);
+      getProcTimer->stop();
     }
 
-    // skip cupti-related stack frames
-    if (HasExcludePatterns(outer_name))
-      continue;
-
-    if (GetProfilerConf()->backEnd == "TORCH" &&
-        std::string(outer_name).find("_PyEval_EvalFrameDefault") !=
-            std::string::npos) {
-      UNWValue value = pyFrameQueue.front();
+    if (Classifier::kCapturesPyFrames && nextPyFrame < stack.nPyFrames &&
+        Classifier::IsInterpreterFrame(pc)) {
+      const PyFrameInfo &info = stack.pyFrames[nextPyFrame++];
+      UNWValue value(GetSymbol(info.fileNameId), GetSymbol(info.funcNameId),
+                     info.lineNumber);
       value.pc = pc + value.offset; // use native pc plus offset as PyFrame pc
       q.push(value);
-      pyFrameQueue.pop();
     } else {
-      UNWValue value(pc, offset, std::string(outer_name));
+      UNWValue value(pc, symbol.offset, GetSymbol(symbol.funcNameId));
       q.push(value);
     }
 
@@ -210,100 +196,46 @@ CallStackStatus GenerateCallStacks(std::stack<UNWValue> &q,
       s2.pop();                                                                \
   } while (0)
 
-// TODO(lpc): Complicated function. Dont understand yet.
-// Maintain a CPU CCT for each thread.
-void DoBackTrace(bool verbose = false) {
-  pthread_t tid = pthread_self();
-  if (g_CPUCCTMap.find(tid) == g_CPUCCTMap.end()) {
-    // TODO(lpc): need to comm. with yan about the difference between gettid and
-    // tid here.
-    DEBUG_LOG("new CCT, tid=%d\n", gettid());
-
-    CPUCCT *newCCT = new CPUCCT();
-    // Set a virtual root node.
-    CPUCCTNode *vRootNode = new CPUCCTNode();
-
-    // TODO(lpc): can be improved with atomic.
-    g_CPUCCTNodeIdMutex.lock();
-    vRootNode->id = g_CPUCCTNodeId;
-    ++g_CPUCCTNodeId;
-    g_CPUCCTNodeIdMutex.unlock();
-
-    vRootNode->funcName = "thread:" + std::to_string(gettid()) +
-                          "::id:" + std::to_string(vRootNode->id);
-    vRootNode->pc = 0;
-    vRootNode->offset = 0;
-    vRootNode->nodeType = CCTNODE_TYPE_CXX;
-
-    newCCT->setRootNode(vRootNode);
-    g_CPUCCTMap.insert({tid, newCCT});
-  }
-
-  CPUCCT *cpuCCT = g_CPUCCTMap[tid];
-
-  // If GetProfilerConf()->fakeBT is true, do not perform cpu
-  // call stack unwinding.
-  if (GetProfilerConf()->fakeBT) {
-    g_activeCPUPCIDMutex.lock();
-    if (verbose) {
-      DEBUG_LOG("active PC changed to %lu:%p\n", cpuCCT->root->id,
-                (void *)(cpuCCT->root->pc));
-    }
-    g_activeCPUPCID = cpuCCT->root->id;
-    g_activeCPUPCIDMutex.unlock();
-    return;
-  }
-
-  // Optimization of cpu call stack unwinding: check the rsp register first.
-  uint64_t rsp;
-  getRSP(&rsp);
-  if (verbose)
-    DEBUG_LOG("rsp=%p\n", (void *)rsp);
-  if (GetProfilerConf()->checkRSP &&
-      g_esp2pcIdMap.find(rsp) != g_esp2pcIdMap.end()) {
-    uint64_t pcId = g_esp2pcIdMap[rsp];
-    g_activeCPUPCIDMutex.lock();
-    g_activeCPUPCID = pcId;
-    g_activeCPUPCIDMutex.unlock();
-    if (verbose)
-      DEBUG_LOG("already unwound, active pc id changed to %lu\n", pcId);
-    return;
-  }
-
+/**
+ * @brief Insert the call path of stack into cpuCCT.
+ *
+ * @param cpuCCT
+ * @param stack
+ * @param verbose
+ * @return uint64_t id of the leaf of the call path
+ */
+uint64_t InsertCallStack(CPUCCT *cpuCCT, const RawCallStack &stack,
+                         bool verbose = false) {
   // nodes to be inserted to the cpu calling context tree
   std::stack<UNWValue> toInsertUNW;
   std::stack<UNWValue> toInsertUNWMain;
 
-  auto status = GenerateCallStacks(toInsertUNW, verbose);
-
-  // TODO(lpc): don't understand this part yet.
-  // if the backend is Pytorch, and current thread has not PyFrame
-  // go to the main thread for PyFrame
-  if (GetProfilerConf()->doPyUnwinding && status == CALL_STACK_NOT_HAS_PY) {
-    DEBUG_LOG("this thread has not PyFrame, going to the main thread\n");
-    g_genCallStack = true;
-    pthread_kill(GetProfilerConf()->mainThreadTid, SIGUSR1);
-    while (g_genCallStack) {
-    }
-    toInsertUNWMain = g_callStack;
-    // TODO: clear the stack or not ?
-    while (!g_callStack.empty()) {
-      g_callStack.pop();
+  auto status =
+      g_unwindingFuncs.generateCallStacks(stack, toInsertUNW, verbose);
+
+  // python frames of the main thread, when current thread has not PyFrame
+  if (status == CALL_STACK_NOT_HAS_PY) {
+    for (uint32_t i = stack.nMainPyFrames; i-- > 0;) {
+      const PyFrameInfo &info = stack.mainPyFrames[i];
+      UNWValue value(GetSymbol(info.fileNameId), GetSymbol(info.funcNameId),
+                     info.lineNumber);
+      value.pc = MainPyStack::FramePC(info);
+      toInsertUNWMain.push(value);
     }
   }
 
+  CPUCCTWriteGuard writeGuard(cpuCCT);
   CPUCCTNode *parentNode = cpuCCT->root;
   while (!toInsertUNW.empty()) {
     UNWValue value;
     TOP2(toInsertUNWMain, toInsertUNW, value);
-    CPUCCTNode *childNode = parentNode->getChildbyPC(value.pc);
+    CPUCCTNode *childNode = cpuCCT->getChildbyPC(parentNode, value.pc);
     // if finding a CXX node with _PyEval_EvalFrameDefault (C2P node)
     //     replace it with PY node
     if (childNode) {
       if (childNode->nodeType == CCTNODE_TYPE_C2P) {
         if (value.nodeType == CCTNODE_TYPE_PY) {
-          childNode->nodeType = CCTNODE_TYPE_PY;
-          childNode->funcName = value.funcName;
+          cpuCCT->renameNode(childNode, CCTNODE_TYPE_PY, value.funcName);
           DEBUG_LOG("py node renamed in unwinding: %s\n",
                     value.funcName.c_str());
         } else {
@@ -318,204 +250,385 @@ void DoBackTrace(bool verbose = false) {
     }
   }
 
+  // id of the leaf of the call path
+  uint64_t leafPCId = 0;
+
   // The call path has been searched before
   if (toInsertUNW.empty()) {
-    g_activeCPUPCIDMutex.lock();
-    g_activeCPUPCID = parentNode->id;
+    // its leaf may be an inner node of a path inserted earlier
+    cpuCCT->endPath(parentNode);
+    leafPCId = cpuCCT->getAttributedId(parentNode);
     if (verbose)
-      DEBUG_LOG("old pc, active pc changed to %lu:%p\n", parentNode->id,
+      DEBUG_LOG("old pc, leaf pc %lu:%p\n", leafPCId,
                 (void *)(parentNode->pc));
-    g_activeCPUPCIDMutex.unlock();
   }
 
   // The call path has unsearched suffix
   while (!toInsertUNW.empty()) {
     UNWValue value;
     TOP2(toInsertUNWMain, toInsertUNW, value);
-    CPUCCTNode *newNode = new CPUCCTNode(value.nodeType);
+    CPUCCTNode *newNode = cpuCCT->newNode(value.nodeType);
+    // the tree is full, the path is cut at its deepest node
+    if (!newNode) {
+      cpuCCT->endPath(parentNode);
+      leafPCId = cpuCCT->getAttributedId(parentNode);
+      break;
+    }
 
     newNode->pc = value.pc;
     newNode->offset = value.offset;
 
-    g_CPUCCTNodeIdMutex.lock();
-    newNode->id = g_CPUCCTNodeId;
-    ++g_CPUCCTNodeId;
-    g_CPUCCTNodeIdMutex.unlock();
+    newNode->id = CPUCCTNodeIdAllocator::NextId();
 
     if (value.nodeType == CCTNODE_TYPE_CXX) {
-      newNode->funcName =
-          value.funcName; // + "_" + std::to_string(newNode->id);
+      newNode->setFuncName(
+          value.funcName); // + "_" + std::to_string(newNode->id);
     } else {
       // + "_" + std::to_string(newNode->id)
-      newNode->funcName = value.fileName + "::" + value.funcName + "_" +
-                          std::to_string(value.offset);
+      newNode->setFuncName(value.fileName + "::" + value.funcName + "_" +
+                           std::to_string(value.offset));
     }
 
+    cpuCCT->insertNode(parentNode, newNode);
+
     // leaf node
     if (toInsertUNW.size() == 1) {
-      g_activeCPUPCIDMutex.lock();
+      cpuCCT->endPath(newNode);
+      leafPCId = cpuCCT->getAttributedId(newNode);
       if (verbose)
-        DEBUG_LOG("active pc changed to %lu:%p\n", newNode->id,
+        DEBUG_LOG("new pc, leaf pc %lu:%p\n", leafPCId,
                   (void *)(newNode->pc));
-      g_activeCPUPCID = newNode->id;
-      g_esp2pcIdMap[rsp] = newNode->id;
-      g_activeCPUPCIDMutex.unlock();
     }
-
-    cpuCCT->insertNode(parentNode, newNode);
     parentNode = newNode;
     POP2(toInsertUNWMain, toInsertUNW);
   }
+
+  return leafPCId;
 }
 
-void CopyCPUCCT2ProtoCPUCCT(CPUCCT *cct, CPUCallingContextTree *&tree) {
-  if (!cct->root)
-    return;
-  tree->set_rootid(cct->root->id);
-  tree->set_rootpc(cct->root->pc);
-  for (auto node : cct->nodeMap) {
-    CPUCallingContextNode protoNode;
-    protoNode.set_id(node.first);
-    protoNode.set_pc(node.second->pc);
-    protoNode.set_parentid(node.second->parentID);
-    protoNode.set_parentpc(node.second->parentPC);
-    protoNode.set_offset(node.second->offset);
-    protoNode.set_funcname(node.second->funcName);
-    for (auto id2child : node.second->id2ChildNodes) {
-      protoNode.add_childids(id2child.first);
-    }
-    for (auto pc2child : node.second->pc2ChildNodes) {
-      protoNode.add_childpcs(pc2child.first);
+// TODO(lpc): Complicated function. Dont understand yet.
+// Maintain a CPU CCT for each thread.
+void DoBackTrace(bool verbose = false) {
+  if (!g_threadCPUCCT)
+    g_threadCPUCCT = GetThreadCPUCCT(gettid());
+  CPUCCT *cpuCCT = g_threadCPUCCT;
+
+  // If GetProfilerConf()->fakeBT is true, do not perform cpu
+  // call stack unwinding.
+  if (GetProfilerConf()->fakeBT) {
+    g_activeCPUPCIDMutex.lock();
+    if (verbose) {
+      DEBUG_LOG("active PC changed to %lu:%p\n", cpuCCT->root->id,
+                (void *)(cpuCCT->root->pc));
     }
-    (*(tree->mutable_nodemap()))[node.second->id] = protoNode;
+    g_activeCPUPCID = cpuCCT->root->id;
+    g_activeCPUPCIDMutex.unlock();
+    return;
   }
-}
 
-CriticalNodeType IsCriticalNode(CPUCCTNode *node) {
-  std::regex torchOPRegex("at::_ops::(\\S+)::call(\\S+)");
-  std::regex tfOPRegex("(\\S+)Op(Kernel)?.+::Compute");
-
-  // keep python nodes
-  if (node->nodeType == CCTNODE_TYPE_PY) {
-    if (node->funcName.find("python3") == std::string::npos) {
-      if (node->funcName.find("backward") != std::string::npos) {
-        DEBUG_LOG("critical node, kind=backward, funcName=%s, id=%lu\n",
-                  node->funcName.c_str(), node->id);
-        return CRITICAL_TYPE_PY_BACKWARD;
-      }
-      if (node->funcName.find(GetProfilerConf()->pyFileName) !=
-              std::string::npos &&
-          node->funcName.find("loss") != std::string::npos) {
-        DEBUG_LOG("critical node, kind=loss, funcName=%s, id=%lu\n",
-                  node->funcName.c_str(), node->id);
-        return CRITICAL_TYPE_PY_LOSS;
-      }
-      if (node->funcName.find("forward") != std::string::npos) {
-        DEBUG_LOG("critical node, kind=forward, funcName=%s, id=%lu\n",
-                  node->funcName.c_str(), node->id);
-        return CRITICAL_TYPE_PY_FORWARD;
+  // Optimization of cpu call stack unwinding: look the stack signature up
+  // first, unwinding anyway to verify some of the hits.
+  StackSignatureCache *stackCache = nullptr;
+  StackSignature signature;
+  uint64_t cachedPCId = 0;
+  bool verifyingHit = false;
+  if (GetProfilerConf()->checkRSP) {
+    stackCache = StackSignatureCache::GetThreadCache();
+    GetStackSignature(signature, GetProfilerConf()->stackSignatureDepth);
+    // python frames are not on the native stack, the main python stack
+    // changes with every python call
+    if (GetProfilerConf()->doPyUnwinding)
+      signature.context = MainPyStack::GetMainPyStack()->getGeneration();
+    if (verbose)
+      DEBUG_LOG("rsp=%p\n", (void *)signature.rsp);
+    if (stackCache->lookup(signature, cachedPCId)) {
+      verifyingHit = stackCache->shouldVerify();
+      if (!verifyingHit) {
+        g_activeCPUPCIDMutex.lock();
+        g_activeCPUPCID = cachedPCId;
+        g_activeCPUPCIDMutex.unlock();
+        if (verbose)
+          DEBUG_LOG("already unwound, active pc id changed to %lu\n",
+                    cachedPCId);
+        return;
       }
     }
   }
 
-  // Pytorch OP regex
-  std::smatch results;
-  if (std::regex_search(node->funcName, results, torchOPRegex)) {
-    DEBUG_LOG("critical node, kind=torch regex, funcName=%s, id=%lu\n",
-              node->funcName.c_str(), node->id);
-    return CRITICAL_TYPE_TORCH_OP;
+  // python frames of the main thread are tracked for the other threads
+  if (GetProfilerConf()->doPyUnwinding)
+    MainPyStack::GetMainPyStack()->reinstallIfMainThread();
+
+  RawCallStack stack;
+  g_unwindingFuncs.captureCallStack(stack);
+  uint64_t leafPCId = InsertCallStack(cpuCCT, stack, verbose);
+
+  g_activeCPUPCIDMutex.lock();
+  g_activeCPUPCID = leafPCId;
+  if (verbose)
+    DEBUG_LOG("active pc changed to %lu\n", leafPCId);
+  g_activeCPUPCIDMutex.unlock();
+
+  if (stackCache) {
+    if (verifyingHit && cachedPCId != leafPCId) {
+      stackCache->countFalseHit();
+      if (verbose)
+        DEBUG_LOG("false stack cache hit, cached=%lu, unwound=%lu\n",
+                  cachedPCId, leafPCId);
+    }
+    stackCache->insert(signature, leafPCId);
   }
+}
 
-  // TF OP regex
-  if (std::regex_search(node->funcName, results, tfOPRegex)) {
-    DEBUG_LOG("critical node, kind=tf regex, funcName=%s, id=%lu\n",
-              node->funcName.c_str(), node->id);
-    return CRITICAL_TYPE_TF_OP;
+// Insert the call path of a launch captured by PushLaunchCallStack into the
+// CCT of its thread, on the thread of the CCT builder.
+uint64_t BuildLaunchCallStack(const RawCallStack &stack) {
+  return InsertCallStack(GetThreadCPUCCT(stack.tid), stack);
+}
+
+// Capture the call stack of the kernel launch corId for the CCT builder, the
+// CCT is not touched on the launching thread (ASYNC_CCT_BUILD).
+void PushLaunchCallStack(uint32_t corId) {
+  if (GetProfilerConf()->doPyUnwinding)
+    MainPyStack::GetMainPyStack()->reinstallIfMainThread();
+
+  RawCallStack stack;
+  stack.corId = corId;
+  stack.tid = gettid();
+  g_unwindingFuncs.captureCallStack(stack);
+  CCTBuilder::GetCCTBuilder()->push(stack);
+  g_lastLaunchCorId.store(corId, std::memory_order_release);
+}
+
+// Maps process-wide symbol ids to dense indices of the string table of one
+// response, so that a response only carries the names it references.
+class ResponseStringTable {
+public:
+  explicit ResponseStringTable(GPUProfilingResponse *_reply) : reply(_reply) {
+    // index 0 is the empty string, as in the SymbolTable
+    reply->add_stringtable("");
+    symbolId2Index[EMPTY_SYMBOL_ID] = 0;
   }
 
-  // leaf node
-  if (node->childNodes.size() == 0) {
-    DEBUG_LOG("critical node, kind=leaf, funcName=%s, id=%lu\n",
-              node->funcName.c_str(), node->id);
-    return CRITICAL_TYPE_LEAF;
+  uint32_t getIndex(SymbolId symbolId) {
+    auto itr = symbolId2Index.find(symbolId);
+    if (itr != symbolId2Index.end())
+      return itr->second;
+    uint32_t index = reply->stringtable_size();
+    reply->add_stringtable(GetSymbol(symbolId));
+    symbolId2Index.insert(std::make_pair(symbolId, index));
+    return index;
   }
 
-  return NOT_CRITICAL_NODE;
+private:
+  GPUProfilingResponse *reply;
+  std::unordered_map<SymbolId, uint32_t> symbolId2Index;
+};
+
+void CopyCPUCCTNode2ProtoNode(CPUCCT *cct, CPUCCTNode *node,
+                              CPUCallingContextNode &protoNode,
+                              ResponseStringTable &stringTable,
+                              bool inlineFuncNames = false) {
+  CPUCCTNode *parent = cct->getParent(node);
+  protoNode.set_id(node->id);
+  protoNode.set_pc(node->pc);
+  protoNode.set_parentid(parent ? parent->id : 0);
+  protoNode.set_parentpc(parent ? parent->pc : 0);
+  protoNode.set_offset(node->offset);
+  protoNode.set_samples(node->getSamples());
+  // only for clients that predate the string table
+  if (inlineFuncNames)
+    protoNode.set_funcname(GetSymbol(node->getFuncNameId()));
+  protoNode.set_funcnameid(stringTable.getIndex(node->getFuncNameId()));
+  cct->forEachChild(node, [&protoNode](CPUCCTNode *child) {
+    protoNode.add_childids(child->id);
+    protoNode.add_childpcs(child->pc);
+  });
 }
 
-void PruneTreeRecursively(CPUCCT *newTree, CPUCCT *oldTree,
-                          uint64_t currNewNodeId, uint64_t currOldNodeId) {
-  auto currNewNode = newTree->nodeMap[currNewNodeId];
-  auto currOldNode = oldTree->nodeMap[currOldNodeId];
-  for (auto child : currOldNode->childNodes) {
-    if (IsCriticalNode(child) != NOT_CRITICAL_NODE) {
-      // for continus op calling, keep the first one/merge them?
-      if (currOldNode->childNodes.size() == 1 &&
-          IsCriticalNode(currNewNode) == CRITICAL_TYPE_TORCH_OP &&
-          IsCriticalNode(child) == CRITICAL_TYPE_TORCH_OP) {
-        currNewNode->funcName += ("::" + child->funcName.substr(10));
-        PruneTreeRecursively(newTree, oldTree, currNewNodeId, child->id);
-      } else {
-        CPUCCTNode *newChild = new CPUCCTNode();
-        CPUCCTNode::copyNodeWithoutRelation(child, newChild);
-        newTree->insertNode(currNewNode, newChild, true);
-        PruneTreeRecursively(newTree, oldTree, newChild->id, child->id);
-      }
-    } else {
-      PruneTreeRecursively(newTree, oldTree, currNewNodeId, child->id);
+void CopyCPUCCT2ProtoCPUCCT(CPUCCT *cct, CPUCallingContextTree *&tree,
+                            ResponseStringTable &stringTable) {
+  if (!cct->root)
+    return;
+  tree->set_rootid(cct->root->id);
+  tree->set_rootpc(cct->root->pc);
+  cct->forEachNode([cct, tree, &stringTable](CPUCCTNode *node) {
+    CopyCPUCCTNode2ProtoNode(cct, node, (*(tree->mutable_nodemap()))[node->id],
+                             stringTable);
+  });
+}
+
+/**
+ * @brief Name the native nodes collected with deferred symbolization. The
+ * distinct pcs of the nodes created since the previous call are resolved in a
+ * batch, by a pool of workers.
+ */
+void SymbolizeCPUCCTs() {
+  static std::mutex symbolizeMutex;
+  // nodes created before this epoch have been named
+  static uint32_t symbolizedEpoch = 0;
+  std::lock_guard<std::mutex> lock(symbolizeMutex);
+  uint32_t epoch = CPUCCTEpoch::Current();
+
+  std::unordered_map<uint64_t, std::vector<CPUCCTNode *>> pc2Nodes;
+  CPUCCTRegistry::GetRegistry()->forEach([&pc2Nodes](pid_t, CPUCCT *cct) {
+    cct->forEachNodeChangedSince(symbolizedEpoch, [&](CPUCCTNode *node) {
+      // interpreter frames of cpu samples are named too, unless a python
+      // frame has renamed them
+      if (node != cct->root &&
+          (node->nodeType == CCTNODE_TYPE_CXX ||
+           node->nodeType == CCTNODE_TYPE_C2P) &&
+          node->getFuncNameId() == EMPTY_SYMBOL_ID)
+        pc2Nodes[node->pc].push_back(node);
+    });
+  });
+  symbolizedEpoch = epoch;
+  if (pc2Nodes.empty())
+    return;
+
+  std::vector<uint64_t> pcs;
+  for (auto &itr : pc2Nodes)
+    pcs.push_back(itr.first);
+  std::vector<PCSymbol> symbols(pcs.size());
+  ElfSymbolizer *symbolizer = ElfSymbolizer::GetElfSymbolizer();
+  PCSymbolCache *pcSymbolCache = PCSymbolCache::GetPCSymbolCache();
+  symbolizer->refresh();
+  ParallelFor(pcs.size(), GetProfilerConf()->symbolizationWorkers,
+              [&](size_t i) {
+                if (!pcSymbolCache->lookup(pcs[i], symbols[i])) {
+                  bool named = false;
+                  symbols[i] = symbolizer->resolve(pcs[i], &named);
+                  if (named)
+                    pcSymbolCache->insert(pcs[i], symbols[i]);
+                }
+              });
+  for (size_t i = 0; i < pcs.size(); ++i) {
+    for (CPUCCTNode *node : pc2Nodes[pcs[i]]) {
+      // a C2P node may have become a python node meanwhile
+      SymbolId unnamed = EMPTY_SYMBOL_ID;
+      if (node->funcNameId.compare_exchange_strong(unnamed,
+                                                   symbols[i].funcNameId,
+                                                   std::memory_order_acq_rel))
+        node->offset = symbols[i].offset;
     }
   }
+  DEBUG_LOG("symbolized %lu pcs\n", pcs.size());
 }
 
-void PruneCPUCCT(CCTMAP_t &cctMap) {
-  DEBUG_LOG("pruning cpu cct\n");
-  for (auto itr : g_CPUCCTMap) {
-    auto key = itr.first;
-    CPUCCT *oldCCT = itr.second;
-    CPUCCT *newCCT = new CPUCCT();
-    cctMap.insert(std::make_pair(key, newCCT));
-    CPUCCTNode *oldRootNode = oldCCT->root;
-    CPUCCTNode *newRootNode = new CPUCCTNode();
-    CPUCCTNode::copyNodeWithoutRelation(oldRootNode, newRootNode);
-    newCCT->setRootNode(newRootNode);
-    PruneTreeRecursively(newCCT, oldCCT, newRootNode->id, oldRootNode->id);
+/**
+ * @brief Copy the cpu ccts to the response.
+ *
+ * @param reply
+ * @param sinceEpoch only copy the nodes created or modified since this epoch,
+ * 0 for the whole trees. Ignored when pruning or merging, pruned and merged
+ * trees are rebuilt for every export, from the pruned views if the trees
+ * have them.
+ * @param inlineFuncNames also fill the names of the nodes, not only their
+ * indices into the string table
+ */
+void CopyCPUCCT2ProtoCPUCCTV2(GPUProfilingResponse *reply,
+                              uint32_t sinceEpoch = 0,
+                              bool inlineFuncNames = false) {
+  // changes from now on are stamped with the next epoch
+  // launches captured so far belong to this epoch
+  if (GetProfilerConf()->asyncCCTBuild)
+    CCTBuilder::GetCCTBuilder()->flush();
+  reply->set_epoch(CPUCCTEpoch::Advance());
+  if (GetProfilerConf()->deferSymbolization)
+    SymbolizeCPUCCTs();
+  if (GetProfilerConf()->enableCPUSampling) {
+    reply->set_cpusamples(g_cpuSamplerCollection->GetSamples());
+    reply->set_cpulostsamples(g_cpuSamplerCollection->GetLostSamples());
+  }
+  CCTMAP_t cctMap, unprunedCCTMap, viewCCTMap;
+  bool pruneCCT = GetProfilerConf()->pruneCCT;
+  bool prunedViews = pruneCCT && GetProfilerConf()->pruneCCTIncremental;
+  CPUCCTRegistry::GetRegistry()->forEach([&](pid_t tid, CPUCCT *cct) {
+    CPUCCTPrunedView *view =
+        prunedViews ? dynamic_cast<CPUCCTPrunedView *>(cct->getObserver())
+                    : nullptr;
+    // trees without a pruned view are pruned from the whole tree
+    if (view)
+      viewCCTMap.insert(std::make_pair(tid, cct));
+    else if (pruneCCT)
+      unprunedCCTMap.insert(std::make_pair(tid, cct));
+    else
+      cctMap.insert(std::make_pair(tid, cct));
+  });
+
+  std::unique_ptr<CPUCCTPruner> pruner, viewPruner;
+  if (!unprunedCCTMap.empty()) {
+    DEBUG_LOG("pruning cpu cct\n");
+    pruner.reset(new CPUCCTPruner(GetProfilerConf()->pruneCCTWorkers));
+    CCTMAP_t prunedCCTMap;
+    pruner->prune(unprunedCCTMap, prunedCCTMap);
+    cctMap.insert(prunedCCTMap.begin(), prunedCCTMap.end());
+    sinceEpoch = 0;
+  }
+  if (!viewCCTMap.empty()) {
+    DEBUG_LOG("pruning the pruned views of the cpu cct\n");
+    viewPruner.reset(new CPUCCTPruner(GetProfilerConf()->pruneCCTWorkers));
+    CCTMAP_t prunedCCTMap;
+    viewPruner->pruneViews(viewCCTMap, prunedCCTMap);
+    cctMap.insert(prunedCCTMap.begin(), prunedCCTMap.end());
+    sinceEpoch = 0;
   }
-}
 
-void CopyCPUCCT2ProtoCPUCCTV2(GPUProfilingResponse *reply) {
-  CCTMAP_t PrunedCPUCCTMap;
-  if (GetProfilerConf()->pruneCCT)
-    PruneCPUCCT(PrunedCPUCCTMap);
-  else
-    PrunedCPUCCTMap = g_CPUCCTMap;
-  for (auto itr : PrunedCPUCCTMap) {
+  std::unique_ptr<CPUCCTMerger> merger;
+  if (GetProfilerConf()->mergeCCT) {
+    merger.reset(new CPUCCTMerger(GetProfilerConf()->mergeCCTWorkers,
+                                  GetProfilerConf()->mergeCCTThreadIds));
+    CPUCCT *mergedCCT = merger->merge(cctMap);
+    cctMap.clear();
+    cctMap.insert(std::make_pair(getpid(), mergedCCT));
+    sinceEpoch = 0;
+    // gpu pc samples refer to the nodes of the per-thread trees
+    for (auto &pcSamplingData : *reply->mutable_pcsamplingdata()) {
+      for (auto &pcData : *pcSamplingData.mutable_ppcdata()) {
+        uint64_t mergedId = merger->getMergedId(pcData.parentcpupcid());
+        if (mergedId)
+          pcData.set_parentcpupcid(mergedId);
+      }
+    }
+  }
+
+  ResponseStringTable stringTable(reply);
+  for (auto itr : cctMap) {
     CPUCCT *cct = itr.second;
     if (!cct->root)
-      return;
-    CPUCallingContextTree *tree = reply->add_cpucallingctxtree();
-    tree->set_rootid(cct->root->id);
-    tree->set_rootpc(cct->root->pc);
-    for (auto node : cct->nodeMap) {
-      CPUCallingContextNode protoNode;
-      protoNode.set_id(node.first);
-      protoNode.set_pc(node.second->pc);
-      protoNode.set_parentid(node.second->parentID);
-      protoNode.set_parentpc(node.second->parentPC);
-      protoNode.set_offset(node.second->offset);
-      protoNode.set_samples(node.second->samples);
-      protoNode.set_funcname(node.second->funcName);
-      for (auto id2child : node.second->id2ChildNodes) {
-        protoNode.add_childids(id2child.first);
-      }
-      for (auto pc2child : node.second->pc2ChildNodes) {
-        protoNode.add_childpcs(pc2child.first);
-      }
-      (*(tree->mutable_nodemap()))[node.second->id] = protoNode;
+      continue;
+    // trees without changes are left out of a delta
+    CPUCallingContextTree *tree = nullptr;
+    cct->forEachNodeChangedSince(
+        sinceEpoch,
+        [cct, reply, &tree, &stringTable, inlineFuncNames](CPUCCTNode *node) {
+          if (!tree) {
+            tree = reply->add_cpucallingctxtree();
+            tree->set_rootid(cct->root->id);
+            tree->set_rootpc(cct->root->pc);
+          }
+          CopyCPUCCTNode2ProtoNode(cct, node,
+                                   (*(tree->mutable_nodemap()))[node->id],
+                                   stringTable, inlineFuncNames);
+        });
+  }
+
+  if (merger && reply->cpucallingctxtree_size()) {
+    auto nodeMap = reply->mutable_cpucallingctxtree(0)->mutable_nodemap();
+    for (auto &itr : merger->getLeafThreadIds()) {
+      for (pid_t tid : itr.second)
+        (*nodeMap)[itr.first].add_threadids(tid);
     }
   }
 }
 
 void StorePCSamplesParents(CUpti_PCSamplingData *pPcSamplingData) {
+  if (GetProfilerConf()->asyncCCTBuild) {
+    // the call path of the launch may not be built yet
+    g_GPUPCSamplesCorIds[pPcSamplingData] =
+        g_lastLaunchCorId.load(std::memory_order_acquire);
+    return;
+  }
   for (int i = 0; i < pPcSamplingData->totalNumPcs; ++i) {
     CUpti_PCSamplingPCData *pPcData = &pPcSamplingData->pPcData[i];
     g_GPUPCSamplesParentCPUPCIDs[pPcData] = g_activeCPUPCID;
@@ -889,6 +1002,7 @@ void RPCCopyTracingData(GPUProfilingResponse *reply) {
 }
 
 void RPCCopyPCSamplingData(GPUProfilingResponse *reply) {
+  RegisterProfilerThread();
   bool to_break = false;
   DEBUG_LOG("rpc copy thread created [sampling]\n");
   while (true) {
@@ -912,6 +1026,11 @@ void RPCCopyPCSamplingData(GPUProfilingResponse *reply) {
       // pcSampDataProto->set_nonusrkernelstotalsamples(pcSampData->nonUsrKernelsTotalSamples);
       pcSampDataProto->set_nonusrkernelstotalsamples(0);
 
+      uint64_t launchParentCPUPCID = 0;
+      if (GetProfilerConf()->asyncCCTBuild)
+        launchParentCPUPCID = CCTBuilder::GetCCTBuilder()->getLeafId(
+            g_GPUPCSamplesCorIds[pcSampData]);
+
       for (int i = 0; i < pcSampData->totalNumPcs; ++i) {
         gpuprofiling::CUptiPCSamplingPCData *pcDataProto =
             pcSampDataProto->add_ppcdata();
@@ -923,7 +1042,11 @@ void RPCCopyPCSamplingData(GPUProfilingResponse *reply) {
         pcDataProto->set_pad(pcData->pad);
         pcDataProto->set_functionname(std::string(pcData->functionName));
         pcDataProto->set_stallreasoncount(pcData->stallReasonCount);
-        pcDataProto->set_parentcpupcid(g_GPUPCSamplesParentCPUPCIDs[pcData]);
+        if (GetProfilerConf()->asyncCCTBuild)
+          pcDataProto->set_parentcpupcid(launchParentCPUPCID);
+        else
+          pcDataProto->set_parentcpupcid(
+              g_GPUPCSamplesParentCPUPCIDs[pcData]);
         for (int j = 0; j < pcData->stallReasonCount; ++j) {
           gpuprofiling::PCSamplingStallReason *stallResProto =
               pcDataProto->add_stallreason();
@@ -960,6 +1083,7 @@ void AtExitHandler() {
   if (GetProfilerConf()->noRPC) {
     g_pcSamplingStarted = false;
     g_tracingStarted = false;
+    MainPyStack::GetMainPyStack()->stopTracking();
   }
   if (g_pcSamplingStarted) {
     DEBUG_LOG("waiting for pc sampling stopping\n");
@@ -988,6 +1112,10 @@ void AtExitHandler() {
         << std::endl;
   }
 
+  // build the launches left in the rings
+  if (GetProfilerConf()->asyncCCTBuild)
+    CCTBuilder::GetCCTBuilder()->stop();
+
   if (GetProfilerConf()->noRPC) {
     if (GetProfilerConf()->enableCPUSampling) {
       g_cpuSamplerCollection->DisableSampling();
@@ -1003,7 +1131,11 @@ void AtExitHandler() {
     }
     CopyCPUCCT2ProtoCPUCCTV2(g_reply);
     g_reply->set_message("profiling completed");
-    if (DumpSamplingResults(*g_reply, GetProfilerConf()->dumpFileName)) {
+    bool dumped =
+        GetProfilerConf()->dumpFormat == "mmap"
+            ? DumpSamplingResultsMmap(*g_reply, GetProfilerConf()->dumpFileName)
+            : DumpSamplingResults(*g_reply, GetProfilerConf()->dumpFileName);
+    if (dumped) {
       DEBUG_LOG("dumping to %s successfully\n",
                 GetProfilerConf()->dumpFileName.c_str());
     } else {
@@ -1083,7 +1215,9 @@ void CallbackHandler(void *userdata, CUpti_CallbackDomain domain,
           g_pidt2pthreadt.insert({gettid(), tid});
           g_pthreadt2pidt.insert({tid, gettid()});
           g_kernelThreadSyncedMap.insert({tid, false});
-          g_cpuSamplerCollection->RegisterSampler(gettid());
+          // threads created after the per-cpu samplers are sampled by them
+          if (g_cpuSamplerCollection->NeedsThreadSampler(gettid()))
+            g_cpuSamplerCollection->RegisterSampler(gettid());
         }
         if (GetProfilerConf()->noSampling) {
           if (GetProfilerConf()->doCPUCallStackUnwinding && g_tracingStarted) {
@@ -1109,7 +1243,10 @@ void CallbackHandler(void *userdata, CUpti_CallbackDomain domain,
         } else {
           if (GetProfilerConf()->doCPUCallStackUnwinding &&
               g_pcSamplingStarted) {
-            DoBackTrace(GetProfilerConf()->backTraceVerbose);
+            if (GetProfilerConf()->asyncCCTBuild)
+              PushLaunchCallStack(cbInfo->correlationId);
+            else
+              DoBackTrace(GetProfilerConf()->backTraceVerbose);
           }
         }
       }
@@ -1377,7 +1514,7 @@ void stopCUptiPCSamplingHandler(int signum) {
 }
 
 void startPCThreadSyncHanlder(int signum) {
-  if (signum == SIGUSR1 && !g_genCallStack) {
+  if (signum == SIGUSR1) {
     pthread_t tid = pthread_self();
     DEBUG_LOG("[pid=%u, tid=%u] in start, synchronizing\n", (uint32_t)gettid(),
               (uint32_t)pthread_self());
@@ -1405,10 +1542,6 @@ void startPCThreadSyncHanlder(int signum) {
     DEBUG_LOG(
         "[pid=%u, tid=%u] PC sampling started, continue launching kernels\n",
         (uint32_t)gettid(), (uint32_t)pthread_self());
-  } else if (g_genCallStack) {
-    DEBUG_LOG("back trace signal received\n");
-    GenerateCallStacks(g_callStack);
-    g_genCallStack = false;
   }
 }
 
@@ -1445,59 +1578,39 @@ void stopPCThreadSyncHandler(int signum) {
 }
 
 //
+// Add count samples of callStack to the CCT of thread pid.
+template <typename Classifier>
 void UpdateCCT(pid_t pid, CPUCallStackSampler::CallStack &callStack,
-               bool verbose = false) {
-  pthread_t tid = g_pidt2pthreadt[pid];
-
+               uint64_t count, bool verbose) {
   // Maintain a seperate CCT for each CPU thread.
-  if (g_CPUCCTMap.find(tid) == g_CPUCCTMap.end()) {
-    DEBUG_LOG("new CCT, tid=%d\n", pid);
-    CPUCCT *newCCT = new CPUCCT();
-    // set a virtual root node of the new added CCT
-    CPUCCTNode *vRootNode = new CPUCCTNode();
-
-    g_CPUCCTNodeIdMutex.lock();
-    vRootNode->id = g_CPUCCTNodeId;
-    ++g_CPUCCTNodeId;
-    g_CPUCCTNodeIdMutex.unlock();
-
-    vRootNode->funcName = "thread:" + std::to_string(pid) +
-                          "::id:" + std::to_string(vRootNode->id);
-    vRootNode->pc = 0;
-    vRootNode->offset = 0;
-    vRootNode->nodeType = CCTNODE_TYPE_CXX;
-
-    newCCT->setRootNode(vRootNode);
-    g_CPUCCTMap.insert(std::make_pair(tid, newCCT));
-  }
-
-  CPUCCT *cpuCCT = g_CPUCCTMap[tid];
+  CPUCCT *cpuCCT = GetThreadCPUCCT(pid);
+  CPUCCTWriteGuard writeGuard(cpuCCT);
 
   auto parentNode = cpuCCT->root;
   int i;
 
   // false: no need to update cct
   // true: there are nodes to insert
-  // TODO: update the sample count
   bool flag = false;
   for (i = callStack.depth - 1; i >= 0; --i) {
+    const PCSymbol &symbol = callStack.symbols[i];
     if (verbose)
       DEBUG_LOG("[pid=%d] in cpu sampler thread, %s:%lx\n", pid,
-                callStack.fnames[i].c_str(), callStack.pcs[i]);
-    if (callStack.fnames[i].length() == 0 ||
-        HasExcludePatterns(callStack.fnames[i])) {
+                GetSymbol(symbol.funcNameId).c_str(), callStack.pcs[i]);
+    if (symbol.excluded) {
       break;
     }
-    std::string funcName = callStack.fnames[i];
     uint64_t pc = callStack.pcs[i];
 
-    auto childNode = parentNode->getChildbyPC(pc);
+    auto childNode = cpuCCT->getChildbyPC(parentNode, pc);
     if (childNode) {
       parentNode = childNode;
-      ++childNode->samples;
+      childNode->addSamples(count);
+      cpuCCT->touchNode(childNode);
       if (verbose)
         DEBUG_LOG("[pid=%d] old cpu sample: %s:%lx, samples=%lu\n", pid,
-                  funcName.c_str(), pc, childNode->samples);
+                  GetSymbol(symbol.funcNameId).c_str(), pc,
+                  childNode->getSamples());
     } else {
       flag = true;
       break;
@@ -1505,59 +1618,114 @@ void UpdateCCT(pid_t pid, CPUCallStackSampler::CallStack &callStack,
   }
 
   if (flag) {
-    DEBUG_LOG("new samples to insert\n");
+    if (verbose)
+      DEBUG_LOG("new samples to insert\n");
     for (int j = i; j >= 0; --j) {
-      if (callStack.fnames[j].length() == 0 ||
-          HasExcludePatterns(callStack.fnames[j])) {
+      const PCSymbol &symbol = callStack.symbols[j];
+      if (symbol.excluded) {
         break;
       }
-      std::string funcName = callStack.fnames[j];
       uint64_t pc = callStack.pcs[j];
-      CPUCCTNode *newNode = new CPUCCTNode();
-      newNode->funcName = funcName;
+      CPUCCTNode *newNode = cpuCCT->newNode();
+      // the tree is full, the samples stay with the deepest node
+      if (!newNode)
+        break;
+      newNode->funcNameId.store(symbol.funcNameId, std::memory_order_release);
       newNode->pc = pc;
-      newNode->offset = 0;
-      if (funcName.find("_PyEval_EvalFrameDefault") == std::string::npos) {
+      newNode->offset = symbol.offset;
+      if (!Classifier::IsInterpreterFrame(pc)) {
         newNode->nodeType = CCTNODE_TYPE_CXX;
       } else {
         // this is a potential py node
         newNode->nodeType = CCTNODE_TYPE_C2P;
       }
-      g_CPUCCTNodeIdMutex.lock();
-      newNode->id = g_CPUCCTNodeId;
-      ++g_CPUCCTNodeId;
-      g_CPUCCTNodeIdMutex.unlock();
+      newNode->id = CPUCCTNodeIdAllocator::NextId();
+      // a new node counts one sample, the others were aggregated with it
+      newNode->addSamples(count - 1);
 
       if (verbose)
-        DEBUG_LOG("[pid=%d] new cpu sample: %s:%lx\n", pid, funcName.c_str(),
-                  pc);
+        DEBUG_LOG("[pid=%d] new cpu sample: %s:%lx\n", pid,
+                  GetSymbol(symbol.funcNameId).c_str(), pc);
       cpuCCT->insertNode(parentNode, newNode);
       parentNode = newNode;
     }
+    cpuCCT->endPath(parentNode);
+  }
+}
+
+template <typename Classifier> UnwindingFuncs MakeUnwindingFuncs() {
+  UnwindingFuncs funcs;
+  funcs.captureCallStack = CaptureCallStack<Classifier>;
+  if (GetProfilerConf()->deferSymbolization)
+    funcs.generateCallStacks = GenerateCallStacks<Classifier, true>;
+  else
+    funcs.generateCallStacks = GenerateCallStacks<Classifier, false>;
+  funcs.updateCCT = UpdateCCT<Classifier>;
+  return funcs;
+}
+
+// Specialize unwinding for the frame classifier of the backend.
+void SelectFrameClassifier() {
+  switch (GetFrameClassifierKind(GetProfilerConf()->backEnd)) {
+  case FRAME_CLASSIFIER_TORCH:
+    g_unwindingFuncs = MakeUnwindingFuncs<TorchFrameClassifier>();
+    break;
+  case FRAME_CLASSIFIER_TF:
+    g_unwindingFuncs = MakeUnwindingFuncs<TFFrameClassifier>();
+    break;
+  default:
+    g_unwindingFuncs = MakeUnwindingFuncs<CxxFrameClassifier>();
+    break;
   }
 }
 
 // Done by the newly launched thread, not application threads.
 void CollectCPUSamplerData() {
+  RegisterProfilerThread();
+  uint32_t pid = getpid();
+  // reused across rounds, the samples of all ready threads
+  std::vector<CPUCallStackSampler::CallStack> callStacks;
+  CPUSampleAggregator aggregator(GetProfilerConf()->cpuSampleAggregationMs);
+  bool verbose = GetProfilerConf()->backTraceVerbose;
+  CPUSampleAggregator::ApplyFunc apply =
+      [verbose](pid_t tid, CPUCallStackSampler::CallStack &callStack,
+                uint64_t count) {
+        g_unwindingFuncs.updateCCT(tid, callStack, count, verbose);
+      };
   while (g_cpuSamplerCollection->IsRunning()) {
-    auto tid2CallStack = g_cpuSamplerCollection->CollectData();
-    for (auto itr : tid2CallStack) {
-      auto pid = itr.first;
-      auto callStack = itr.second;
-      UpdateCCT(pid, callStack, true);
+    g_cpuSamplerCollection->CollectData(callStacks);
+    for (auto &callStack : callStacks) {
+      // per-cpu samplers are inherited by the threads of the profiler and
+      // by forked processes
+      if (callStack.pid != pid || IsProfilerThread(callStack.tid))
+        continue;
+      aggregator.add(callStack);
     }
+    if (aggregator.due())
+      aggregator.flush(apply);
   }
-  DEBUG_LOG("cpu sampler not running, stop collecting cpu pc data\n");
+  // the CCT is complete once the thread is joined
+  aggregator.flush(apply);
+  DEBUG_LOG("cpu sampler not running, stop collecting cpu pc data, "
+            "samples: %lu, distinct stacks: %lu\n",
+            aggregator.getSamples(), aggregator.getStacks());
 }
 
 class GPUProfilingServiceImpl final : public GPUProfilingService::Service {
   Status PerformGPUProfiling(ServerContext *context,
                              const GPUProfilingRequest *request,
                              GPUProfilingResponse *reply) override {
+    RegisterProfilerThread();
     auto rpcTimer = Timer::GetGlobalTimer("rpc");
     rpcTimer->start();
     DEBUG_LOG("pc sampling request received, duration=%u\n",
               request->duration());
+    // epochs are 32-bit, a larger one is not from a previous response
+    if (request->sinceepoch() > UINT32_MAX) {
+      DEBUG_LOG("invalid sinceEpoch: %lu\n", request->sinceepoch());
+      return Status(grpc::StatusCode::INVALID_ARGUMENT,
+                    "sinceEpoch is not an epoch of a previous response");
+    }
 
     // erasing exited threads
     std::vector<pthread_t> toEraseTids;
@@ -1585,6 +1753,10 @@ class GPUProfilingServiceImpl final : public GPUProfilingService::Service {
       }
     }
 
+    // python frames of the main thread are tracked while sampling
+    if (GetProfilerConf()->doPyUnwinding)
+      MainPyStack::GetMainPyStack()->startTracking();
+
     if (GetProfilerConf()->noSampling) {
       g_tracingStarted = true;
     } else {
@@ -1626,6 +1798,7 @@ class GPUProfilingServiceImpl final : public GPUProfilingService::Service {
       std::cout << "Duration should be a positive number (larger than 1000 "
                    "recommended)"
                 << std::endl;
+      MainPyStack::GetMainPyStack()->stopTracking();
       return Status::CANCELLED;
     }
 
@@ -1633,6 +1806,7 @@ class GPUProfilingServiceImpl final : public GPUProfilingService::Service {
     if (GetProfilerConf()->enableCPUSampling) {
       g_cpuSamplerCollection->DisableSampling();
     }
+    MainPyStack::GetMainPyStack()->stopTracking();
 
     if (GetProfilerConf()->noSampling) {
       g_tracingStarted = false;
@@ -1660,7 +1834,8 @@ class GPUProfilingServiceImpl final : public GPUProfilingService::Service {
       }
     }
 
-    CopyCPUCCT2ProtoCPUCCTV2(reply);
+    CopyCPUCCT2ProtoCPUCCTV2(reply, (uint32_t)request->sinceepoch(),
+                             request->inlinefuncnames());
     reply->set_message("pc sampling completed");
     rpcTimer->stop();
     DEBUG_LOG("requested duration=%lf, actual processing duration=%lf\n",
@@ -1672,12 +1847,41 @@ class GPUProfilingServiceImpl final : public GPUProfilingService::Service {
     Timer *getProcTimer = Timer::GetGlobalTimer("unwinding_get_proc_name");
     DEBUG_LOG("unwind get proc timer: %lf\n",
               getProcTimer->getAccumulatedTime());
+    DEBUG_LOG("cct nodes dropped: %lu, symbols dropped: %lu\n",
+              CPUCCTNodeArena::GetDroppedNodes(),
+              SymbolTable::GetSymbolTable()->getDropped());
+    PCSymbolCache *pcSymbolCache = PCSymbolCache::GetPCSymbolCache();
+    DEBUG_LOG("pc symbol cache hits: %lu, misses: %lu, hit rate: %lf, "
+              "uncached: %lu\n",
+              pcSymbolCache->getHits(), pcSymbolCache->getMisses(),
+              pcSymbolCache->getHitRate(), pcSymbolCache->getUncached());
+    PyFrameCache *pyFrameCache = PyFrameCache::GetPyFrameCache();
+    DEBUG_LOG("py frame cache hits: %lu, misses: %lu, uncached: %lu\n",
+              pyFrameCache->getHits(), pyFrameCache->getMisses(),
+              pyFrameCache->getUncached());
+    PySourceCache *pySourceCache = PySourceCache::GetPySourceCache();
+    DEBUG_LOG("py source cache hits: %lu, misses: %lu, reloads: %lu\n",
+              pySourceCache->getHits(), pySourceCache->getMisses(),
+              pySourceCache->getReloads());
+    DEBUG_LOG("stack cache hits: %lu, misses: %lu, false hits: %lu, "
+              "evictions: %lu\n",
+              StackSignatureCache::GetHits(), StackSignatureCache::GetMisses(),
+              StackSignatureCache::GetFalseHits(),
+              StackSignatureCache::GetEvictions());
+    if (GetProfilerConf()->asyncCCTBuild) {
+      CCTBuilder *cctBuilder = CCTBuilder::GetCCTBuilder();
+      DEBUG_LOG("cct builder pushed: %lu, dropped: %lu, built: %lu, "
+                "unresolved: %lu\n",
+                cctBuilder->getPushed(), cctBuilder->getDropped(),
+                cctBuilder->getBuilt(), cctBuilder->getUnresolved());
+    }
 
     return Status::OK;
   }
 };
 
 void RunServer() {
+  RegisterProfilerThread();
   std::string server_address("0.0.0.0:8886");
   ServerBuilder builder;
   GPUProfilingServiceImpl service;
@@ -1700,6 +1904,15 @@ extern "C" int InitializeInjection(void) {
     DEBUG_LOG("... Initialize injection ...\n");
 
     g_cpuSamplerCollection = new CPUCallStackSamplerCollection();
+    if (GetProfilerConf()->enableCPUSampling &&
+        GetProfilerConf()->cpuSamplingPerCPU &&
+        !g_cpuSamplerCollection->RegisterProcess()) {
+      std::cout << "WARNING: per-cpu sampling not available, sampling the "
+                   "threads launching kernels"
+                << std::endl;
+      GetProfilerConf()->cpuSamplingPerCPU = false;
+    }
+    SelectFrameClassifier();
 
     g_circularBuffer.resize(GetProfilerConf()->circularbufCount);
     g_bufferEmptyTrackerArray.resize(GetProfilerConf()->circularbufCount,
@@ -1712,6 +1925,9 @@ extern "C" int InitializeInjection(void) {
     // Subscribe for all domains
     CUPTI_CALL(cuptiEnableAllDomains(1, subscriber));
 
+    if (GetProfilerConf()->asyncCCTBuild)
+      CCTBuilder::GetCCTBuilder()->start(BuildLaunchCallStack);
+
     g_initializedInjection = true;
   }
 
@@ -1735,6 +1951,12 @@ extern "C" int InitializeInjection(void) {
 
   DEBUG_LOG("main thread pid=%u\n", (uint32_t)getpid());
   GetProfilerConf()->mainThreadTid = pthread_self();
+  if (GetProfilerConf()->doPyUnwinding) {
+    // without rpc, samples are taken from here on until exit
+    if (GetProfilerConf()->noRPC)
+      MainPyStack::GetMainPyStack()->startTracking();
+    MainPyStack::GetMainPyStack()->reinstallIfMainThread();
+  }
 
   registerAtExitHandler();
   g_initializeInjectionMutex.unlock();
@@ -7,6 +7,7 @@
 #include <memory>
 #include <string>
 #include <vector>
+#include <atomic>
 #include <thread>
 #include <iostream>
 #include <algorithm>
@@ -37,8 +38,21 @@
 
 #include "utils.h"
 #include "cpu_sampler.h"
+#include "cpu_sample_aggregator.h"
 #include "tools/tools.h"
 #include "calling_ctx_tree.h"
+#include "cct_builder.h"
+#include "cct_merger.h"
+#include "cct_pruner.h"
+#include "elf_symbolizer.h"
+#include "frame_classifier.h"
+#include "main_py_stack.h"
+#include "module_filter.h"
+#include "pc_symbol_cache.h"
+#include "py_frame_cache.h"
+#include "py_source_cache.h"
+#include "stack_signature_cache.h"
+#include "unwinder.h"
 #include "./cpp-gen/gpu_profiling.grpc.pb.h"
 
 using namespace CUPTI::PcSamplingUtil;
@@ -83,19 +97,17 @@ typedef enum {
     CALL_STACK_NOT_HAS_PY = 2
 } CallStackStatus;
 
-typedef enum {
-    // OP nodes
-    CRITICAL_TYPE_TORCH_OP = 1,
-    CRITICAL_TYPE_TF_OP = 2,
-    // Leaf nodes
-    CRITICAL_TYPE_LEAF = 3,
-    // Py nodes
-    CRITICAL_TYPE_PY_FORWARD = 4,
-    CRITICAL_TYPE_PY_BACKWARD = 5,
-    CRITICAL_TYPE_PY_LOSS = 6,
-    // Not critical
-    NOT_CRITICAL_NODE = 0x7fffffff
-} CriticalNodeType;
+// Unwinding functions instantiated for the frame classifier of the backend,
+// selected at InitializeInjection.
+typedef struct unwindingfuncs {
+    void (*captureCallStack)(RawCallStack &stack);
+    CallStackStatus (*generateCallStacks)(const RawCallStack &stack,
+                                          std::stack<UNWValue> &q,
+                                          bool verbose);
+    void (*updateCCT)(pid_t pid, CPUCallStackSampler::CallStack &callStack,
+                      uint64_t count, bool verbose);
+} UnwindingFuncs;
+UnwindingFuncs g_unwindingFuncs;
 
 // For multi-gpu we are preallocating buffers only for first context creation,
 // so preallocated buffer stall reason size will be equal to max stall reason for first context GPU
@@ -137,18 +149,17 @@ bool g_kernelThreadSynced = false;
 pthread_t selectedTid;
 
 // Variables related to cpu cct
-typedef std::unordered_map<pthread_t, CPUCCT*> CCTMAP_t;
-CCTMAP_t g_CPUCCTMap;
+// CCT of the current thread, registered in CPUCCTRegistry
+thread_local CPUCCT *g_threadCPUCCT = nullptr;
 std::mutex g_cpuCallingCtxTreeMutex;
 unw_word_t g_activeCPUPCID;
 std::recursive_mutex g_activeCPUPCIDMutex;
 std::unordered_map<CUpti_PCSamplingPCData*, unw_word_t> g_GPUPCSamplesParentCPUPCIDs;
 std::mutex g_GPUPCSamplesParentCPUPCIDsMutex;
-uint64_t g_CPUCCTNodeId = 1;
-std::mutex g_CPUCCTNodeIdMutex;
-std::unordered_map<uint64_t, uint64_t> g_esp2pcIdMap;
-std::stack<UNWValue> g_callStack;
-bool g_genCallStack = false;
+// ASYNC_CCT_BUILD: the last launch, and the launch of the gpu samples of a
+// buffer, whose parent cpu pc is resolved by the CCT builder
+std::atomic<uint32_t> g_lastLaunchCorId(0);
+std::unordered_map<CUpti_PCSamplingData*, uint32_t> g_GPUPCSamplesCorIds;
 CPUCallStackSamplerCollection* g_cpuSamplerCollection;
 std::thread g_cpuSamplerThreadHandle;
 
@@ -0,0 +1,293 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <pthread.h>
+#include <stack>
+#include <stdint.h>
+#include <vector>
+
+#include <Python.h>
+#include <frameobject.h>
+
+#include "common.h"
+#include "py_frame_cache.h"
+#include "symbol_table.h"
+
+// pcs of python frames without a native frame, above the user address space
+#define PY_FRAME_PC_TAG (1ull << 63)
+
+// Python call stack of the main thread, readable from any thread without
+// the GIL and without interrupting the main thread.
+//
+// The main thread maintains a shadow copy of its python stack from a profile
+// function (PyEval_SetProfile): python calls push a frame, returns pop one,
+// and calls into C update the line of the calling frame, so the copy is
+// exact whenever the main thread runs native code, e.g., while it waits for
+// the threads that launch kernels. Each update is framed by a seqlock, whose
+// sequence number / 2 is the generation of the copy, and readers retry until
+// they copy a consistent generation.
+//
+// The stack is only tracked between startTracking and stopTracking, i.e.,
+// while the profiler samples. Both schedule a pending call (Py_AddPendingCall)
+// that installs or removes the profile function on the main thread at the
+// next point where the interpreter runs pending calls, so no launch waits for
+// the GIL. The profile function set before, e.g., by sys.setprofile or the
+// torch profiler, keeps receiving every event and is restored once tracking
+// stops.
+class MainPyStack {
+public:
+  static const uint32_t kMaxDepth = 256;
+  static const uint32_t kMaxReadRetries = 64;
+
+  MainPyStack()
+      : seq(0), depth(0), installed(false), tracking(false), pending(false),
+        prevFunc(nullptr), prevObj(nullptr) {
+    for (uint32_t i = 0; i < kMaxDepth; ++i) {
+      frames[i].names.store(0, std::memory_order_relaxed);
+      frames[i].lineNumber.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  MainPyStack(const MainPyStack &) = delete;
+  MainPyStack &operator=(const MainPyStack &) = delete;
+
+  static MainPyStack *GetMainPyStack() {
+    static MainPyStack *stack = new MainPyStack();
+    return stack;
+  }
+
+  // called from any thread, the main thread installs the profile function
+  // in a pending call, and removes it in a pending call or on its next python
+  // event after stopTracking
+  void startTracking() {
+    tracking.store(true, std::memory_order_release);
+    schedule();
+  }
+
+  void stopTracking() {
+    tracking.store(false, std::memory_order_release);
+    schedule();
+  }
+
+  // start tracking the stack of the calling thread, which must be the main
+  // thread and hold the GIL, chaining the profile function set before
+  void install() {
+    if (installed)
+      return;
+    PyThreadState *tstate = PyThreadState_Get();
+    prevFunc = tstate->c_profilefunc;
+    prevObj = tstate->c_profileobj;
+    Py_XINCREF(prevObj);
+    std::stack<PyFrameObject *> frameStack;
+    for (PyFrameObject *f = PyEval_GetFrame(); f; f = f->f_back)
+      frameStack.push(f);
+    beginWrite();
+    depth.store(0, std::memory_order_relaxed);
+    for (; !frameStack.empty(); frameStack.pop())
+      push(frameStack.top());
+    endWrite();
+    PyEval_SetProfile(ProfileFunc, nullptr);
+    installed = true;
+  }
+
+  // stop tracking and restore the previous profile function, unless ours
+  // was replaced meanwhile, on the main thread holding the GIL
+  void uninstall() {
+    if (!installed)
+      return;
+    installed = false;
+    if (PyThreadState_Get()->c_profilefunc == ProfileFunc)
+      PyEval_SetProfile(prevFunc, prevObj);
+    Py_XDECREF(prevObj);
+    prevFunc = nullptr;
+    prevObj = nullptr;
+  }
+
+  // called by the main thread without the GIL, e.g., on a launch: schedules
+  // the install again if python was not initialized when tracking started,
+  // or if sys.setprofile replaced the profile function, which then gets
+  // chained
+  void reinstallIfMainThread() {
+    if (!tracking.load(std::memory_order_acquire) || !Py_IsInitialized() ||
+        !pthread_equal(pthread_self(), GetProfilerConf()->mainThreadTid))
+      return;
+    // only the main thread sets its profile function, no GIL needed
+    PyThreadState *tstate = PyGILState_GetThisThreadState();
+    if (!tstate || tstate->c_profilefunc != ProfileFunc)
+      schedule();
+  }
+
+  bool isInstalled() { return installed; }
+
+  // copy the frames of the stack to infos, outermost first, and their number
+  // to n; false if no consistent copy could be read or the stack is not
+  // tracked. infos holds kMaxDepth frames.
+  bool read(PyFrameInfo *infos, uint32_t &n, uint64_t *generation = nullptr) {
+    n = 0;
+    uint64_t seq0 = 0;
+    bool consistent = false;
+    for (uint32_t retry = 0; retry < kMaxReadRetries && !consistent; ++retry) {
+      seq0 = seq.load(std::memory_order_acquire);
+      if (seq0 & 1)
+        continue;
+      n = std::min(depth.load(std::memory_order_relaxed), kMaxDepth);
+      for (uint32_t i = 0; i < n; ++i) {
+        uint64_t names = frames[i].names.load(std::memory_order_relaxed);
+        infos[i].fileNameId = (SymbolId)(names >> 32);
+        infos[i].funcNameId = (SymbolId)names;
+        infos[i].lineNumber =
+            frames[i].lineNumber.load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      consistent = seq.load(std::memory_order_relaxed) == seq0;
+    }
+    if (!consistent || !installed) {
+      n = 0;
+      return false;
+    }
+    if (generation)
+      *generation = seq0 >> 1;
+    return true;
+  }
+
+  bool read(std::vector<PyFrameInfo> &infos, uint64_t *generation = nullptr) {
+    infos.resize(kMaxDepth);
+    uint32_t n = 0;
+    bool ok = read(infos.data(), n, generation);
+    infos.resize(n);
+    return ok;
+  }
+
+  // pc of the CCT node of a frame read from the stack, python frames of the
+  // main thread have no native pc
+  static uint64_t FramePC(const PyFrameInfo &info) {
+    return PY_FRAME_PC_TAG | (uint64_t)info.funcNameId << 24 |
+           (info.fileNameId & 0xffffff);
+  }
+
+  uint64_t getGeneration() { return seq.load(std::memory_order_acquire) >> 1; }
+
+private:
+  struct Frame {
+    // file name id << 32 | function name id
+    std::atomic<uint64_t> names;
+    std::atomic<int> lineNumber;
+  };
+
+  // install or uninstall on the main thread, as pending calls only run there
+  void schedule() {
+    if (!Py_IsInitialized() || pending.exchange(true))
+      return;
+    if (Py_AddPendingCall(PendingUpdate, nullptr) != 0) {
+      pending.store(false);
+      DEBUG_LOG("failed to schedule the main python stack update\n");
+    }
+  }
+
+  static int PendingUpdate(void *) {
+    MainPyStack *stack = GetMainPyStack();
+    stack->pending.store(false);
+    if (!stack->tracking.load(std::memory_order_acquire)) {
+      stack->uninstall();
+      return 0;
+    }
+    // inside a chained python profile function, whose frame returns without
+    // an event, install once it returned
+    PyThreadState *tstate = PyThreadState_Get();
+    if (tstate->tracing) {
+      stack->schedule();
+      return 0;
+    }
+    // a replaced profile function is chained by installing again
+    if (tstate->c_profilefunc != ProfileFunc)
+      stack->uninstall();
+    stack->install();
+    return 0;
+  }
+
+  static int ProfileFunc(PyObject *, PyFrameObject *frame, int what,
+                         PyObject *arg) {
+    MainPyStack *stack = GetMainPyStack();
+    if (!stack->tracking.load(std::memory_order_acquire)) {
+      Py_tracefunc prevFunc = stack->prevFunc;
+      PyObject *prevObj = stack->prevObj;
+      Py_XINCREF(prevObj);
+      stack->uninstall();
+      int res = prevFunc ? prevFunc(prevObj, frame, what, arg) : 0;
+      Py_XDECREF(prevObj);
+      return res;
+    }
+    stack->beginWrite();
+    switch (what) {
+    case PyTrace_CALL:
+      // the caller is paused at its call line
+      if (frame->f_back)
+        stack->update(frame->f_back);
+      stack->push(frame);
+      break;
+    case PyTrace_RETURN:
+      stack->pop();
+      break;
+    case PyTrace_C_CALL:
+      stack->update(frame);
+      break;
+    default:
+      break;
+    }
+    stack->endWrite();
+    if (stack->prevFunc)
+      return stack->prevFunc(stack->prevObj, frame, what, arg);
+    return 0;
+  }
+
+  // only called by the main thread
+  void beginWrite() {
+    seq.store(seq.load(std::memory_order_relaxed) + 1,
+              std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  void endWrite() {
+    seq.store(seq.load(std::memory_order_relaxed) + 1,
+              std::memory_order_release);
+  }
+
+  void store(uint32_t idx, PyFrameObject *frame) {
+    if (idx >= kMaxDepth)
+      return;
+    PyFrameInfo info = PyFrameCache::GetPyFrameCache()->resolve(frame);
+    frames[idx].names.store((uint64_t)info.fileNameId << 32 | info.funcNameId,
+                            std::memory_order_relaxed);
+    frames[idx].lineNumber.store(info.lineNumber, std::memory_order_relaxed);
+  }
+
+  void push(PyFrameObject *frame) {
+    uint32_t d = depth.load(std::memory_order_relaxed);
+    store(d, frame);
+    depth.store(d + 1, std::memory_order_relaxed);
+  }
+
+  void pop() {
+    uint32_t d = depth.load(std::memory_order_relaxed);
+    if (d)
+      depth.store(d - 1, std::memory_order_relaxed);
+  }
+
+  // the innermost frame is executing another line
+  void update(PyFrameObject *frame) {
+    uint32_t d = depth.load(std::memory_order_relaxed);
+    if (d)
+      store(d - 1, frame);
+  }
+
+  std::atomic<uint64_t> seq;
+  std::atomic<uint32_t> depth;
+  Frame frames[kMaxDepth];
+  std::atomic<bool> installed;
+  std::atomic<bool> tracking;
+  // an update is scheduled and has not run yet
+  std::atomic<bool> pending;
+  // profile function replaced by ours, only used by the main thread
+  Py_tracefunc prevFunc;
+  PyObject *prevObj;
+};
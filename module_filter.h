@@ -0,0 +1,227 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <link.h>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+// Address ranges of the loaded objects whose frames are left out of call
+// stacks, by default libcupti, libcuda and the profiler library itself, so
+// that a frame is dropped by a binary search on its pc before it is
+// symbolized. An object is excluded if its path contains one of the patterns.
+//
+// The ranges are the PT_LOAD segments listed by dl_iterate_phdr and the
+// executable file mappings of /proc/self/maps, for objects mapped without
+// the loader. They form an immutable snapshot that is replaced by refresh().
+// A pc outside every known range refreshes the snapshot if objects were
+// loaded or unloaded since it was taken (dlopen and dlclose bump counters of
+// the loader), so the frames of objects opened later are filtered as well.
+class ModuleFilter {
+public:
+  // excludeSelf excludes the object of the profiler, unless it is the
+  // executable, e.g., in tests
+  ModuleFilter(const std::vector<std::string> &_patterns, bool _excludeSelf)
+      : patterns(_patterns), excludeSelf(_excludeSelf), snapshot(nullptr),
+        refreshes(0) {
+    refresh();
+  }
+
+  ~ModuleFilter() {
+    for (Snapshot *s : retiredSnapshots)
+      delete s;
+    delete snapshot.load(std::memory_order_relaxed);
+  }
+
+  ModuleFilter(const ModuleFilter &) = delete;
+  ModuleFilter &operator=(const ModuleFilter &) = delete;
+
+  static ModuleFilter *GetModuleFilter() {
+    static ModuleFilter *filter =
+        new ModuleFilter(SplitPatterns(GetProfilerConf()->excludeModules),
+                         GetProfilerConf()->excludeProfilerModule);
+    return filter;
+  }
+
+  // comma-separated patterns, empty ones are ignored
+  static std::vector<std::string> SplitPatterns(const std::string &list) {
+    std::vector<std::string> patterns;
+    size_t begin = 0;
+    while (begin <= list.size()) {
+      size_t end = list.find(',', begin);
+      if (end == std::string::npos)
+        end = list.size();
+      if (end > begin)
+        patterns.push_back(list.substr(begin, end - begin));
+      begin = end + 1;
+    }
+    return patterns;
+  }
+
+  // pc is in an excluded object
+  bool isExcluded(uint64_t pc) {
+    Snapshot *s = snapshot.load(std::memory_order_acquire);
+    if (Contains(s->excluded, pc))
+      return true;
+    if (Contains(s->known, pc))
+      return false;
+    uint64_t adds, subs;
+    LoaderCounters(adds, subs);
+    if (adds == s->adds && subs == s->subs)
+      return false;
+    refresh();
+    return Contains(snapshot.load(std::memory_order_acquire)->excluded, pc);
+  }
+
+  // take the ranges of the objects loaded now
+  void refresh() {
+    std::lock_guard<std::mutex> lock(refreshMutex);
+    Snapshot *s = new Snapshot();
+    LoaderCounters(s->adds, s->subs);
+    CollectContext context = {this, s, 0};
+    dl_iterate_phdr(CollectModule, &context);
+    collectMappings(s);
+    Merge(s->known);
+    Merge(s->excluded);
+    Snapshot *old = snapshot.load(std::memory_order_relaxed);
+    snapshot.store(s, std::memory_order_release);
+    // readers may still hold the old snapshot
+    if (old)
+      retiredSnapshots.push_back(old);
+    refreshes.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  size_t getNumExcludedRanges() {
+    return snapshot.load(std::memory_order_acquire)->excluded.size();
+  }
+
+  uint64_t getRefreshes() { return refreshes.load(std::memory_order_relaxed); }
+
+  // objects loaded and unloaded by the loader so far
+  static void LoaderCounters(uint64_t &adds, uint64_t &subs) {
+    uint64_t counters[2] = {0, 0};
+    dl_iterate_phdr(ReadCounters, counters);
+    adds = counters[0];
+    subs = counters[1];
+  }
+
+private:
+  static int ReadCounters(struct dl_phdr_info *info, size_t, void *data) {
+    uint64_t *counters = (uint64_t *)data;
+    counters[0] = info->dlpi_adds;
+    counters[1] = info->dlpi_subs;
+    // the counters are the same for every object
+    return 1;
+  }
+
+  struct Range {
+    uint64_t begin, end;
+  };
+
+  struct Snapshot {
+    // sorted, disjoint
+    std::vector<Range> known;
+    std::vector<Range> excluded;
+    // objects loaded and unloaded before the snapshot
+    uint64_t adds, subs;
+  };
+
+  struct CollectContext {
+    ModuleFilter *filter;
+    Snapshot *snapshot;
+    uint32_t index;
+  };
+
+  static int CollectModule(struct dl_phdr_info *info, size_t, void *data) {
+    CollectContext *context = (CollectContext *)data;
+    std::vector<Range> segments;
+    bool self = false;
+    uint64_t marker = (uint64_t)&CollectModule;
+    for (int i = 0; i < info->dlpi_phnum; ++i) {
+      const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+      if (phdr.p_type != PT_LOAD)
+        continue;
+      uint64_t begin = info->dlpi_addr + phdr.p_vaddr;
+      uint64_t end = begin + phdr.p_memsz;
+      segments.push_back({begin, end});
+      self = self || (marker >= begin && marker < end);
+    }
+    // the executable is listed first
+    bool excluded =
+        (self && context->filter->excludeSelf && context->index > 0) ||
+        context->filter->matches(info->dlpi_name ? info->dlpi_name : "");
+    Snapshot *s = context->snapshot;
+    s->known.insert(s->known.end(), segments.begin(), segments.end());
+    if (excluded)
+      s->excluded.insert(s->excluded.end(), segments.begin(), segments.end());
+    ++context->index;
+    return 0;
+  }
+
+  // executable mappings of files
+  void collectMappings(Snapshot *s) {
+    FILE *maps = fopen("/proc/self/maps", "r");
+    if (!maps)
+      return;
+    char line[4096];
+    while (fgets(line, sizeof(line), maps)) {
+      unsigned long begin, end;
+      char perms[8];
+      int pathOffset = 0;
+      if (sscanf(line, "%lx-%lx %7s %*s %*s %*s %n", &begin, &end, perms,
+                 &pathOffset) < 3 ||
+          !strchr(perms, 'x') || !pathOffset || line[pathOffset] != '/')
+        continue;
+      std::string path = line + pathOffset;
+      if (!path.empty() && path.back() == '\n')
+        path.pop_back();
+      s->known.push_back({begin, end});
+      if (matches(path))
+        s->excluded.push_back({begin, end});
+    }
+    fclose(maps);
+  }
+
+  bool matches(const std::string &path) {
+    for (auto &pattern : patterns) {
+      if (path.find(pattern) != std::string::npos)
+        return true;
+    }
+    return false;
+  }
+
+  static void Merge(std::vector<Range> &ranges) {
+    std::sort(ranges.begin(), ranges.end(),
+              [](const Range &a, const Range &b) { return a.begin < b.begin; });
+    size_t n = 0;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+      if (n && ranges[i].begin <= ranges[n - 1].end)
+        ranges[n - 1].end = std::max(ranges[n - 1].end, ranges[i].end);
+      else
+        ranges[n++] = ranges[i];
+    }
+    ranges.resize(n);
+  }
+
+  static bool Contains(const std::vector<Range> &ranges, uint64_t pc) {
+    auto itr = std::upper_bound(
+        ranges.begin(), ranges.end(), pc,
+        [](uint64_t a, const Range &r) { return a < r.begin; });
+    if (itr == ranges.begin())
+      return false;
+    --itr;
+    return pc < itr->end;
+  }
+
+  std::vector<std::string> patterns;
+  bool excludeSelf;
+  std::atomic<Snapshot *> snapshot;
+  std::mutex refreshMutex;
+  std::vector<Snapshot *> retiredSnapshots;
+  std::atomic<uint64_t> refreshes;
+};
@@ -0,0 +1,150 @@
+#pragma once
+#include <atomic>
+
+#include "common.h"
+#include "symbol_table.h"
+
+// Symbol of a native frame: the demangled name of its function, interned, and
+// the offset of the pc in the function.
+struct PCSymbol {
+  SymbolId funcNameId;
+  uint64_t offset;
+  // a frame of an excluded object (see ModuleFilter), skipped by unwinding
+  bool excluded;
+  // a frame of the python interpreter loop
+  bool pyEval;
+};
+
+// Process-wide cache from the pc of a native frame to its PCSymbol, so that a
+// call path seen before is symbolized without reading symbol tables and
+// demangling.
+//
+// The cache is a fixed-size open-addressing table. A slot is claimed with a
+// CAS on its pc and its symbol is published afterwards with a release store,
+// so lookups and insertions never lock. Entries are never evicted: a pc that
+// finds no free slot within kMaxProbes is left uncached.
+class PCSymbolCache {
+public:
+  static const uint32_t kMaxProbes = 16;
+
+  // capacity is rounded up to a power of 2, 0 disables the cache
+  explicit PCSymbolCache(uint64_t capacity)
+      : nSlots(0), slots(nullptr), hits(0), misses(0), uncached(0) {
+    if (capacity) {
+      nSlots = 1;
+      while (nSlots < capacity)
+        nSlots <<= 1;
+      slots = new Slot[nSlots];
+      for (uint64_t i = 0; i < nSlots; ++i) {
+        slots[i].pc.store(0, std::memory_order_relaxed);
+        slots[i].value.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  ~PCSymbolCache() { delete[] slots; }
+
+  PCSymbolCache(const PCSymbolCache &) = delete;
+  PCSymbolCache &operator=(const PCSymbolCache &) = delete;
+
+  static PCSymbolCache *GetPCSymbolCache() {
+    static PCSymbolCache *cache =
+        new PCSymbolCache(GetProfilerConf()->pcSymbolCacheSize);
+    return cache;
+  }
+
+  bool lookup(uint64_t pc, PCSymbol &symbol) {
+    for (uint32_t i = 0; nSlots && pc && i < kMaxProbes; ++i) {
+      Slot &slot = slots[(hash(pc) + i) & (nSlots - 1)];
+      uint64_t slotPC = slot.pc.load(std::memory_order_relaxed);
+      if (slotPC == pc) {
+        uint64_t value = slot.value.load(std::memory_order_acquire);
+        if (!(value & kReady))
+          break;
+        symbol.funcNameId = (SymbolId)value;
+        symbol.offset = (value >> 32) & kMaxOffset;
+        symbol.excluded = value & kExcluded;
+        symbol.pyEval = value & kPyEval;
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+      if (slotPC == 0)
+        break;
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  // pc has a slot, published or being inserted, not counted as a lookup
+  bool contains(uint64_t pc) {
+    for (uint32_t i = 0; nSlots && pc && i < kMaxProbes; ++i) {
+      Slot &slot = slots[(hash(pc) + i) & (nSlots - 1)];
+      uint64_t slotPC = slot.pc.load(std::memory_order_relaxed);
+      if (slotPC == pc)
+        return true;
+      if (slotPC == 0)
+        break;
+    }
+    return false;
+  }
+
+  void insert(uint64_t pc, const PCSymbol &symbol) {
+    if (!nSlots || !pc || symbol.offset > kMaxOffset)
+      return;
+    uint64_t value = kReady | symbol.offset << 32 | symbol.funcNameId;
+    if (symbol.excluded)
+      value |= kExcluded;
+    if (symbol.pyEval)
+      value |= kPyEval;
+    for (uint32_t i = 0; i < kMaxProbes; ++i) {
+      Slot &slot = slots[(hash(pc) + i) & (nSlots - 1)];
+      uint64_t slotPC = 0;
+      if (slot.pc.compare_exchange_strong(slotPC, pc,
+                                          std::memory_order_relaxed)) {
+        slot.value.store(value, std::memory_order_release);
+        return;
+      }
+      // another thread is inserting the same pc
+      if (slotPC == pc)
+        return;
+    }
+    uncached.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint64_t getHits() { return hits.load(std::memory_order_relaxed); }
+
+  uint64_t getMisses() { return misses.load(std::memory_order_relaxed); }
+
+  double getHitRate() {
+    uint64_t nHits = getHits(), nLookups = nHits + getMisses();
+    return nLookups ? (double)nHits / nLookups : 0;
+  }
+
+  // pcs left out of a full table
+  uint64_t getUncached() { return uncached.load(std::memory_order_relaxed); }
+
+private:
+  // value: ready | pyEval | excluded | 29 bits of offset | 32 bits of name id
+  static const uint64_t kReady = 1ull << 63;
+  static const uint64_t kPyEval = 1ull << 62;
+  static const uint64_t kExcluded = 1ull << 61;
+  static const uint64_t kMaxOffset = (1ull << 29) - 1;
+
+  struct Slot {
+    std::atomic<uint64_t> pc;
+    std::atomic<uint64_t> value;
+  };
+
+  static uint64_t hash(uint64_t pc) {
+    pc ^= pc >> 33;
+    pc *= 0xff51afd7ed558ccdull;
+    pc ^= pc >> 33;
+    return pc;
+  }
+
+  uint64_t nSlots;
+  Slot *slots;
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> misses;
+  std::atomic<uint64_t> uncached;
+};
@@ -0,0 +1,168 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+#include <Python.h>
+#include <frameobject.h>
+
+#include "common.h"
+#include "py_source_cache.h"
+#include "symbol_table.h"
+
+// Names of a python frame, as used by python CCT nodes.
+struct PyFrameInfo {
+  SymbolId fileNameId;
+  // "<function name>::<source line>"
+  SymbolId funcNameId;
+  int lineNumber;
+};
+
+// Process-wide cache from (code object, line) to the PyFrameInfo of the
+// frames executing that line, so that a python frame seen before costs
+// PyFrame_GetLineNumber and one lookup, without encoding or building names.
+//
+// Same layout as PCSymbolCache: a fixed-size open-addressing table whose
+// slots are claimed by CAS on the key and published with a release store,
+// so lookups never block. resolve interns names and reads source files on a
+// miss, so it is not async-signal-safe. A cached code object is pinned with
+// a reference, so its address is never reused by another code object while
+// it is a key. Source lines are read once per key, a code object is compiled
+// from one version of its file.
+class PyFrameCache {
+public:
+  static const uint32_t kMaxProbes = 16;
+  // lines from this one on are not cached
+  static const int kMaxLine = 1 << 16;
+
+  // capacity is rounded up to a power of 2
+  explicit PyFrameCache(uint64_t capacity)
+      : nSlots(1), hits(0), misses(0), uncached(0) {
+    while (nSlots < capacity)
+      nSlots <<= 1;
+    slots = new Slot[nSlots];
+    for (uint64_t i = 0; i < nSlots; ++i) {
+      slots[i].key.store(0, std::memory_order_relaxed);
+      slots[i].value.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  ~PyFrameCache() { delete[] slots; }
+
+  PyFrameCache(const PyFrameCache &) = delete;
+  PyFrameCache &operator=(const PyFrameCache &) = delete;
+
+  static PyFrameCache *GetPyFrameCache() {
+    static PyFrameCache *cache =
+        new PyFrameCache(GetProfilerConf()->pyFrameCacheSize);
+    return cache;
+  }
+
+  // called by the thread running frame, never from a signal handler
+  PyFrameInfo resolve(PyFrameObject *frame) {
+    PyCodeObject *code = frame->f_code;
+    int lineNumber = PyFrame_GetLineNumber(frame);
+    uint64_t key = MakeKey(code, lineNumber);
+    PyFrameInfo info;
+    info.lineNumber = lineNumber;
+    if (key && lookup(key, info)) {
+      hits.fetch_add(1, std::memory_order_relaxed);
+      return info;
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    std::string fileName = PyStr2Str(code->co_filename);
+    std::string funcName = PyStr2Str(code->co_name);
+    info.fileNameId = InternSymbol(fileName);
+    info.funcNameId =
+        InternSymbol(funcName + "::" + GetPyLine(fileName, lineNumber));
+    if (!key)
+      uncached.fetch_add(1, std::memory_order_relaxed);
+    else if (insert(key, info))
+      Py_INCREF(code);
+    return info;
+  }
+
+  uint64_t getHits() { return hits.load(std::memory_order_relaxed); }
+
+  uint64_t getMisses() { return misses.load(std::memory_order_relaxed); }
+
+  // frames left out of a full table or with a large line number
+  uint64_t getUncached() { return uncached.load(std::memory_order_relaxed); }
+
+private:
+  // value: ready | 31 bits of file name id | 32 bits of function name id
+  static const uint64_t kReady = 1ull << 63;
+
+  struct Slot {
+    std::atomic<uint64_t> key;
+    std::atomic<uint64_t> value;
+  };
+
+  // user space addresses fit in 47 bits, 0 if the frame is not cacheable
+  static uint64_t MakeKey(PyCodeObject *code, int lineNumber) {
+    if (lineNumber < 0 || lineNumber >= kMaxLine)
+      return 0;
+    return (uint64_t)code << 16 | (uint64_t)lineNumber;
+  }
+
+  static uint64_t Hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return key;
+  }
+
+  static std::string PyStr2Str(PyObject *obj) {
+    // the utf-8 form is cached in the object, nothing to release
+    const char *str = PyUnicode_AsUTF8(obj);
+    if (!str) {
+      PyErr_Clear();
+      return "";
+    }
+    return str;
+  }
+
+  bool lookup(uint64_t key, PyFrameInfo &info) {
+    for (uint32_t i = 0; i < kMaxProbes; ++i) {
+      Slot &slot = slots[(Hash(key) + i) & (nSlots - 1)];
+      uint64_t slotKey = slot.key.load(std::memory_order_relaxed);
+      if (slotKey == key) {
+        uint64_t value = slot.value.load(std::memory_order_acquire);
+        if (!(value & kReady))
+          return false;
+        info.fileNameId = (SymbolId)((value & ~kReady) >> 32);
+        info.funcNameId = (SymbolId)value;
+        return true;
+      }
+      if (slotKey == 0)
+        return false;
+    }
+    return false;
+  }
+
+  // true if this call added the key, which then holds a reference
+  bool insert(uint64_t key, const PyFrameInfo &info) {
+    uint64_t value =
+        kReady | (uint64_t)info.fileNameId << 32 | info.funcNameId;
+    for (uint32_t i = 0; i < kMaxProbes; ++i) {
+      Slot &slot = slots[(Hash(key) + i) & (nSlots - 1)];
+      uint64_t slotKey = 0;
+      if (slot.key.compare_exchange_strong(slotKey, key,
+                                           std::memory_order_relaxed)) {
+        slot.value.store(value, std::memory_order_release);
+        return true;
+      }
+      // another thread is inserting the same key
+      if (slotKey == key)
+        return false;
+    }
+    uncached.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  uint64_t nSlots;
+  Slot *slots;
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> misses;
+  std::atomic<uint64_t> uncached;
+};
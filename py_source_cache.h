@@ -0,0 +1,199 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <mutex>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "symbol_table.h"
+
+// Serves the source lines of python frames, as used in the names of python
+// CCT nodes. Every source file is read once into memory and indexed by line
+// offsets the first time a line of it is asked for, and every asked line is
+// interned with its spaces removed, so repeated frames only cost a hash
+// lookup. Files are copied rather than mapped, a file truncated in place
+// would fault on the pages of a mapping past its new end.
+//
+// A file is read again when its mtime, size or inode changes. Its status
+// is checked at most once per statIntervalNs, so edits show up with a delay.
+class PySourceCache {
+public:
+  static const uint32_t kNumShards = 16;
+
+  explicit PySourceCache(uint64_t _statIntervalNs)
+      : statIntervalNs(_statIntervalNs), hits(0), misses(0), reloads(0){};
+
+  ~PySourceCache() {
+    for (Shard &shard : shards) {
+      for (auto &itr : shard.files)
+        delete itr.second;
+    }
+  }
+
+  PySourceCache(const PySourceCache &) = delete;
+  PySourceCache &operator=(const PySourceCache &) = delete;
+
+  static PySourceCache *GetPySourceCache() {
+    static PySourceCache *cache = new PySourceCache(1000000000);
+    return cache;
+  }
+
+  // line lineNumber (from 1) of fileName without spaces, EMPTY_SYMBOL_ID if
+  // there is no such file or line; lines before the first are the first
+  SymbolId getLine(const std::string &fileName, int lineNumber) {
+    lineNumber = std::max(lineNumber, 1);
+    Shard &shard = shards[std::hash<std::string>()(fileName) % kNumShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    SourceFile *&file = shard.files[fileName];
+    if (!file) {
+      file = new SourceFile();
+      load(fileName, file);
+    } else {
+      refresh(fileName, file);
+    }
+
+    auto itr = file->lines.find(lineNumber);
+    if (itr != file->lines.end()) {
+      hits.fetch_add(1, std::memory_order_relaxed);
+      return itr->second;
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    SymbolId lineId = EMPTY_SYMBOL_ID;
+    if (!file->data.empty()) {
+      if (file->lineOffsets.empty())
+        indexLines(file);
+      if ((size_t)lineNumber < file->lineOffsets.size()) {
+        const char *base = file->data.data();
+        const char *begin = base + file->lineOffsets[lineNumber - 1];
+        const char *end = base + file->lineOffsets[lineNumber];
+        // the index ends past the last byte, a line may end with its '\n'
+        if (end > begin && end[-1] == '\n')
+          --end;
+        std::string line;
+        line.reserve(end - begin);
+        for (const char *c = begin; c < end; ++c) {
+          if (*c != ' ')
+            line.push_back(*c);
+        }
+        lineId = InternSymbol(line);
+      }
+    }
+    file->lines[lineNumber] = lineId;
+    return lineId;
+  }
+
+  uint64_t getHits() { return hits.load(std::memory_order_relaxed); }
+
+  uint64_t getMisses() { return misses.load(std::memory_order_relaxed); }
+
+  // files read again after a change
+  uint64_t getReloads() { return reloads.load(std::memory_order_relaxed); }
+
+private:
+  struct SourceFile {
+    std::string data;
+    // size of the file when it was read
+    size_t size = 0;
+    struct timespec mtime = {0, 0};
+    ino_t inode = 0;
+    bool exists = false;
+    uint64_t lastStatNs = 0;
+    // offsets of the line starts, and the file size as the last entry
+    std::vector<size_t> lineOffsets;
+    std::unordered_map<int, SymbolId> lines;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<std::string, SourceFile *> files;
+  };
+
+  static uint64_t NowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  }
+
+  void load(const std::string &fileName, SourceFile *file) {
+    file->lastStatNs = NowNs();
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      file->exists = true;
+      file->mtime = st.st_mtim;
+      file->inode = st.st_ino;
+      file->size = st.st_size;
+      // the file may change size while it is read, what was read is kept
+      // until the next refresh sees the new size
+      file->data.resize(st.st_size);
+      size_t n = 0;
+      while (n < file->data.size()) {
+        ssize_t ret = read(fd, &file->data[n], file->data.size() - n);
+        if (ret < 0 && errno == EINTR)
+          continue;
+        if (ret <= 0)
+          break;
+        n += ret;
+      }
+      file->data.resize(n);
+    }
+    close(fd);
+  }
+
+  void refresh(const std::string &fileName, SourceFile *file) {
+    uint64_t now = NowNs();
+    if (now - file->lastStatNs < statIntervalNs)
+      return;
+    file->lastStatNs = now;
+    struct stat st;
+    bool exists = stat(fileName.c_str(), &st) == 0;
+    if (exists == file->exists &&
+        (!exists || (st.st_mtim.tv_sec == file->mtime.tv_sec &&
+                     st.st_mtim.tv_nsec == file->mtime.tv_nsec &&
+                     (size_t)st.st_size == file->size &&
+                     st.st_ino == file->inode)))
+      return;
+    file->data.clear();
+    file->size = 0;
+    file->exists = false;
+    file->lineOffsets.clear();
+    file->lines.clear();
+    load(fileName, file);
+    reloads.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  static void indexLines(SourceFile *file) {
+    file->lineOffsets.push_back(0);
+    const char *base = file->data.data();
+    const char *pos = base, *end = base + file->data.size();
+    while ((pos = (const char *)memchr(pos, '\n', end - pos)) != nullptr) {
+      ++pos;
+      if (pos == end)
+        break;
+      file->lineOffsets.push_back(pos - base);
+    }
+    file->lineOffsets.push_back(file->data.size());
+  }
+
+  uint64_t statIntervalNs;
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> misses;
+  std::atomic<uint64_t> reloads;
+  Shard shards[kNumShards];
+};
+
+// line pyLineNumber of pyFileName without spaces, "" if there is none
+static inline std::string GetPyLine(const std::string &pyFileName,
+                                    int pyLineNumber) {
+  return GetSymbol(
+      PySourceCache::GetPySourceCache()->getLine(pyFileName, pyLineNumber));
+}
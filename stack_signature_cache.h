@@ -0,0 +1,245 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "common.h"
+#include "module_filter.h"
+#include "unwinder.h"
+
+#define MAX_STACK_SIGNATURE_DEPTH 8
+// frames walked for the signature, excluded ones included
+#define MAX_STACK_SIGNATURE_WALK 32
+
+// Cheap fingerprint of the native call stack at a sampling point: %rsp plus
+// the first return addresses of the application above the sampling function.
+// Two call paths that leave %rsp at the same value differ in their return
+// addresses unless they only diverge deeper than the signature.
+struct StackSignature {
+  uint64_t rsp;
+  // state outside the native stack that the call path depends on
+  uint64_t context;
+  uint32_t depth;
+  uint64_t pcs[MAX_STACK_SIGNATURE_DEPTH];
+
+  uint64_t hash() const {
+    uint64_t h = rsp ^ context * 0x9e3779b97f4a7c15ull;
+    for (uint32_t i = 0; i < depth; ++i)
+      h = (h ^ pcs[i]) * 0x100000001b3ull;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  bool operator==(const StackSignature &other) const {
+    return rsp == other.rsp && context == other.context &&
+           depth == other.depth &&
+           memcmp(pcs, other.pcs, depth * sizeof(uint64_t)) == 0;
+  }
+};
+
+// Fill signature with the stack of the caller of GetStackSignature: its %rsp
+// and the first depth return addresses above it outside the modules excluded
+// by filter. The frames of the profiler, libcupti and libcuda between a
+// launch and its callback are the same for every call path of the launch, so
+// the signature is taken from the frames of the application above them. Those
+// libraries are built without frame pointers, the walk follows unwind info.
+__attribute__((noinline)) static void
+GetStackSignature(StackSignature &signature, uint32_t depth,
+                  ModuleFilter *filter = ModuleFilter::GetModuleFilter()) {
+  // %rsp of the caller, before it called this function
+  signature.rsp = (uint64_t)__builtin_frame_address(0) + 2 * sizeof(uint64_t);
+  signature.context = 0;
+  // skip the frames of this function and of the caller
+  uint64_t pcs[MAX_STACK_SIGNATURE_WALK];
+  size_t n = Unwinder::GetUnwinder("backtrace")
+                 ->unwind(pcs, MAX_STACK_SIGNATURE_WALK, 2);
+  depth = std::min(depth, (uint32_t)MAX_STACK_SIGNATURE_DEPTH);
+  signature.depth = 0;
+  for (size_t i = 0; i < n && signature.depth < depth; ++i) {
+    if (!filter->isExcluded(pcs[i]))
+      signature.pcs[signature.depth++] = pcs[i];
+  }
+}
+
+// Per-thread cache from stack signatures to the CCT node id of the call path
+// they were sampled at, so that a sample at a known stack skips unwinding.
+//
+// Capacity is fixed, entries live in a preallocated array threaded on an LRU
+// list and are looked up through a chained hash index, so the cache never
+// allocates after construction. A signature may still match a different call
+// path (a false hit), so one in verifyInterval hits is unwound anyway and
+// checked against the cached node.
+class StackSignatureCache {
+public:
+  // capacity must be > 0, verifyInterval 0 never verifies
+  StackSignatureCache(uint32_t capacity, uint32_t _verifyInterval)
+      : entries(capacity), nEntries(0), lruHead(kNull), lruTail(kNull),
+        verifyInterval(_verifyInterval), hitsToVerify(_verifyInterval) {
+    uint32_t nBuckets = 1;
+    while (nBuckets < 2 * capacity)
+      nBuckets <<= 1;
+    buckets.assign(nBuckets, kNull);
+  }
+
+  StackSignatureCache(const StackSignatureCache &) = delete;
+  StackSignatureCache &operator=(const StackSignatureCache &) = delete;
+
+  // the cache of the calling thread
+  static StackSignatureCache *GetThreadCache() {
+    static thread_local StackSignatureCache cache(
+        std::max(GetProfilerConf()->stackCacheSize, 1u),
+        GetProfilerConf()->stackCacheVerifyInterval);
+    return &cache;
+  }
+
+  bool lookup(const StackSignature &signature, uint64_t &pcId) {
+    uint32_t idx = find(signature, signature.hash());
+    if (idx == kNull) {
+      CountEvent(GetStats().misses);
+      return false;
+    }
+    moveToFront(idx);
+    pcId = entries[idx].pcId;
+    CountEvent(GetStats().hits);
+    return true;
+  }
+
+  // the hit just returned by lookup should be verified by unwinding
+  bool shouldVerify() {
+    if (!verifyInterval || --hitsToVerify)
+      return false;
+    hitsToVerify = verifyInterval;
+    return true;
+  }
+
+  // the hit just verified pointed to another call path
+  void countFalseHit() { CountEvent(GetStats().falseHits); }
+
+  // map signature to pcId, evicting the least recently used entry if full
+  void insert(const StackSignature &signature, uint64_t pcId) {
+    uint64_t hash = signature.hash();
+    uint32_t idx = find(signature, hash);
+    if (idx == kNull) {
+      if (nEntries < entries.size()) {
+        idx = nEntries++;
+      } else {
+        idx = lruTail;
+        unlinkLRU(idx);
+        unlinkBucket(idx);
+        CountEvent(GetStats().evictions);
+      }
+      Entry &entry = entries[idx];
+      entry.signature = signature;
+      entry.hash = hash;
+      uint32_t &bucket = buckets[hash & (buckets.size() - 1)];
+      entry.bucketNext = bucket;
+      bucket = idx;
+    } else {
+      unlinkLRU(idx);
+    }
+    entries[idx].pcId = pcId;
+    pushFront(idx);
+  }
+
+  uint32_t size() { return nEntries; }
+
+  // counters of all threads
+  static uint64_t GetHits() {
+    return GetStats().hits.load(std::memory_order_relaxed);
+  }
+
+  static uint64_t GetMisses() {
+    return GetStats().misses.load(std::memory_order_relaxed);
+  }
+
+  static uint64_t GetFalseHits() {
+    return GetStats().falseHits.load(std::memory_order_relaxed);
+  }
+
+  static uint64_t GetEvictions() {
+    return GetStats().evictions.load(std::memory_order_relaxed);
+  }
+
+private:
+  static const uint32_t kNull = UINT32_MAX;
+
+  struct Entry {
+    StackSignature signature;
+    uint64_t hash;
+    uint64_t pcId;
+    uint32_t bucketNext;
+    uint32_t lruPrev, lruNext;
+  };
+
+  struct Stats {
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> falseHits{0};
+    std::atomic<uint64_t> evictions{0};
+  };
+
+  static Stats &GetStats() {
+    static Stats stats;
+    return stats;
+  }
+
+  static void CountEvent(std::atomic<uint64_t> &counter) {
+    counter.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint32_t find(const StackSignature &signature, uint64_t hash) {
+    uint32_t idx = buckets[hash & (buckets.size() - 1)];
+    while (idx != kNull && (entries[idx].hash != hash ||
+                            !(entries[idx].signature == signature)))
+      idx = entries[idx].bucketNext;
+    return idx;
+  }
+
+  void unlinkBucket(uint32_t idx) {
+    uint32_t *link = &buckets[entries[idx].hash & (buckets.size() - 1)];
+    while (*link != idx)
+      link = &entries[*link].bucketNext;
+    *link = entries[idx].bucketNext;
+  }
+
+  void unlinkLRU(uint32_t idx) {
+    Entry &entry = entries[idx];
+    if (entry.lruPrev != kNull)
+      entries[entry.lruPrev].lruNext = entry.lruNext;
+    else
+      lruHead = entry.lruNext;
+    if (entry.lruNext != kNull)
+      entries[entry.lruNext].lruPrev = entry.lruPrev;
+    else
+      lruTail = entry.lruPrev;
+  }
+
+  void pushFront(uint32_t idx) {
+    Entry &entry = entries[idx];
+    entry.lruPrev = kNull;
+    entry.lruNext = lruHead;
+    if (lruHead != kNull)
+      entries[lruHead].lruPrev = idx;
+    lruHead = idx;
+    if (lruTail == kNull)
+      lruTail = idx;
+  }
+
+  void moveToFront(uint32_t idx) {
+    if (idx == lruHead)
+      return;
+    unlinkLRU(idx);
+    pushFront(idx);
+  }
+
+  std::vector<Entry> entries;
+  std::vector<uint32_t> buckets;
+  uint32_t nEntries;
+  uint32_t lruHead, lruTail;
+  uint32_t verifyInterval;
+  uint32_t hitsToVerify;
+};
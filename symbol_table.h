@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unordered_map>
+
+typedef uint32_t SymbolId;
+
+// id of the empty string, also used for "no symbol"
+#define EMPTY_SYMBOL_ID 0
+
+// Process-wide string interning table. Function names are stored once and
+// referenced by a 32-bit id everywhere else (e.g., by CCT nodes).
+//
+// Interning goes through one of kNumShards mutexed hash maps, picked by the
+// hash of the string, so threads interning different names rarely contend.
+// Resolving an id is lock-free: the id indexes a chunked table whose chunk
+// pointers are atomic, and a slot is written before its id is handed out.
+// Once the table is full, new strings are interned as the empty string and
+// counted as dropped.
+class SymbolTable {
+public:
+  static const uint32_t kNumShards = 64;
+  static const uint32_t kChunkBits = 14;
+  static const uint32_t kChunkSize = 1u << kChunkBits;
+  // at most 64M symbols
+  static const uint32_t kMaxChunks = 1u << 12;
+
+  // capacity is the number of symbols, at most kMaxChunks * kChunkSize
+  explicit SymbolTable(uint32_t _capacity = kMaxChunks * kChunkSize)
+      : capacity(std::min(_capacity, kMaxChunks * kChunkSize)), nSymbols(0),
+        dropped(0) {
+    for (uint32_t i = 0; i < kMaxChunks; ++i)
+      chunks[i].store(nullptr, std::memory_order_relaxed);
+    SymbolId emptyId = intern("");
+    (void)emptyId;
+  }
+
+  ~SymbolTable() {
+    for (uint32_t i = 0; i < kMaxChunks; ++i)
+      delete[] chunks[i].load(std::memory_order_relaxed);
+  }
+
+  SymbolTable(const SymbolTable &) = delete;
+  SymbolTable &operator=(const SymbolTable &) = delete;
+
+  static SymbolTable *GetSymbolTable() {
+    static SymbolTable *symbolTable = new SymbolTable();
+    return symbolTable;
+  }
+
+  SymbolId intern(const std::string &symbol) {
+    Shard &shard = shards[std::hash<std::string>()(symbol) % kNumShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto itr = shard.symbol2Id.find(symbol);
+    if (itr != shard.symbol2Id.end())
+      return itr->second;
+
+    // the check keeps the counter from wrapping around, ids taken past the
+    // capacity by concurrent shards are not used
+    SymbolId id = capacity;
+    if (nSymbols.load(std::memory_order_relaxed) < capacity)
+      id = nSymbols.fetch_add(1, std::memory_order_relaxed);
+    if (id >= capacity) {
+      if (dropped.fetch_add(1, std::memory_order_relaxed) == 0)
+        fprintf(stderr,
+                "%s:%d: Warning: symbol table exhausted, new names are "
+                "left empty\n",
+                __FILE__, __LINE__);
+      return EMPTY_SYMBOL_ID;
+    }
+    uint32_t chunkIdx = id >> kChunkBits;
+    const std::string **chunk = getOrCreateChunk(chunkIdx);
+    // keys of an unordered_map never move, the slot can point to it
+    auto res = shard.symbol2Id.insert(std::make_pair(symbol, id));
+    chunk[id & (kChunkSize - 1)] = &res.first->first;
+    return id;
+  }
+
+  // id must have been returned by intern
+  const std::string &getSymbol(SymbolId id) {
+    return *chunks[id >> kChunkBits].load(
+        std::memory_order_acquire)[id & (kChunkSize - 1)];
+  }
+
+  uint32_t size() {
+    uint32_t n = nSymbols.load(std::memory_order_relaxed);
+    return n < capacity ? n : capacity;
+  }
+
+  // strings not interned because the table was full
+  uint64_t getDropped() { return dropped.load(std::memory_order_relaxed); }
+
+private:
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<std::string, SymbolId> symbol2Id;
+  };
+
+  const std::string **getOrCreateChunk(uint32_t chunkIdx) {
+    const std::string **chunk =
+        chunks[chunkIdx].load(std::memory_order_acquire);
+    if (chunk)
+      return chunk;
+    // threads of different shards may race to create the same chunk
+    const std::string **newChunk = new const std::string *[kChunkSize]();
+    if (chunks[chunkIdx].compare_exchange_strong(chunk, newChunk,
+                                                 std::memory_order_acq_rel))
+      return newChunk;
+    delete[] newChunk;
+    return chunk;
+  }
+
+  uint32_t capacity;
+  Shard shards[kNumShards];
+  std::atomic<const std::string **> chunks[kMaxChunks];
+  std::atomic<SymbolId> nSymbols;
+  std::atomic<uint64_t> dropped;
+};
+
+static inline SymbolId InternSymbol(const std::string &symbol) {
+  return SymbolTable::GetSymbolTable()->intern(symbol);
+}
+
+static inline const std::string &GetSymbol(SymbolId id) {
+  return SymbolTable::GetSymbolTable()->getSymbol(id);
+}
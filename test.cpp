@@ -1,9 +1,29 @@
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fstream>
+#include <malloc.h>
+#include <set>
+
 #include "back_tracer.h"
+#include "cct_builder.h"
+#include "cct_merger.h"
+#include "cct_pruner.h"
 #include "common.h"
+#include "cpu_sample_aggregator.h"
 #include "cpu_sampler.h"
+#include "elf_symbolizer.h"
+#include "frame_classifier.h"
+#include "main_py_stack.h"
+#include "module_filter.h"
+#include "py_frame_cache.h"
+#include "py_source_cache.h"
+#include "stack_signature_cache.h"
+#include "tools/profile_file.h"
+#include "unwinder.h"
 
 bool verbose = true;
-bool samplingStarted = false;
+std::atomic<bool> samplingStarted(false);
 pid_t mainPid = -1;
 
 void TestProfilerConf() {
@@ -81,6 +101,7 @@ void TestBackTracerOverheadR2(int depth) {
   timer->stop();
   std::cout << "overhead of complex sample: " << timer->getAccumulatedTime()
             << std::endl;
+  timer->reset();
 }
 
 void TestCppStackPointer() {
@@ -90,31 +111,2210 @@ void TestCppStackPointer() {
   barFunc();
 }
 
+// Node layout used before the arena-backed CCT, kept here as the baseline of
+// TestCCTArenaBenchmark.
+class LegacyCPUCCTNode {
+public:
+  uint64_t id, pc, parentID, parentPC, offset, samples;
+  CCTNodeType nodeType;
+  std::string funcName;
+  std::vector<LegacyCPUCCTNode *> childNodes;
+  std::unordered_map<uint64_t, LegacyCPUCCTNode *> pc2ChildNodes;
+  std::unordered_map<uint64_t, LegacyCPUCCTNode *> id2ChildNodes;
+
+  ~LegacyCPUCCTNode() {
+    for (auto child : childNodes)
+      delete child;
+  }
+};
+
+// pc of the frame at `level` of synthetic call path `path`, the paths form a
+// tree with the given fan-out for the first levels and deep chains below it
+static uint64_t SyntheticPC(uint64_t path, uint64_t level, uint64_t nPaths,
+                            uint64_t fanout) {
+  uint64_t stride = nPaths;
+  for (uint64_t l = 0; l < level && stride; ++l)
+    stride /= fanout;
+  uint64_t prefix = stride ? path / stride : path;
+  return 0x400000 + (level << 4) + (prefix << 20);
+}
+
+static size_t GetHeapInUse() { return mallinfo().uordblks; }
+
+// resolve every frame of the current call stack with libunwind, as unwinding
+// did before the elf symbolizer, f(pc, name, offset)
+template <typename F> void ResolveCallStackUnw(F f) {
+  unw_cursor_t cursor;
+  unw_context_t context;
+  unw_getcontext(&context);
+  unw_init_local(&cursor, &context);
+  while (unw_step(&cursor) > 0) {
+    unw_word_t pc, offset = 0;
+    unw_get_reg(&cursor, UNW_REG_IP, &pc);
+    char fname[FUNC_NAME_LENGTH];
+    fname[0] = '\0';
+    unw_get_proc_name(&cursor, fname, sizeof(fname), &offset);
+    int status = 99;
+    char *demangled = abi::__cxa_demangle(fname, nullptr, nullptr, &status);
+    f(pc, std::string(demangled ? demangled : fname), offset);
+    free(demangled);
+  }
+}
+
+// resolve every frame of the current call stack with the elf symbolizer,
+// through the pc symbol cache or not, f(pc, name, offset)
+template <typename F>
+__attribute__((noinline)) void ResolveCallStack(bool useCache, F f) {
+  uint64_t pcs[MAX_UNWIND_DEPTH];
+  // skip the frame of ResolveCallStack
+  size_t depth =
+      Unwinder::GetUnwinder("cursor")->unwind(pcs, MAX_UNWIND_DEPTH, 1);
+  ElfSymbolizer *symbolizer = ElfSymbolizer::GetElfSymbolizer();
+  for (size_t i = 0; i < depth; ++i) {
+    PCSymbol symbol =
+        useCache ? ResolvePCSymbol(pcs[i]) : symbolizer->resolve(pcs[i]);
+    f(pcs[i], GetSymbol(symbol.funcNameId), symbol.offset);
+  }
+}
+
+void TestPCSymbolCacheRecursive(int depth, int nRounds, uint64_t &nMismatches,
+                                uint64_t &nFrames, double &uncachedTime,
+                                double &cachedTime) {
+  if (depth > 0) {
+    TestPCSymbolCacheRecursive(depth - 1, nRounds, nMismatches, nFrames,
+                               uncachedTime, cachedTime);
+    // not a tail call, every level keeps its frame
+    asm volatile("" ::: "memory");
+    return;
+  }
+  std::vector<std::pair<std::string, uint64_t>> expected, resolved;
+  ResolveCallStack(false, [&expected](uint64_t, std::string name,
+                                      uint64_t offset) {
+    expected.push_back({name, offset});
+  });
+  Timer timer;
+  for (int useCache = 0; useCache < 2; ++useCache) {
+    timer.reset();
+    timer.start();
+    for (int r = 0; r < nRounds; ++r) {
+      resolved.clear();
+      ResolveCallStack(useCache, [&resolved](uint64_t, std::string name,
+                                             uint64_t offset) {
+        resolved.push_back({name, offset});
+      });
+    }
+    timer.stop();
+    (useCache ? cachedTime : uncachedTime) += timer.getAccumulatedTime();
+  }
+  // frames below this one are the same in every round
+  nFrames += expected.size();
+  for (size_t i = 1; i < expected.size() && i < resolved.size(); ++i)
+    nMismatches += expected[i] != resolved[i];
+}
+
+void TestPCSymbolCache(int nThreads, int depth, int nRounds) {
+  std::cout << "********** TestPCSymbolCache **********" << std::endl;
+  std::cout << "threads: " << nThreads << ", depth: " << depth
+            << ", rounds: " << nRounds << std::endl;
+  PCSymbolCache *cache = PCSymbolCache::GetPCSymbolCache();
+  uint64_t hits0 = cache->getHits(), misses0 = cache->getMisses();
+  std::vector<std::thread> threads;
+  std::vector<uint64_t> nMismatches(nThreads, 0), nFrames(nThreads, 0);
+  std::vector<double> uncachedTime(nThreads, 0), cachedTime(nThreads, 0);
+  for (int t = 0; t < nThreads; ++t) {
+    threads.emplace_back([=, &nMismatches, &nFrames, &uncachedTime,
+                          &cachedTime]() {
+      TestPCSymbolCacheRecursive(depth, nRounds, nMismatches[t], nFrames[t],
+                                 uncachedTime[t], cachedTime[t]);
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+  uint64_t mismatches = 0, frames = 0;
+  double uncached = 0, cached = 0;
+  for (int t = 0; t < nThreads; ++t) {
+    mismatches += nMismatches[t];
+    frames += nFrames[t];
+    uncached += uncachedTime[t];
+    cached += cachedTime[t];
+  }
+  uint64_t hits = cache->getHits() - hits0;
+  uint64_t misses = cache->getMisses() - misses0;
+  std::cout << "frames: " << frames << ", mismatches: " << mismatches
+            << ", hits: " << hits << ", misses: " << misses
+            << ", hit rate: " << (double)hits / (hits + misses)
+            << ", uncached time: " << uncached
+            << ", cached time: " << cached << std::endl;
+}
+
+void TestElfSymbolizerRecursive(int depth, int nRounds) {
+  if (depth > 0) {
+    TestElfSymbolizerRecursive(depth - 1, nRounds);
+    // not a tail call, every level keeps its frame
+    asm volatile("" ::: "memory");
+    return;
+  }
+  std::vector<uint64_t> pcs;
+  std::vector<std::pair<std::string, uint64_t>> expected;
+  ResolveCallStackUnw([&](uint64_t pc, std::string name, uint64_t offset) {
+    pcs.push_back(pc);
+    expected.push_back({name, offset});
+  });
+  ElfSymbolizer *symbolizer = ElfSymbolizer::GetElfSymbolizer();
+  uint64_t nMatches = 0;
+  for (size_t i = 0; i < pcs.size(); ++i) {
+    PCSymbol symbol = symbolizer->resolve(pcs[i]);
+    bool match = GetSymbol(symbol.funcNameId) == expected[i].first &&
+                 symbol.offset == expected[i].second;
+    nMatches += match;
+    if (!match)
+      std::cout << "mismatch: " << GetSymbol(symbol.funcNameId) << "+"
+                << symbol.offset << " vs " << expected[i].first << "+"
+                << expected[i].second << std::endl;
+  }
+
+  // hot path cost: raw pcs only vs names through a cold cache
+  Timer rawTimer, namedTimer, batchTimer;
+  std::vector<uint64_t> rawPCs;
+  for (int r = 0; r < nRounds; ++r) {
+    rawTimer.start();
+    rawPCs.clear();
+    unw_cursor_t cursor;
+    unw_context_t context;
+    unw_getcontext(&context);
+    unw_init_local(&cursor, &context);
+    while (unw_step(&cursor) > 0) {
+      unw_word_t pc;
+      unw_get_reg(&cursor, UNW_REG_IP, &pc);
+      if (!symbolizer->isExcludedPC(pc))
+        rawPCs.push_back(pc);
+    }
+    rawTimer.stop();
+    namedTimer.start();
+    ResolveCallStackUnw([](uint64_t, std::string, uint64_t) {});
+    namedTimer.stop();
+    batchTimer.start();
+    for (uint64_t pc : rawPCs)
+      symbolizer->resolve(pc);
+    batchTimer.stop();
+  }
+  std::cout << "frames: " << pcs.size() << ", matches: " << nMatches
+            << ", raw unwinding time: " << rawTimer.getAccumulatedTime()
+            << ", named unwinding time: " << namedTimer.getAccumulatedTime()
+            << ", elf symbolization time: " << batchTimer.getAccumulatedTime()
+            << std::endl;
+}
+
+void TestElfSymbolizer(int depth, int nRounds) {
+  std::cout << "********** TestElfSymbolizer **********" << std::endl;
+  std::cout << "depth: " << depth << ", rounds: " << nRounds << std::endl;
+  TestElfSymbolizerRecursive(depth, nRounds);
+
+  // an object opened after the module list was taken is named, and a pc
+  // outside every object is not cached
+  PCSymbolCache *cache = PCSymbolCache::GetPCSymbolCache();
+  void *handle = dlopen("libz.so.1", RTLD_NOW | RTLD_LOCAL);
+  void *func = handle ? dlsym(handle, "zlibVersion") : nullptr;
+  uint64_t dlopenedPC = (uint64_t)func + 1;
+  std::string dlopenedName =
+      func ? GetSymbol(ResolvePCSymbol(dlopenedPC).funcNameId) : "";
+  void *page = mmap(nullptr, 4096, PROT_READ | PROT_EXEC,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  uint64_t anonPC = (uint64_t)page + 16;
+  std::string anonName = GetSymbol(ResolvePCSymbol(anonPC).funcNameId);
+  std::cout << "dlopened: " << dlopenedName << " (expected zlibVersion)"
+            << ", cached: " << cache->contains(dlopenedPC)
+            << ", unknown: " << anonName
+            << ", cached: " << cache->contains(anonPC) << " (expected 0)"
+            << std::endl;
+  munmap(page, 4096);
+  if (handle)
+    dlclose(handle);
+}
+
+void TestUnwindersRecursive(int depth,
+                            std::vector<std::vector<uint64_t>> &stacks) {
+  if (depth > 0) {
+    TestUnwindersRecursive(depth - 1, stacks);
+    // not a tail call, every level keeps its frame
+    asm volatile("" ::: "memory");
+    return;
+  }
+  for (const char *name : {"cursor", "backtrace", "fp"}) {
+    uint64_t pcs[MAX_UNWIND_DEPTH];
+    size_t n = Unwinder::GetUnwinder(name)->unwind(pcs, MAX_UNWIND_DEPTH);
+    stacks.push_back(std::vector<uint64_t>(pcs, pcs + n));
+  }
+}
+
+void TestUnwinders(int depth) {
+  std::cout << "********** TestUnwinders **********" << std::endl;
+  std::cout << "depth: " << depth << std::endl;
+  // the backends agree on the frames of this binary, the fp chain may stop
+  // early in libraries built without frame pointers
+  std::vector<std::vector<uint64_t>> stacks;
+  TestUnwindersRecursive(depth, stacks);
+  const char *names[] = {"cursor", "backtrace", "fp"};
+  for (size_t b = 0; b < stacks.size(); ++b) {
+    size_t nCommon = 0;
+    while (nCommon < stacks[b].size() && nCommon < stacks[0].size() &&
+           stacks[b][nCommon] == stacks[0][nCommon])
+      ++nCommon;
+    std::cout << names[b] << ": frames: " << stacks[b].size()
+              << ", same as cursor: " << nCommon << std::endl;
+  }
+
+  auto conf = GetProfilerConf();
+  std::string unwinder = conf->unwinder;
+
+  // the cursor backend of the profiler names frames as unw_get_proc_name,
+  // e.g., those the ELF symbolizer only names by object and offset
+  std::map<uint64_t, std::string> unwNames;
+  ResolveCallStackUnw([&unwNames](uint64_t pc, std::string name, uint64_t) {
+    unwNames[pc] = name;
+  });
+  conf->unwinder = "cursor";
+  uint64_t pcs[MAX_UNWIND_DEPTH];
+  size_t n = GetUnwinder()->unwind(pcs, MAX_UNWIND_DEPTH);
+  uint64_t nCompared = 0, nSameNames = 0;
+  for (size_t i = 0; i < n; ++i) {
+    auto itr = unwNames.find(pcs[i]);
+    if (itr == unwNames.end() || itr->second.empty())
+      continue;
+    ++nCompared;
+    nSameNames += GetSymbol(ResolvePCSymbol(pcs[i]).funcNameId) == itr->second;
+  }
+  std::cout << "cursor names: " << nSameNames << "/" << nCompared
+            << " as unw_get_proc_name" << std::endl;
+
+  bool checkRSP = conf->checkRSP, verbose0 = verbose;
+  conf->checkRSP = false;
+  verbose = false;
+  // one untimed warm-up per backend, so no backend pays for the first
+  // sample of the call paths in the CCT
+  const int nUnwinds = 1000;
+  TestA::TestA1::A a;
+  for (const char *name : names) {
+    conf->unwinder = name;
+    TestBackTracerRecursive(depth);
+    a.foo(depth, 1, 2, 3, 4.0, 5.0, 6.0);
+    Timer simpleTimer, complexTimer;
+    simpleTimer.start();
+    for (int i = 0; i < nUnwinds; ++i)
+      TestBackTracerRecursive(depth);
+    simpleTimer.stop();
+    complexTimer.start();
+    for (int i = 0; i < nUnwinds; ++i)
+      a.foo(depth, 1, 2, 3, 4.0, 5.0, 6.0);
+    complexTimer.stop();
+    std::cout << "unwinder: " << name << ", us per unwind: simple: "
+              << double(simpleTimer.getAccumulatedTimeInt()) / nUnwinds
+              << ", complex: "
+              << double(complexTimer.getAccumulatedTimeInt()) / nUnwinds
+              << std::endl;
+  }
+  conf->unwinder = unwinder;
+  conf->checkRSP = checkRSP;
+  verbose = verbose0;
+}
+
+__attribute__((noinline)) void StackSignatureAtSite(StackSignature &signature) {
+  GetStackSignature(signature, 4);
+  asm volatile("" ::: "memory");
+}
+
+__attribute__((noinline)) void BackTraceAtSite() {
+  GetBackTracer()->DoBackTrace(false);
+  asm volatile("" ::: "memory");
+}
+
+// DoBackTrace from two call paths that leave %rsp at the same value, on a new
+// thread so that its stack cache is built with the current conf
+void StackCacheRun(uint32_t signatureDepth, int nRounds) {
+  auto conf = GetProfilerConf();
+  uint32_t signatureDepth0 = conf->stackSignatureDepth;
+  uint32_t verifyInterval0 = conf->stackCacheVerifyInterval;
+  bool checkRSP0 = conf->checkRSP;
+  conf->stackSignatureDepth = signatureDepth;
+  conf->stackCacheVerifyInterval = 1;
+  conf->checkRSP = true;
+  uint64_t hits0 = StackSignatureCache::GetHits();
+  uint64_t misses0 = StackSignatureCache::GetMisses();
+  uint64_t falseHits0 = StackSignatureCache::GetFalseHits();
+  std::thread([nRounds]() {
+    for (int r = 0; r < nRounds; ++r) {
+      BackTraceAtSite();
+      BackTraceAtSite();
+    }
+  }).join();
+  std::cout << "signature depth: " << signatureDepth
+            << ", hits: " << StackSignatureCache::GetHits() - hits0
+            << ", misses: " << StackSignatureCache::GetMisses() - misses0
+            << ", false hits: "
+            << StackSignatureCache::GetFalseHits() - falseHits0 << std::endl;
+  conf->stackSignatureDepth = signatureDepth0;
+  conf->stackCacheVerifyInterval = verifyInterval0;
+  conf->checkRSP = checkRSP0;
+}
+
+// frame filter by function names before ModuleFilter, the baseline of
+// TestModuleFilter
+static bool LegacyHasExcludePatterns(std::string funcName) {
+  std::vector<std::string> excludePatterns = {
+      "cupti", "CUpti", "cuTexRefGetArray", "GenCallStack"};
+  for (auto pattern : excludePatterns) {
+    if (funcName.find(pattern) != std::string::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void TestModuleFilter(int depth, int nRounds) {
+  std::cout << "********** TestModuleFilter **********" << std::endl;
+  std::cout << "depth: " << depth << ", rounds: " << nRounds << std::endl;
+  ModuleFilter filter(ModuleFilter::SplitPatterns("libpython,,libbz2"), true);
+  // the test is the executable, it is not the profiler library
+  bool pythonExcluded = filter.isExcluded((uint64_t)&Py_IsInitialized);
+  bool selfExcluded = filter.isExcluded((uint64_t)&TestModuleFilter);
+
+  // objects opened later are picked up on their first pc
+  uint64_t refreshes = filter.getRefreshes();
+  bool openedExcluded = false;
+  void *handle = dlopen("libbz2.so.1", RTLD_NOW | RTLD_LOCAL);
+  if (handle) {
+    void *func = dlsym(handle, "BZ2_bzlibVersion");
+    openedExcluded = func && filter.isExcluded((uint64_t)func);
+  }
+  std::cout << "excluded: python: " << pythonExcluded
+            << ", test: " << selfExcluded
+            << ", dlopened: " << openedExcluded << " (expected 101)"
+            << ", refreshes on dlopen: " << filter.getRefreshes() - refreshes
+            << ", excluded ranges: " << filter.getNumExcludedRanges()
+            << std::endl;
+
+  // per frame cost: names matched against patterns vs pcs against ranges
+  std::vector<uint64_t> pcs;
+  std::vector<std::string> names;
+  for (int d = 0; d < depth; ++d) {
+    uint64_t pc = (uint64_t)&Py_IsInitialized + d;
+    if (d % 2)
+      pc = (uint64_t)&TestModuleFilter + d;
+    pcs.push_back(pc);
+    names.push_back(
+        GetSymbol(ElfSymbolizer::GetElfSymbolizer()->resolve(pc).funcNameId));
+  }
+  uint64_t nNames = 0, nPCs = 0;
+  Timer namesTimer, pcsTimer;
+  namesTimer.start();
+  for (int r = 0; r < nRounds; ++r) {
+    for (auto &name : names)
+      nNames += LegacyHasExcludePatterns(name);
+  }
+  namesTimer.stop();
+  pcsTimer.start();
+  for (int r = 0; r < nRounds; ++r) {
+    for (uint64_t pc : pcs)
+      nPCs += filter.isExcluded(pc);
+  }
+  pcsTimer.stop();
+  std::cout << "name patterns time: " << namesTimer.getAccumulatedTime()
+            << " (" << nNames << " excluded)"
+            << ", address ranges time: " << pcsTimer.getAccumulatedTime()
+            << " (" << nPCs << " excluded)" << std::endl;
+  if (handle)
+    dlclose(handle);
+}
+
+// the shape of a launch callback: frames of the application, then frames of
+// excluded libraries, libc's qsort standing in for libcuda and libcupti, then
+// the sampling site
+static ModuleFilter *callbackFilter = nullptr;
+static StackSignature *callbackSignature = nullptr;
+
+static int SignatureAtCallback(const void *a, const void *b) {
+  if (callbackSignature) {
+    GetStackSignature(*callbackSignature, 4, callbackFilter);
+    callbackSignature = nullptr;
+  }
+  return *(const int *)a - *(const int *)b;
+}
+
+__attribute__((noinline)) void LaunchThroughLibraryA(StackSignature &s) {
+  int values[64];
+  for (int i = 0; i < 64; ++i)
+    values[i] = 64 - i;
+  callbackSignature = &s;
+  qsort(values, 64, sizeof(int), SignatureAtCallback);
+  asm volatile("" ::: "memory");
+}
+
+__attribute__((noinline)) void LaunchThroughLibraryB(StackSignature &s) {
+  int values[64];
+  for (int i = 0; i < 64; ++i)
+    values[i] = 64 - i;
+  callbackSignature = &s;
+  qsort(values, 64, sizeof(int), SignatureAtCallback);
+  asm volatile("" ::: "memory");
+}
+
+void TestStackSignatureCache(int nRounds) {
+  std::cout << "********** TestStackSignatureCache **********" << std::endl;
+  // same %rsp, different callers
+  StackSignature a, b;
+  StackSignatureAtSite(a);
+  StackSignatureAtSite(b);
+  std::cout << "same rsp: " << (a.rsp == b.rsp)
+            << ", same signature: " << (a == b) << std::endl;
+
+  // through the frames of a library, only the application frames above them
+  // tell the callers apart
+  ModuleFilter keepAll(std::vector<std::string>(), false);
+  ModuleFilter skipLibc(ModuleFilter::SplitPatterns("libc.so"), false);
+  for (ModuleFilter *filter : {&keepAll, &skipLibc}) {
+    callbackFilter = filter;
+    LaunchThroughLibraryA(a);
+    LaunchThroughLibraryB(b);
+    std::cout << "library frames "
+              << (filter == &keepAll ? "kept" : "skipped")
+              << ": same rsp: " << (a.rsp == b.rsp)
+              << ", same signature: " << (a == b) << std::endl;
+  }
+
+  // least recently used entries are evicted first
+  StackSignature s[3];
+  for (uint64_t i = 0; i < 3; ++i) {
+    s[i].rsp = 0x7ff000 + i;
+    s[i].context = 0;
+    s[i].depth = 1;
+    s[i].pcs[0] = 0x400000;
+  }
+  StackSignatureCache cache(2, 0);
+  uint64_t pcId = 0;
+  cache.insert(s[0], 10);
+  cache.insert(s[1], 11);
+  cache.lookup(s[0], pcId);
+  cache.insert(s[2], 12);
+  bool hit0 = cache.lookup(s[0], pcId) && pcId == 10;
+  bool hit1 = cache.lookup(s[1], pcId);
+  bool hit2 = cache.lookup(s[2], pcId) && pcId == 12;
+  std::cout << "lru: size: " << cache.size() << ", hits: " << hit0 << hit1
+            << hit2 << " (expected 101)" << std::endl;
+
+  // %rsp alone maps both call paths to the first one
+  StackCacheRun(0, nRounds);
+  StackCacheRun(4, nRounds);
+}
+
+// GetPyLine before PySourceCache, the baseline of TestPySourceCache
+static std::string LegacyGetPyLine(std::string pyFileName, int pyLineNumer) {
+  std::fstream inFile;
+  std::string lineStr;
+  inFile.open(pyFileName);
+  int i = 1;
+  while (std::getline(inFile, lineStr) && i < pyLineNumer)
+    ++i;
+  inFile.close();
+  lineStr.erase(std::remove(lineStr.begin(), lineStr.end(), ' '),
+                lineStr.end());
+  return lineStr;
+}
+
+static void WritePySource(const std::string &fileName, int nLines,
+                          const std::string &tag) {
+  std::ofstream out(fileName);
+  for (int l = 1; l <= nLines; ++l) {
+    if (l % 7 == 0)
+      out << "\n";
+    else
+      out << "    x_" << l << " = foo( " << tag << " , " << l << " )\n";
+  }
+}
+
+void TestPySourceCache(int nLines, int nRounds) {
+  std::cout << "********** TestPySourceCache **********" << std::endl;
+  std::cout << "lines: " << nLines << ", rounds: " << nRounds << std::endl;
+  std::string fileName =
+      "/tmp/samprof_test_source_" + std::to_string(getpid()) + ".py";
+  WritePySource(fileName, nLines, "a");
+  // changes are noticed on the next lookup
+  PySourceCache cache(0);
+
+  uint64_t nMismatches = 0;
+  for (int l = -1; l <= nLines + 2; ++l)
+    nMismatches += GetSymbol(cache.getLine(fileName, l)) !=
+                   LegacyGetPyLine(fileName, l);
+  nMismatches += cache.getLine("/nonexistent.py", 3) != EMPTY_SYMBOL_ID;
+
+  Timer legacyTimer, cachedTimer;
+  legacyTimer.start();
+  for (int r = 0; r < nRounds; ++r) {
+    for (int l = 1; l <= nLines; l += 16)
+      LegacyGetPyLine(fileName, l);
+  }
+  legacyTimer.stop();
+  cachedTimer.start();
+  for (int r = 0; r < nRounds; ++r) {
+    for (int l = 1; l <= nLines; l += 16)
+      cache.getLine(fileName, l);
+  }
+  cachedTimer.stop();
+
+  // a rewrite with another size and mtime is read again
+  WritePySource(fileName, nLines + 1, "b");
+  struct timespec times[2] = {{0, UTIME_OMIT}, {1, 0}};
+  utimensat(AT_FDCWD, fileName.c_str(), times, 0);
+  for (int l = 1; l <= nLines + 1; ++l)
+    nMismatches += GetSymbol(cache.getLine(fileName, l)) !=
+                   LegacyGetPyLine(fileName, l);
+
+  // a file truncated in place before its status is checked again still
+  // serves the lines it had
+  PySourceCache stale(UINT64_MAX);
+  stale.getLine(fileName, 1);
+  std::string lastLine = LegacyGetPyLine(fileName, nLines + 1);
+  nMismatches += truncate(fileName.c_str(), 0) != 0;
+  nMismatches += GetSymbol(stale.getLine(fileName, nLines + 1)) != lastLine;
+  unlink(fileName.c_str());
+  std::cout << "mismatches: " << nMismatches
+            << ", hits: " << cache.getHits()
+            << ", misses: " << cache.getMisses()
+            << ", reloads: " << cache.getReloads()
+            << ", legacy time: " << legacyTimer.getAccumulatedTime()
+            << ", cached time: " << cachedTimer.getAccumulatedTime()
+            << std::endl;
+}
+
+// frame names as pyBackTrace built them before PyFrameCache
+static std::string LegacyPyFrameName(PyFrameObject *frame) {
+  PyObject *fileName =
+      PyUnicode_AsEncodedString(frame->f_code->co_filename, "utf-8", "~E~");
+  PyObject *funcName =
+      PyUnicode_AsEncodedString(frame->f_code->co_name, "utf-8", "~E~");
+  std::string name = std::string(PyBytes_AS_STRING(fileName)) + "|" +
+                     PyBytes_AS_STRING(funcName) + "::" +
+                     LegacyGetPyLine(PyBytes_AS_STRING(fileName),
+                                     PyFrame_GetLineNumber(frame));
+  Py_DECREF(fileName);
+  Py_DECREF(funcName);
+  return name;
+}
+
+static int pyFrameCacheRounds = 0;
+static uint64_t pyFrameCacheMismatches = 0, pyFrameCacheFrames = 0;
+static Timer pyFrameLegacyTimer, pyFrameCachedTimer;
+
+// called from python, resolves the python stack of its caller
+static PyObject *PyFrameCacheProbe(PyObject *, PyObject *) {
+  PyFrameCache *cache = PyFrameCache::GetPyFrameCache();
+  std::vector<std::string> expected;
+  for (PyFrameObject *f = PyEval_GetFrame(); f; f = f->f_back)
+    expected.push_back(LegacyPyFrameName(f));
+  size_t i = 0;
+  for (PyFrameObject *f = PyEval_GetFrame(); f; f = f->f_back, ++i) {
+    PyFrameInfo info = cache->resolve(f);
+    pyFrameCacheMismatches += GetSymbol(info.fileNameId) + "|" +
+                                  GetSymbol(info.funcNameId) !=
+                              expected[i];
+  }
+  pyFrameCacheFrames += expected.size();
+
+  pyFrameLegacyTimer.start();
+  for (int r = 0; r < pyFrameCacheRounds; ++r) {
+    for (PyFrameObject *f = PyEval_GetFrame(); f; f = f->f_back)
+      LegacyPyFrameName(f);
+  }
+  pyFrameLegacyTimer.stop();
+  pyFrameCachedTimer.start();
+  for (int r = 0; r < pyFrameCacheRounds; ++r) {
+    for (PyFrameObject *f = PyEval_GetFrame(); f; f = f->f_back)
+      cache->resolve(f);
+  }
+  pyFrameCachedTimer.stop();
+  Py_RETURN_NONE;
+}
+
+void TestPyFrameCache(int depth, int nRounds) {
+  std::cout << "********** TestPyFrameCache **********" << std::endl;
+  std::cout << "depth: " << depth << ", rounds: " << nRounds << std::endl;
+  std::string fileName =
+      "/tmp/samprof_test_frames_" + std::to_string(getpid()) + ".py";
+  {
+    std::ofstream out(fileName);
+    out << "def recurse(depth):\n"
+        << "    if depth > 0:\n"
+        << "        recurse( depth - 1 )\n"
+        << "    else:\n"
+        << "        probe( )\n"
+        << "\n"
+        << "for i in range(2):\n"
+        << "    recurse(" << depth << ")\n";
+  }
+  Py_Initialize();
+  static PyMethodDef probeDef = {"probe", PyFrameCacheProbe, METH_NOARGS,
+                                 nullptr};
+  PyObject *probe = PyCFunction_New(&probeDef, nullptr);
+  PyObject *mainDict = PyModule_GetDict(PyImport_AddModule("__main__"));
+  PyDict_SetItemString(mainDict, "probe", probe);
+  Py_DECREF(probe);
+  pyFrameCacheRounds = nRounds;
+  PyFrameCache *cache = PyFrameCache::GetPyFrameCache();
+  uint64_t hits0 = cache->getHits(), misses0 = cache->getMisses();
+  FILE *file = fopen(fileName.c_str(), "r");
+  PyRun_SimpleFile(file, fileName.c_str());
+  fclose(file);
+  unlink(fileName.c_str());
+  std::cout << "frames: " << pyFrameCacheFrames
+            << ", mismatches: " << pyFrameCacheMismatches
+            << ", hits: " << cache->getHits() - hits0
+            << ", misses: " << cache->getMisses() - misses0
+            << ", legacy time: " << pyFrameLegacyTimer.getAccumulatedTime()
+            << ", cached time: " << pyFrameCachedTimer.getAccumulatedTime()
+            << std::endl;
+}
+
+static uint64_t mainPyStackMismatches = 0, mainPyStackFrames = 0;
+
+// called from python, reads the python stack of the main thread from
+// another thread while the main thread waits
+static PyObject *MainPyStackProbe(PyObject *, PyObject *) {
+  std::vector<std::string> expected;
+  for (PyFrameObject *f = PyEval_GetFrame(); f; f = f->f_back) {
+    PyFrameInfo info = PyFrameCache::GetPyFrameCache()->resolve(f);
+    expected.insert(expected.begin(), GetSymbol(info.fileNameId) + "|" +
+                                          GetSymbol(info.funcNameId));
+  }
+  std::vector<PyFrameInfo> infos;
+  bool ok = false;
+  std::thread([&infos, &ok]() {
+    ok = MainPyStack::GetMainPyStack()->read(infos);
+  }).join();
+  mainPyStackFrames += expected.size();
+  if (!ok || infos.size() != expected.size()) {
+    mainPyStackMismatches += expected.size();
+  } else {
+    for (size_t i = 0; i < infos.size(); ++i)
+      mainPyStackMismatches += GetSymbol(infos[i].fileNameId) + "|" +
+                                   GetSymbol(infos[i].funcNameId) !=
+                               expected[i];
+  }
+  Py_RETURN_NONE;
+}
+
+// python must be initialized, by TestPyFrameCache
+static int frameClassifierRounds = 0;
+static uint64_t interpreterFrames = 0, cxxInterpreterFrames = 0,
+                frameClassifierMismatches = 0;
+static double nameMatchTime = 0, classifierTime = 0;
+
+static PyObject *FrameClassifierProbe(PyObject *, PyObject *) {
+  uint64_t pcs[MAX_UNWIND_DEPTH];
+  size_t depth = Unwinder::GetUnwinder("cursor")->unwind(pcs, MAX_UNWIND_DEPTH);
+  std::vector<std::string> names;
+  for (size_t i = 0; i < depth; ++i)
+    names.push_back(GetSymbol(
+        ElfSymbolizer::GetElfSymbolizer()->resolve(pcs[i]).funcNameId));
+  for (size_t i = 0; i < depth; ++i) {
+    bool byName =
+        names[i].find("_PyEval_EvalFrameDefault") != std::string::npos;
+    bool byAddress = TorchFrameClassifier::IsInterpreterFrame(pcs[i]);
+    interpreterFrames += byAddress;
+    frameClassifierMismatches += byName != byAddress;
+    cxxInterpreterFrames += CxxFrameClassifier::IsInterpreterFrame(pcs[i]);
+  }
+
+  uint64_t n = 0;
+  Timer nameTimer, classifierTimer;
+  nameTimer.start();
+  for (int r = 0; r < frameClassifierRounds; ++r) {
+    for (auto &name : names)
+      n += name.find("_PyEval_EvalFrameDefault") != std::string::npos;
+  }
+  nameTimer.stop();
+  classifierTimer.start();
+  for (int r = 0; r < frameClassifierRounds; ++r) {
+    for (size_t i = 0; i < depth; ++i)
+      n += TorchFrameClassifier::IsInterpreterFrame(pcs[i]);
+  }
+  classifierTimer.stop();
+  nameMatchTime += nameTimer.getAccumulatedTime();
+  classifierTime += classifierTimer.getAccumulatedTime();
+  return PyLong_FromUnsignedLongLong(n);
+}
+
+void TestFrameClassifier(int depth, int nRounds) {
+  std::cout << "********** TestFrameClassifier **********" << std::endl;
+  std::cout << "depth: " << depth << ", rounds: " << nRounds << std::endl;
+  static PyMethodDef probeDef = {"classifier_probe", FrameClassifierProbe,
+                                 METH_NOARGS, nullptr};
+  PyObject *probe = PyCFunction_New(&probeDef, nullptr);
+  PyObject *mainDict = PyModule_GetDict(PyImport_AddModule("__main__"));
+  PyDict_SetItemString(mainDict, "classifier_probe", probe);
+  Py_DECREF(probe);
+  frameClassifierRounds = nRounds;
+  PyRun_SimpleString(("def classify(depth):\n"
+                      "    if depth > 0:\n"
+                      "        return classify(depth - 1)\n"
+                      "    return classifier_probe()\n"
+                      "classify(" +
+                      std::to_string(depth) + ")\n")
+                         .c_str());
+  std::cout << "interpreter frames: " << interpreterFrames
+            << ", mismatches with names: " << frameClassifierMismatches
+            << ", c++ classifier: " << cxxInterpreterFrames
+            << ", name matching time: " << nameMatchTime
+            << ", classifier time: " << classifierTime << std::endl;
+}
+
+void TestMainPyStack(int depth, int nCalls) {
+  std::cout << "********** TestMainPyStack **********" << std::endl;
+  std::cout << "depth: " << depth << ", calls: " << nCalls << std::endl;
+  std::string fileName =
+      "/tmp/samprof_test_main_" + std::to_string(getpid()) + ".py";
+  {
+    std::ofstream out(fileName);
+    out << "def recurse(depth):\n"
+        << "    if depth > 0:\n"
+        << "        recurse( depth - 1 )\n"
+        << "    else:\n"
+        << "        main_probe( )\n"
+        << "    return depth\n"
+        << "\n"
+        << "def calls(n):\n"
+        << "    for i in range(n):\n"
+        << "        recurse(0) if i == 0 and probing else abs(i)\n"
+        << "\n"
+        << "probing = False\n";
+  }
+  static PyMethodDef probeDef = {"main_probe", MainPyStackProbe, METH_NOARGS,
+                                 nullptr};
+  PyObject *probe = PyCFunction_New(&probeDef, nullptr);
+  PyObject *mainDict = PyModule_GetDict(PyImport_AddModule("__main__"));
+  PyDict_SetItemString(mainDict, "main_probe", probe);
+  Py_DECREF(probe);
+  FILE *file = fopen(fileName.c_str(), "r");
+  PyRun_SimpleFile(file, fileName.c_str());
+  fclose(file);
+
+  // the cost of the profile function on python calls
+  std::string calls = "calls(" + std::to_string(nCalls) + ")\n";
+  Timer plainTimer, trackedTimer;
+  plainTimer.start();
+  PyRun_SimpleString(calls.c_str());
+  plainTimer.stop();
+  MainPyStack *stack = MainPyStack::GetMainPyStack();
+  // the profile function is installed by the pending call that the
+  // interpreter runs at its next safe point
+  stack->startTracking();
+  PyRun_SimpleString("pass\n");
+  bool installedByPendingCall = stack->isInstalled();
+  trackedTimer.start();
+  PyRun_SimpleString(calls.c_str());
+  trackedTimer.stop();
+
+  PyRun_SimpleString(("probing = True\nrecurse(" + std::to_string(depth) +
+                      ")\n[recurse(d) for d in range(3)]\ncalls(3)\n")
+                         .c_str());
+
+  // a profile function set before is chained while tracking and restored
+  // on the first python event after stopTracking
+  stack->stopTracking();
+  PyRun_SimpleString("import sys\n"
+                     "events = 0\n"
+                     "def prof(frame, event, arg):\n"
+                     "    global events\n"
+                     "    events += 1\n"
+                     "sys.setprofile(prof)\n");
+  stack->startTracking();
+  PyRun_SimpleString("calls(3)\n");
+  bool chained = stack->isInstalled();
+  stack->stopTracking();
+  PyRun_SimpleString("probing = False\n"
+                     "calls(1)\n"
+                     "restored = sys.getprofile() is prof\n"
+                     "sys.setprofile(None)\n");
+  PyObject *events = PyDict_GetItemString(mainDict, "events");
+  PyObject *restored = PyDict_GetItemString(mainDict, "restored");
+  chained = chained && events && PyLong_AsLong(events) > 0;
+  unlink(fileName.c_str());
+  std::cout << "frames: " << mainPyStackFrames
+            << ", mismatches: " << mainPyStackMismatches
+            << ", untracked time: " << plainTimer.getAccumulatedTime()
+            << ", tracked time: " << trackedTimer.getAccumulatedTime()
+            << ", installed by pending call: " << installedByPendingCall
+            << ", chained: " << chained << ", restored: "
+            << (restored == Py_True && !stack->isInstalled()) << std::endl;
+}
+
+static void FillRawCallStack(RawCallStack &stack, uint32_t corId,
+                             uint64_t path, uint32_t depth, uint64_t nPaths) {
+  stack.corId = corId;
+  stack.nPCs = depth;
+  stack.nPyFrames = 0;
+  stack.nMainPyFrames = depth % 3;
+  // innermost first
+  for (uint32_t l = 0; l < depth; ++l)
+    stack.pcs[l] = SyntheticPC(path, depth - 1 - l, nPaths, 4);
+  for (uint32_t i = 0; i < stack.nMainPyFrames; ++i)
+    stack.mainPyFrames[i] = {corId, i, (int)path};
+}
+
+void TestCCTBuilder(int nThreads, uint64_t nLaunches, uint32_t depth) {
+  std::cout << "********** TestCCTBuilder **********" << std::endl;
+  std::cout << "launching threads: " << nThreads << ", launches: " << nLaunches
+            << ", depth: " << depth << std::endl;
+  const uint64_t nPaths = 64;
+  std::unique_ptr<RawCallStack> in(new RawCallStack()),
+      out(new RawCallStack());
+
+  // records wrap around a small ring and come out as they went in
+  RawCallStackRing ring(4096);
+  uint64_t nPushed = 0, nPopped = 0, nCorrupted = 0;
+  for (uint32_t i = 0; i < 4096; ++i) {
+    FillRawCallStack(*in, i, i % nPaths, 1 + i % 61, nPaths);
+    if (ring.push(*in))
+      ++nPushed;
+    while ((i % 3 == 0 || nPushed - nPopped > 4) && ring.pop(*out)) {
+      FillRawCallStack(*in, out->corId, out->corId % nPaths,
+                       1 + out->corId % 61, nPaths);
+      if (out->nPCs != in->nPCs || out->nMainPyFrames != in->nMainPyFrames ||
+          memcmp(out->pcs, in->pcs, in->nPCs * sizeof(uint64_t)) ||
+          (in->nMainPyFrames &&
+           out->mainPyFrames[in->nMainPyFrames - 1].funcNameId !=
+               in->mainPyFrames[in->nMainPyFrames - 1].funcNameId))
+        ++nCorrupted;
+      ++nPopped;
+    }
+  }
+  while (ring.pop(*out))
+    ++nPopped;
+  std::cout << "ring: pushed: " << nPushed << ", popped: " << nPopped
+            << ", corrupted: " << nCorrupted << std::endl;
+
+  // the builder inserts the paths into per-thread trees, and the leaf of
+  // every launch is found by its correlation id
+  const pid_t tidBase = 1 << 30;
+  std::unordered_map<pid_t, CPUCCT *> ccts;
+  std::unordered_map<uint64_t, uint64_t> leafPCs;
+  uint64_t nextId = 1;
+  auto insert = [&](const RawCallStack &stack) -> uint64_t {
+    CPUCCT *&cct = ccts[stack.tid];
+    if (!cct) {
+      cct = new CPUCCT();
+      CPUCCTNode *root = cct->newNode();
+      root->pc = 0;
+      root->id = nextId++;
+      cct->setRootNode(root);
+    }
+    CPUCCTNode *parent = cct->root;
+    for (uint32_t l = stack.nPCs; l-- > 0;) {
+      CPUCCTNode *child = cct->getChildbyPC(parent, stack.pcs[l]);
+      if (!child) {
+        child = cct->newNode();
+        child->id = nextId++;
+        child->pc = stack.pcs[l];
+        cct->insertNode(parent, child);
+      }
+      parent = child;
+    }
+    leafPCs[parent->id] = parent->pc;
+    return parent->id;
+  };
+
+  // the launching threads only copy their stacks
+  CCTBuilder builder(1 << 20, nThreads * nLaunches);
+  builder.start(insert);
+  Timer launchTimer;
+  launchTimer.start();
+  std::vector<std::thread> launchers;
+  for (int t = 0; t < nThreads; ++t) {
+    launchers.emplace_back([&, t]() {
+      std::unique_ptr<RawCallStack> stack(new RawCallStack());
+      stack->tid = tidBase + t;
+      for (uint64_t i = 0; i < nLaunches; ++i) {
+        FillRawCallStack(*stack, t * nLaunches + i + 1, i % nPaths, depth,
+                         nPaths);
+        builder.push(*stack);
+      }
+    });
+  }
+  for (auto &launcher : launchers)
+    launcher.join();
+  launchTimer.stop();
+  builder.stop();
+
+  uint64_t nResolved = 0, nMismatches = 0;
+  for (int t = 0; t < nThreads; ++t) {
+    for (uint64_t i = 0; i < nLaunches; ++i) {
+      uint64_t leafId = builder.getLeafId(t * nLaunches + i + 1);
+      if (!leafId)
+        continue;
+      ++nResolved;
+      if (leafPCs[leafId] != SyntheticPC(i % nPaths, depth - 1, nPaths, 4))
+        ++nMismatches;
+    }
+  }
+
+  // the same paths inserted on the launching thread
+  Timer syncTimer;
+  syncTimer.start();
+  for (uint64_t i = 0; i < nLaunches; ++i) {
+    FillRawCallStack(*in, i + 1, i % nPaths, depth, nPaths);
+    in->tid = tidBase - 1;
+    insert(*in);
+  }
+  syncTimer.stop();
+
+  std::cout << "pushed: " << builder.getPushed()
+            << ", dropped: " << builder.getDropped()
+            << ", built: " << builder.getBuilt() << ", resolved: " << nResolved
+            << ", unresolved: " << builder.getUnresolved()
+            << ", mismatches: " << nMismatches << std::endl;
+  std::cout << "launch time: " << launchTimer.getAccumulatedTime() /
+                                      (nThreads * nLaunches)
+            << " per launch, sync insertion time: "
+            << syncTimer.getAccumulatedTime() / nLaunches << " per launch"
+            << std::endl;
+  for (auto &itr : ccts)
+    delete itr.second;
+
+  // waves of short-lived threads take over the rings of the exited ones, and
+  // the idle builder is woken up by a push
+  const int nWaves = 4;
+  std::atomic<uint64_t> nBuilt(0);
+  CCTBuilder waves(4096, 1);
+  waves.start([&nBuilt](const RawCallStack &) -> uint64_t {
+    nBuilt.fetch_add(1);
+    return 1;
+  });
+  for (int w = 0; w < nWaves; ++w) {
+    // the threads of a wave are alive at the same time
+    std::atomic<int> nArrived(0);
+    std::vector<std::thread> wave;
+    for (int t = 0; t < nThreads; ++t) {
+      wave.emplace_back([&]() {
+        std::unique_ptr<RawCallStack> stack(new RawCallStack());
+        FillRawCallStack(*stack, 1, 0, 1, nPaths);
+        waves.push(*stack);
+        nArrived.fetch_add(1);
+        while (nArrived.load() < nThreads)
+          std::this_thread::yield();
+      });
+    }
+    for (auto &t : wave)
+      t.join();
+  }
+  while (nBuilt.load() < waves.getPushed())
+    std::this_thread::yield();
+  usleep(10000);
+  Timer wakeTimer;
+  wakeTimer.start();
+  // pushed from a thread that exits before the builder is destroyed
+  FillRawCallStack(*in, 1, 0, 1, nPaths);
+  std::thread([&]() { waves.push(*in); }).join();
+  while (nBuilt.load() < waves.getPushed())
+    std::this_thread::yield();
+  wakeTimer.stop();
+  waves.stop();
+  std::cout << "rings after " << nWaves << " waves of " << nThreads
+            << " threads: " << waves.getNRings() << " (expected " << nThreads
+            << "), wakeup after idle: "
+            << (uint64_t)(wakeTimer.getAccumulatedTime() * 1e6) << " us"
+            << std::endl;
+}
+
+void TestCCTArenaBenchmark(uint64_t nPaths, uint64_t depth, uint64_t fanout) {
+  std::cout << "********** TestCCTArenaBenchmark **********" << std::endl;
+  std::cout << "paths: " << nPaths << ", depth: " << depth
+            << ", fanout: " << fanout << std::endl;
+  uint64_t nodeId = 1, nNodes = 0;
+
+  size_t heapBefore = GetHeapInUse();
+  auto timer = Timer::GetGlobalTimer("test_cct_legacy_insert");
+  timer->start();
+  auto legacyRoot = new LegacyCPUCCTNode();
+  for (uint64_t p = 0; p < nPaths; ++p) {
+    LegacyCPUCCTNode *parent = legacyRoot;
+    for (uint64_t l = 0; l < depth; ++l) {
+      uint64_t pc = SyntheticPC(p, l, nPaths, fanout);
+      auto itr = parent->pc2ChildNodes.find(pc);
+      if (itr != parent->pc2ChildNodes.end()) {
+        parent = itr->second;
+        continue;
+      }
+      auto child = new LegacyCPUCCTNode();
+      child->id = nodeId++;
+      child->pc = pc;
+      child->funcName = "frame";
+      child->parentID = parent->id;
+      child->parentPC = parent->pc;
+      parent->childNodes.push_back(child);
+      parent->id2ChildNodes.insert({child->id, child});
+      parent->pc2ChildNodes.insert({pc, child});
+      parent = child;
+      ++nNodes;
+    }
+  }
+  timer->stop();
+  size_t legacyBytes = GetHeapInUse() - heapBefore;
+  std::cout << "legacy nodes: " << nNodes << ", heap: " << legacyBytes
+            << " bytes, insert time: " << timer->getAccumulatedTime()
+            << std::endl;
+  timer->reset();
+
+  // replay every path, prefix matching only
+  uint64_t leafIds = 0;
+  timer->start();
+  for (uint64_t p = 0; p < nPaths; ++p) {
+    LegacyCPUCCTNode *parent = legacyRoot;
+    for (uint64_t l = 0; l < depth; ++l) {
+      uint64_t pc = SyntheticPC(p, l, nPaths, fanout);
+      if (parent->pc2ChildNodes.find(pc) == parent->pc2ChildNodes.end())
+        break;
+      parent = parent->pc2ChildNodes[pc];
+    }
+    leafIds += parent->id;
+  }
+  timer->stop();
+  std::cout << "legacy lookup time: " << timer->getAccumulatedTime()
+            << " (leaf ids: " << leafIds << ")" << std::endl;
+  delete legacyRoot;
+  timer->reset();
+
+  nNodes = 0;
+  heapBefore = GetHeapInUse();
+  timer = Timer::GetGlobalTimer("test_cct_arena_insert");
+  timer->start();
+  auto cct = new CPUCCT();
+  cct->setRootNode(cct->newNode());
+  for (uint64_t p = 0; p < nPaths; ++p) {
+    CPUCCTNode *parent = cct->root;
+    for (uint64_t l = 0; l < depth; ++l) {
+      uint64_t pc = SyntheticPC(p, l, nPaths, fanout);
+      CPUCCTNode *child = cct->getChildbyPC(parent, pc);
+      if (child) {
+        parent = child;
+        continue;
+      }
+      child = cct->newNode();
+      child->id = nodeId++;
+      child->pc = pc;
+      child->setFuncName("frame");
+      cct->insertNode(parent, child);
+      parent = child;
+      ++nNodes;
+    }
+  }
+  timer->stop();
+  size_t arenaBytes = GetHeapInUse() - heapBefore;
+  std::cout << "arena nodes: " << nNodes << ", heap: " << arenaBytes
+            << " bytes, insert time: " << timer->getAccumulatedTime()
+            << std::endl;
+  timer->reset();
+
+  leafIds = 0;
+  timer->start();
+  for (uint64_t p = 0; p < nPaths; ++p) {
+    CPUCCTNode *parent = cct->root;
+    for (uint64_t l = 0; l < depth && parent; ++l)
+      parent = cct->getChildbyPC(parent, SyntheticPC(p, l, nPaths, fanout));
+    leafIds += parent ? parent->id : 0;
+  }
+  timer->stop();
+  std::cout << "arena lookup time: " << timer->getAccumulatedTime()
+            << " (leaf ids: " << leafIds << ")" << std::endl;
+  delete cct;
+  timer->reset();
+}
+
+void TestCCTRegistryConcurrent(int nThreads, uint64_t nPaths,
+                               uint64_t depth) {
+  std::cout << "********** TestCCTRegistryConcurrent **********" << std::endl;
+  std::cout << "writers: " << nThreads << ", paths: " << nPaths
+            << ", depth: " << depth << std::endl;
+  auto registry = CPUCCTRegistry::GetRegistry();
+  // synthetic tids that do not collide with real threads
+  const pid_t tidBase = 1 << 30;
+  std::atomic<int> nRunning(nThreads);
+
+  auto writer = [&](int t) {
+    auto cct = new CPUCCT();
+    CPUCCTNode *root = cct->newNode();
+    root->pc = 0;
+    cct->setRootNode(root);
+    cct = registry->registerCCT(tidBase + t, cct);
+    for (uint64_t p = 0; p < nPaths; ++p) {
+      CPUCCTNode *parent = cct->root;
+      for (uint64_t l = 0; l < depth; ++l) {
+        uint64_t pc = SyntheticPC(p, l, nPaths, 4);
+        CPUCCTNode *child = cct->getChildbyPC(parent, pc);
+        if (!child) {
+          child = cct->newNode();
+          child->id = l + 1;
+          child->pc = pc;
+          cct->insertNode(parent, child);
+        }
+        parent = child;
+      }
+    }
+    --nRunning;
+  };
+
+  // walk the registered trees while they grow, every published node must be
+  // fully initialized
+  uint64_t nWalks = 0, nTorn = 0, nNodes = 0;
+  auto timer = Timer::GetGlobalTimer("test_cct_registry");
+  timer->start();
+  std::vector<std::thread> writers;
+  for (int t = 0; t < nThreads; ++t)
+    writers.emplace_back(writer, t);
+  do {
+    nNodes = 0;
+    registry->forEach([&](pid_t tid, CPUCCT *cct) {
+      if (tid < tidBase)
+        return;
+      cct->forEachNode([&](CPUCCTNode *node) {
+        CPUCCTNode *parent = cct->getParent(node);
+        if (parent && (node->pc == 0 || node->id != parent->id + 1))
+          ++nTorn;
+        ++nNodes;
+      });
+    });
+    ++nWalks;
+  } while (nRunning > 0);
+  for (auto &w : writers)
+    w.join();
+  timer->stop();
+  std::cout << "walks: " << nWalks << ", nodes in last walk: " << nNodes
+            << ", torn nodes: " << nTorn
+            << ", time: " << timer->getAccumulatedTime() << std::endl;
+  timer->reset();
+}
+
+void TestCCTNodeIdBenchmark(int nThreads, uint64_t nPaths, uint64_t depth) {
+  std::cout << "********** TestCCTNodeIdBenchmark **********" << std::endl;
+  std::cout << "threads: " << nThreads << ", paths: " << nPaths
+            << ", depth: " << depth << std::endl;
+  std::mutex idMutex;
+  uint64_t mutexId = 1;
+
+  // every thread inserts fresh paths into its own tree
+  auto insertPaths = [&](bool batched) {
+    auto cct = new CPUCCT();
+    cct->setRootNode(cct->newNode());
+    for (uint64_t p = 0; p < nPaths; ++p) {
+      CPUCCTNode *parent = cct->root;
+      for (uint64_t l = 0; l < depth; ++l) {
+        CPUCCTNode *child = cct->newNode();
+        if (batched) {
+          child->id = CPUCCTNodeIdAllocator::NextId();
+        } else {
+          idMutex.lock();
+          child->id = mutexId;
+          ++mutexId;
+          idMutex.unlock();
+        }
+        child->pc = SyntheticPC(p, l, nPaths, nPaths);
+        cct->insertNode(parent, child);
+        parent = child;
+      }
+    }
+    delete cct;
+  };
+
+  for (bool batched : {false, true}) {
+    auto timer = Timer::GetGlobalTimer(batched ? "test_cct_id_batched"
+                                               : "test_cct_id_mutex");
+    timer->start();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; ++t)
+      threads.emplace_back(insertPaths, batched);
+    for (auto &t : threads)
+      t.join();
+    timer->stop();
+    std::cout << (batched ? "batched" : "mutex")
+              << " id allocation, insert time: " << timer->getAccumulatedTime()
+              << std::endl;
+    timer->reset();
+  }
+}
+
+void TestSymbolTable(int nThreads, uint64_t nSymbols) {
+  std::cout << "********** TestSymbolTable **********" << std::endl;
+  std::cout << "threads: " << nThreads << ", symbols: " << nSymbols
+            << std::endl;
+  // long, template-like names sharing a common prefix
+  std::vector<std::string> symbols;
+  size_t symbolBytes = 0;
+  for (uint64_t i = 0; i < nSymbols; ++i) {
+    symbols.push_back("at::native::(anonymous namespace)::cpu_kernel_vec<" +
+                      std::string(512, 'T') + std::to_string(i) + ">");
+    symbolBytes += symbols.back().size() + 1;
+  }
+
+  size_t heapBefore = GetHeapInUse();
+  std::vector<std::vector<SymbolId>> ids(nThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < nThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      // every thread interns all the symbols, starting at a different one
+      ids[t].resize(nSymbols);
+      for (uint64_t i = 0; i < nSymbols; ++i) {
+        uint64_t j = (i + t * nSymbols / nThreads) % nSymbols;
+        ids[t][j] = InternSymbol(symbols[j]);
+      }
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+  size_t internedBytes = GetHeapInUse() - heapBefore;
+
+  uint64_t nMismatch = 0;
+  for (int t = 0; t < nThreads; ++t) {
+    for (uint64_t i = 0; i < nSymbols; ++i) {
+      if (ids[t][i] != ids[0][i] || GetSymbol(ids[t][i]) != symbols[i])
+        ++nMismatch;
+    }
+  }
+  std::cout << "interned heap: " << internedBytes
+            << " bytes, one copy per thread: " << nThreads * symbolBytes
+            << " bytes, mismatches: " << nMismatch << std::endl;
+
+  // a full table drops new strings instead of exiting
+  SymbolTable smallTable(1024);
+  uint64_t nEmpty = 0;
+  for (uint64_t i = 0; i < 2048; ++i)
+    nEmpty += smallTable.intern(symbols[i % nSymbols]) == EMPTY_SYMBOL_ID;
+  std::cout << "full table: size: " << smallTable.size()
+            << ", dropped: " << smallTable.getDropped()
+            << ", empty ids: " << nEmpty << " (expected 1025)" << std::endl;
+}
+
+void TestCCTDeltaExport(uint64_t nPaths, uint64_t depth, uint64_t nNewPaths) {
+  std::cout << "********** TestCCTDeltaExport **********" << std::endl;
+  std::cout << "paths: " << nPaths << ", depth: " << depth
+            << ", new paths: " << nNewPaths << std::endl;
+  auto cct = new CPUCCT();
+  cct->setRootNode(cct->newNode());
+  auto insertPath = [cct, depth, nPaths](uint64_t p) {
+    CPUCCTNode *parent = cct->root;
+    for (uint64_t l = 0; l < depth; ++l) {
+      uint64_t pc = SyntheticPC(p, l, nPaths, 16);
+      CPUCCTNode *child = cct->getChildbyPC(parent, pc);
+      if (child) {
+        child->addSamples(1);
+        cct->touchNode(child);
+      } else {
+        child = cct->newNode();
+        child->pc = pc;
+        cct->insertNode(parent, child);
+      }
+      parent = child;
+    }
+  };
+  for (uint64_t p = 0; p < nPaths; ++p)
+    insertPath(p);
+
+  // a client passes the epoch of the previous response as sinceEpoch, the
+  // first export returns the whole tree, the second one resends the changes
+  // of the epoch closed by the first one, here none
+  CPUCCTEpoch::Advance();
+  uint32_t epoch = CPUCCTEpoch::Advance();
+  for (uint64_t p = 0; p < nNewPaths; ++p)
+    insertPath(nPaths + p);
+  // samples on an existing path
+  insertPath(0);
+
+  uint64_t nFull = 0, nDelta = 0, nExpected = 0;
+  auto timer = Timer::GetGlobalTimer("test_cct_full_export");
+  timer->start();
+  cct->forEachNode([&nFull, &nExpected, epoch](CPUCCTNode *node) {
+    ++nFull;
+    nExpected += node->changedSince(epoch);
+  });
+  timer->stop();
+  std::cout << "full walk nodes: " << nFull
+            << ", time: " << timer->getAccumulatedTime() << std::endl;
+  timer->reset();
+
+  timer = Timer::GetGlobalTimer("test_cct_delta_export");
+  timer->start();
+  cct->forEachNodeChangedSince(epoch,
+                               [&nDelta](CPUCCTNode *node) { ++nDelta; });
+  timer->stop();
+  std::cout << "delta walk nodes: " << nDelta << ", expected: " << nExpected
+            << ", time: " << timer->getAccumulatedTime() << std::endl;
+  timer->reset();
+  delete cct;
+}
+
+void TestCCTMerge(int nThreads, uint64_t nPaths, uint64_t depth) {
+  std::cout << "********** TestCCTMerge **********" << std::endl;
+  std::cout << "threads: " << nThreads << ", paths per thread: " << nPaths
+            << ", depth: " << depth << std::endl;
+  // thread t takes paths [t * nPaths / 2, t * nPaths / 2 + nPaths), i.e.,
+  // every path is shared by two threads
+  auto buildTree = [depth](CPUCCT *cct, uint64_t firstPath, uint64_t nPaths) {
+    if (!cct->root) {
+      cct->setRootNode(cct->newNode());
+      cct->root->id = CPUCCTNodeIdAllocator::NextId();
+    }
+    uint64_t nNodes = 0;
+    for (uint64_t p = firstPath; p < firstPath + nPaths; ++p) {
+      CPUCCTNode *parent = cct->root;
+      for (uint64_t l = 0; l < depth; ++l) {
+        uint64_t pc = SyntheticPC(p, l, 1 << 20, 8);
+        CPUCCTNode *child = cct->getChildbyPC(parent, pc);
+        if (!child) {
+          child = cct->newNode();
+          child->id = CPUCCTNodeIdAllocator::NextId();
+          child->pc = pc;
+          cct->insertNode(parent, child);
+          ++nNodes;
+        }
+        parent = child;
+      }
+    }
+    return nNodes;
+  };
+
+  CCTMAP_t cctMap;
+  uint64_t nSourceNodes = 0;
+  for (int t = 0; t < nThreads; ++t) {
+    auto cct = new CPUCCT();
+    nSourceNodes += buildTree(cct, t * nPaths / 2, nPaths);
+    cctMap.insert({t, cct});
+  }
+  // reference: one tree with the paths of all the threads
+  CPUCCT reference;
+  uint64_t nExpected =
+      buildTree(&reference, 0, nThreads * nPaths / 2 + nPaths / 2);
+
+  for (uint32_t nWorkers : {1u, 8u}) {
+    CPUCCTMerger merger(nWorkers, true);
+    auto timer = Timer::GetGlobalTimer("test_cct_merge");
+    timer->start();
+    CPUCCT *merged = merger.merge(cctMap);
+    timer->stop();
+    uint64_t nMerged = 0, nSamples = 0, nUnmapped = 0, nAnnotated = 0;
+    merged->forEachNode([&](CPUCCTNode *node) {
+      if (node == merged->root)
+        return;
+      ++nMerged;
+      nSamples += node->getSamples();
+    });
+    for (auto itr : cctMap) {
+      itr.second->forEachNode([&](CPUCCTNode *node) {
+        nUnmapped += merger.getMergedId(node->id) == 0;
+      });
+    }
+    for (auto &itr : merger.getLeafThreadIds())
+      nAnnotated += itr.second.size();
+    std::cout << "workers: " << nWorkers << ", source nodes: " << nSourceNodes
+              << ", merged nodes: " << nMerged << ", expected: " << nExpected
+              << ", samples: " << nSamples << ", unmapped ids: " << nUnmapped
+              << ", annotated leaves: " << nAnnotated
+              << ", time: " << timer->getAccumulatedTime() << std::endl;
+    timer->reset();
+  }
+  for (auto itr : cctMap)
+    delete itr.second;
+}
+
+void TestCCTPruner(int nThreads, uint64_t nPaths, uint64_t depth) {
+  std::cout << "********** TestCCTPruner **********" << std::endl;
+  // golden tree: {id, parent id, python frame, function name}
+  struct GoldenNode {
+    uint64_t id, parentId;
+    bool isPy;
+    const char *funcName;
+  };
+  std::vector<GoldenNode> goldenNodes = {
+      {2, 1, true, "main.py::train"},
+      {3, 2, true, "main.py::forward"},
+      {4, 3, false, "foo"},
+      {5, 4, false, "at::_ops::add::call(x)"},
+      {6, 5, false, "at::_ops::add_impl::call(y)"},
+      {7, 6, false, "cudaLaunchKernel"},
+      {8, 1, false, "tensorflow::MatMulOp<float>::Compute"},
+      {9, 8, false, "bar"},
+      {10, 9, false, "baz"},
+      {11, 9, true, "/usr/lib/python3.8/x.py::backward"},
+      {12, 1, true, "main.py::compute_loss"},
+      {13, 12, true, "/usr/lib/python3.8/y.py::forward"},
+      {14, 13, true, "model.py::backward"},
+      {15, 14, false, "qux"},
+  };
+  // pruned tree as sorted "id parent id function name" lines
+  std::string expected = "3 1 main.py::forward\n"
+                         "5 3 at::_ops::add::call(x)::add_impl::call(y)\n"
+                         "7 5 cudaLaunchKernel\n"
+                         "8 1 tensorflow::MatMulOp<float>::Compute\n"
+                         "10 8 baz\n"
+                         "11 8 /usr/lib/python3.8/x.py::backward\n"
+                         "12 1 main.py::compute_loss\n"
+                         "14 12 model.py::backward\n"
+                         "15 14 qux\n";
+  CPUCCT golden;
+  std::unordered_map<uint64_t, CPUCCTNode *> id2Node;
+  golden.setRootNode(golden.newNode());
+  golden.root->id = 1;
+  id2Node[1] = golden.root;
+  for (auto &g : goldenNodes) {
+    CPUCCTNode *node =
+        golden.newNode(g.isPy ? CCTNODE_TYPE_PY : CCTNODE_TYPE_CXX);
+    node->id = g.id;
+    node->pc = g.id;
+    node->setFuncName(g.funcName);
+    golden.insertNode(id2Node[g.parentId], node);
+    id2Node[g.id] = node;
+  }
+  CPUCCT *pruned = CPUCCTPruner::PruneTree(&golden);
+  std::map<uint64_t, std::string> lines;
+  pruned->forEachNode([pruned, &lines](CPUCCTNode *node) {
+    if (node != pruned->root)
+      lines[node->id] = std::to_string(node->id) + " " +
+                        std::to_string(pruned->getParent(node)->id) + " " +
+                        node->getFuncName() + "\n";
+  });
+  std::string result;
+  for (auto &itr : lines)
+    result += itr.second;
+  std::cout << "golden: " << (result == expected ? "PASS" : "FAIL") << std::endl;
+  if (result != expected)
+    std::cout << result;
+  delete pruned;
+
+  // benchmark: python-like deep paths, names repeat across levels
+  std::cout << "threads: " << nThreads << ", paths per thread: " << nPaths
+            << ", depth: " << depth << std::endl;
+  const char *funcNames[] = {"main.py::train", "module.py::__call__",
+                             "main.py::forward", "at::_ops::mm::call(a)",
+                             "at::_ops::mm_impl::call(b)", "helper"};
+  CCTMAP_t cctMap;
+  uint64_t nNodes = 0;
+  for (int t = 0; t < nThreads; ++t) {
+    auto cct = new CPUCCT();
+    cct->setRootNode(cct->newNode());
+    cct->root->id = CPUCCTNodeIdAllocator::NextId();
+    for (uint64_t p = 0; p < nPaths; ++p) {
+      CPUCCTNode *parent = cct->root;
+      for (uint64_t l = 0; l < depth; ++l) {
+        uint64_t pc = SyntheticPC(p, l, nPaths, 4);
+        CPUCCTNode *child = cct->getChildbyPC(parent, pc);
+        if (!child) {
+          child = cct->newNode(l % 6 < 3 ? CCTNODE_TYPE_PY : CCTNODE_TYPE_CXX);
+          child->id = CPUCCTNodeIdAllocator::NextId();
+          child->pc = pc;
+          child->setFuncName(funcNames[l % 6]);
+          cct->insertNode(parent, child);
+          ++nNodes;
+        }
+        parent = child;
+      }
+    }
+    cctMap.insert({t, cct});
+  }
+  for (uint32_t nWorkers : {1u, 8u}) {
+    CPUCCTPruner pruner(nWorkers);
+    CCTMAP_t prunedMap;
+    auto timer = Timer::GetGlobalTimer("test_cct_prune");
+    timer->start();
+    pruner.prune(cctMap, prunedMap);
+    timer->stop();
+    uint64_t nPruned = 0;
+    for (auto itr : prunedMap)
+      itr.second->forEachNode([&nPruned](CPUCCTNode *) { ++nPruned; });
+    std::cout << "workers: " << nWorkers << ", nodes: " << nNodes
+              << ", pruned nodes: " << nPruned
+              << ", time: " << timer->getAccumulatedTime() << std::endl;
+    timer->reset();
+  }
+  for (auto itr : cctMap)
+    delete itr.second;
+}
+
+void TestCCTPrunedView(uint64_t nPaths, uint64_t depth) {
+  std::cout << "********** TestCCTPrunedView **********" << std::endl;
+  // golden paths of {python frame, function name}, inserted in order
+  typedef std::vector<std::pair<bool, const char *>> Path;
+  std::vector<Path> goldenPaths = {
+      {{true, "main.py::train"},
+       {true, "main.py::forward"},
+       {false, "foo"},
+       {false, "at::_ops::add::call(x)"},
+       {false, "at::_ops::add_impl::call(y)"},
+       {false, "cudaLaunchKernel"}},
+      {{false, "tensorflow::MatMulOp<float>::Compute"},
+       {false, "bar"},
+       {false, "baz"}},
+      {{false, "tensorflow::MatMulOp<float>::Compute"},
+       {false, "bar"},
+       {true, "/usr/lib/python3.8/x.py::backward"}},
+      {{true, "main.py::compute_loss"},
+       {true, "/usr/lib/python3.8/y.py::forward"},
+       {true, "model.py::backward"},
+       {false, "qux"}},
+  };
+  // view as sorted "function name <- parent function name" lines, the
+  // attributed nodes of the raw tree as "function name -> function name"
+  std::string expected =
+      "/usr/lib/python3.8/x.py::backward <- "
+      "tensorflow::MatMulOp<float>::Compute\n"
+      "/usr/lib/python3.8/y.py::forward -> main.py::compute_loss\n"
+      "at::_ops::add::call(x) <- main.py::forward\n"
+      "at::_ops::add_impl::call(y) <- at::_ops::add::call(x)\n"
+      "bar -> tensorflow::MatMulOp<float>::Compute\n"
+      "baz <- tensorflow::MatMulOp<float>::Compute\n"
+      "cudaLaunchKernel <- at::_ops::add_impl::call(y)\n"
+      "foo -> main.py::forward\n"
+      "main.py::compute_loss <- thread\n"
+      "main.py::forward <- thread\n"
+      "main.py::train -> thread\n"
+      "model.py::backward <- main.py::compute_loss\n"
+      "qux <- model.py::backward\n"
+      "tensorflow::MatMulOp<float>::Compute <- thread\n";
+  auto newTree = []() {
+    auto cct = new CPUCCT();
+    cct->setRootNode(cct->newNode());
+    cct->root->id = CPUCCTNodeIdAllocator::NextId();
+    cct->root->setFuncName("thread");
+    cct->setObserver(new CPUCCTPrunedView(cct));
+    return cct;
+  };
+  auto insertPath = [](CPUCCT *cct, const Path &path) {
+    CPUCCTNode *parent = cct->root;
+    bool inserted = false;
+    for (size_t l = 0; l < path.size(); ++l) {
+      uint64_t pc = std::hash<std::string>()(path[l].second);
+      CPUCCTNode *child = cct->getChildbyPC(parent, pc);
+      if (!child) {
+        child = cct->newNode(path[l].first ? CCTNODE_TYPE_PY : CCTNODE_TYPE_CXX);
+        child->id = CPUCCTNodeIdAllocator::NextId();
+        child->pc = pc;
+        child->setFuncName(path[l].second);
+        cct->insertNode(parent, child);
+        inserted = true;
+      }
+      parent = child;
+    }
+    if (inserted)
+      cct->endPath(parent);
+  };
+
+  CPUCCT *golden = newTree();
+  for (auto &path : goldenPaths)
+    insertPath(golden, path);
+  CPUCCT *view =
+      dynamic_cast<CPUCCTPrunedView *>(golden->getObserver())->getTree();
+  std::set<std::string> lines;
+  view->forEachNode([view, &lines](CPUCCTNode *node) {
+    if (node != view->root)
+      lines.insert(node->getFuncName() + " <- " +
+                   view->getParent(node)->getFuncName() + "\n");
+  });
+  std::unordered_map<uint64_t, std::string> id2FuncName;
+  view->forEachNode([&id2FuncName](CPUCCTNode *node) {
+    id2FuncName[node->id] = node->getFuncName();
+  });
+  golden->forEachNode([golden, &lines, &id2FuncName](CPUCCTNode *node) {
+    uint64_t attributedId = golden->getAttributedId(node);
+    if (attributedId != node->id)
+      lines.insert(node->getFuncName() + " -> " + id2FuncName[attributedId] +
+                   "\n");
+  });
+  std::string result;
+  for (auto &line : lines)
+    result += line;
+  std::cout << "golden: " << (result == expected ? "PASS" : "FAIL") << std::endl;
+  if (result != expected)
+    std::cout << result;
+
+  // pruning the view gives the tree of pruning the whole tree, also after a
+  // C2P node with kept frames below it is renamed to a critical python frame
+  auto prunedLines = [](CPUCCT *pruned) {
+    std::set<std::string> lines;
+    pruned->forEachNode([pruned, &lines](CPUCCTNode *node) {
+      if (node != pruned->root)
+        lines.insert(node->getFuncName() + " <- " +
+                     pruned->getParent(node)->getFuncName());
+    });
+    delete pruned;
+    return lines;
+  };
+  auto samePruning = [&prunedLines](CPUCCT *cct) {
+    CPUCCT *view =
+        dynamic_cast<CPUCCTPrunedView *>(cct->getObserver())->getTree();
+    return prunedLines(CPUCCTPruner::PruneTree(cct)) ==
+           prunedLines(CPUCCTPruner::PruneTree(view, cct));
+  };
+  CPUCCT *renamed = newTree();
+  insertPath(renamed, {{false, "_PyEval_EvalFrameDefault"},
+                       {false, "helper"},
+                       {false, "at::_ops::mm::call(a)"},
+                       {false, "leaf"}});
+  insertPath(renamed, {{false, "_PyEval_EvalFrameDefault"},
+                       {false, "helper"},
+                       {false, "other"}});
+  CPUCCTNode *c2p = renamed->getChildbyPC(
+      renamed->root, std::hash<std::string>()("_PyEval_EvalFrameDefault"));
+  renamed->renameNode(c2p, CCTNODE_TYPE_PY, "main.py::forward");
+  insertPath(renamed, {{false, "_PyEval_EvalFrameDefault"},
+                       {false, "helper"},
+                       {false, "more"}});
+  std::cout << "pruned view: golden: "
+            << (samePruning(golden) ? "PASS" : "FAIL")
+            << ", renamed: " << (samePruning(renamed) ? "PASS" : "FAIL")
+            << std::endl;
+  delete renamed;
+  delete golden;
+
+  // benchmark: the view is ready at export, compare with pruning at export
+  std::cout << "paths: " << nPaths << ", depth: " << depth << std::endl;
+  const char *funcNames[] = {"main.py::train", "module.py::__call__",
+                             "main.py::forward", "at::_ops::mm::call(a)",
+                             "at::_ops::mm_impl::call(b)", "helper"};
+  CPUCCT *cct = newTree();
+  auto insertTimer = Timer::GetGlobalTimer("test_cct_pruned_view_insert");
+  insertTimer->start();
+  for (uint64_t p = 0; p < nPaths; ++p) {
+    CPUCCTNode *parent = cct->root;
+    for (uint64_t l = 0; l < depth; ++l) {
+      uint64_t pc = SyntheticPC(p, l, nPaths, 4);
+      CPUCCTNode *child = cct->getChildbyPC(parent, pc);
+      if (!child) {
+        child = cct->newNode(l % 6 < 3 ? CCTNODE_TYPE_PY : CCTNODE_TYPE_CXX);
+        child->id = CPUCCTNodeIdAllocator::NextId();
+        child->pc = pc;
+        child->setFuncName(funcNames[l % 6]);
+        cct->insertNode(parent, child);
+      }
+      parent = child;
+    }
+    cct->endPath(parent);
+  }
+  insertTimer->stop();
+  view = dynamic_cast<CPUCCTPrunedView *>(cct->getObserver())->getTree();
+  uint64_t nViewNodes = 0;
+  view->forEachNode([&nViewNodes](CPUCCTNode *) { ++nViewNodes; });
+  auto viewTimer = Timer::GetGlobalTimer("test_cct_pruned_view_export");
+  viewTimer->start();
+  delete CPUCCTPruner::PruneTree(view, cct);
+  viewTimer->stop();
+  auto pruneTimer = Timer::GetGlobalTimer("test_cct_pruned_view_prune");
+  pruneTimer->start();
+  CPUCCT *pruned = CPUCCTPruner::PruneTree(cct);
+  pruneTimer->stop();
+  uint64_t nPrunedNodes = 0;
+  pruned->forEachNode([&nPrunedNodes](CPUCCTNode *) { ++nPrunedNodes; });
+  std::cout << "view nodes: " << nViewNodes
+            << ", pruned at export: " << nPrunedNodes
+            << ", insert time: " << insertTimer->getAccumulatedTime()
+            << ", view prune time: " << viewTimer->getAccumulatedTime()
+            << ", prune time: " << pruneTimer->getAccumulatedTime()
+            << std::endl;
+  insertTimer->reset();
+  viewTimer->reset();
+  pruneTimer->reset();
+  delete pruned;
+  delete cct;
+}
+
+void TestProfileFile(uint64_t nPaths, uint64_t depth) {
+  std::cout << "********** TestProfileFile **********" << std::endl;
+  std::cout << "paths: " << nPaths << ", depth: " << depth << std::endl;
+  auto cct = new CPUCCT();
+  cct->setRootNode(cct->newNode());
+  cct->root->id = CPUCCTNodeIdAllocator::NextId();
+  for (uint64_t p = 0; p < nPaths; ++p) {
+    CPUCCTNode *parent = cct->root;
+    for (uint64_t l = 0; l < depth; ++l) {
+      uint64_t pc = SyntheticPC(p, l, nPaths, 16);
+      CPUCCTNode *child = cct->getChildbyPC(parent, pc);
+      if (!child) {
+        child = cct->newNode();
+        child->id = CPUCCTNodeIdAllocator::NextId();
+        child->pc = pc;
+        child->setFuncName("frame_" + std::to_string(l));
+        cct->insertNode(parent, child);
+      }
+      parent = child;
+    }
+  }
+
+  // one GPU sample per node, attributed to the node itself
+  ProfileFileWriter writer;
+  uint32_t treeIdx = writer.addTree(cct->root->id, cct->root->pc);
+  uint64_t nNodes = 0, nRootChilds = cct->root->getNChilds();
+  cct->forEachNode([&](CPUCCTNode *node) {
+    CPUCCTNode *parent = cct->getParent(node);
+    std::vector<uint64_t> childIds;
+    cct->forEachChild(node,
+                      [&childIds](CPUCCTNode *c) { childIds.push_back(c->id); });
+    writer.addNode(treeIdx, node->id, node->pc, node->offset,
+                   parent ? parent->id : 0, node->getSamples(),
+                   writer.addString(node->getFuncName()), childIds);
+    ProfileSampleRecord sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.parentId = node->id;
+    sample.samples = 1;
+    writer.addSample(sample);
+    ++nNodes;
+  });
+  std::string filename = "/tmp/test_profile_file.prof";
+  bool written = writer.write(filename);
+
+  auto timer = Timer::GetGlobalTimer("test_profile_file_open");
+  timer->start();
+  ProfileFileReader reader;
+  bool opened = reader.open(filename);
+  timer->stop();
+  if (!written || !opened) {
+    std::cout << "FAIL: written=" << written << ", opened=" << opened
+              << std::endl;
+    delete cct;
+    return;
+  }
+  const ProfileNodeRecord *root = reader.getNode(cct->root->id);
+  uint64_t nChilds = 0;
+  reader.forEachChild(root, [&nChilds](const ProfileNodeRecord *) { ++nChilds; });
+  const ProfileNodeRecord *leaf = reader.getNodeByIdx(reader.getNNodes() - 1);
+  std::cout << "nodes: " << reader.getNNodes() << "/" << nNodes
+            << ", root childs: " << nChilds << "/" << nRootChilds
+            << ", samples under root: " << reader.getSamplesUnder(root->id)
+            << ", leaf: " << reader.getFuncName(leaf)
+            << ", open time: " << timer->getAccumulatedTime() << std::endl;
+  timer->reset();
+  reader.close();
+
+  // copies of the file with one header field out of range are rejected
+  std::ifstream fin(filename, std::ios::binary);
+  std::string bytes((std::istreambuf_iterator<char>(fin)),
+                    std::istreambuf_iterator<char>());
+  std::vector<std::function<void(ProfileFileHeader *)>> corruptions = {
+      [](ProfileFileHeader *h) { h->headerSize = 0; },
+      [](ProfileFileHeader *h) { h->nodesOffset = h->fileSize; },
+      [](ProfileFileHeader *h) { h->nNodes = UINT64_MAX / 8; },
+      [](ProfileFileHeader *h) { h->childsOffset += 4; },
+      [](ProfileFileHeader *h) { h->nStrings = UINT64_MAX; },
+      [](ProfileFileHeader *h) { h->stringDataOffset = UINT64_MAX - 7; },
+      [](ProfileFileHeader *h) { h->samplesOffset = 0; },
+      [](ProfileFileHeader *h) { h->fileSize += 8; },
+  };
+  uint64_t rejected = 0;
+  for (auto &corrupt : corruptions) {
+    std::string copy = bytes;
+    corrupt(reinterpret_cast<ProfileFileHeader *>(&copy[0]));
+    std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+    fout.write(copy.data(), copy.size());
+    fout.close();
+    ProfileFileReader corrupted;
+    rejected += !corrupted.open(filename);
+  }
+  std::cout << "corrupted headers rejected: " << rejected << "/"
+            << corruptions.size() << std::endl;
+
+  // a child index pointing back to the root makes a cycle, which the walk of
+  // getSamplesUnder stops
+  {
+    std::string copy = bytes;
+    auto header = reinterpret_cast<ProfileFileHeader *>(&copy[0]);
+    auto nodes =
+        reinterpret_cast<ProfileNodeRecord *>(&copy[header->nodesOffset]);
+    auto childIdxs = reinterpret_cast<uint32_t *>(&copy[header->childsOffset]);
+    uint32_t rootIdx = 0;
+    while (nodes[rootIdx].id != cct->root->id)
+      ++rootIdx;
+    childIdxs[nodes[rootIdx].childBegin] = rootIdx;
+    std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+    fout.write(copy.data(), copy.size());
+    fout.close();
+    ProfileFileReader cyclic;
+    uint64_t samples = cyclic.open(filename)
+                           ? cyclic.getSamplesUnder(cct->root->id)
+                           : UINT64_MAX;
+    std::cout << "samples under cyclic root: " << samples << " (at most "
+              << nNodes << ")" << std::endl;
+  }
+  delete cct;
+  unlink(filename.c_str());
+}
+
 void TestCPUCallStackSampler() {
   if (mainPid < 0)
     std::cerr << "main pid not initialized" << std::endl;
   auto cpuSampler = GetOrCreateCPUCallStackSampler(mainPid);
   cpuSampler->EnableSampling();
   while (samplingStarted) {
-    CPUCallStackSampler::CallStack callStack;
+    std::vector<CPUCallStackSampler::CallStack> callStacks;
     int ret = cpuSampler->CollectData(GetProfilerConf()->cpuSamplingTimeout,
                                       GetProfilerConf()->cpuSamplingMaxDepth,
-                                      callStack);
-    printf("ret=%d\n", ret);
-    if (ret == 0) {
+                                      callStacks);
+    printf("ret=%d, samples=%lu\n", ret, callStacks.size());
+    for (auto &callStack : callStacks) {
       printf("time=%lu\n", callStack.time);
       printf("pid,tid=%d,%d\n", callStack.pid, callStack.tid);
       printf("stack:\n");
       for (int j = 0; j < callStack.depth; ++j) {
-        printf("[%d]    %s:%lx\n", j, callStack.fnames[j].c_str(),
+        printf("[%d]    %s:%lx\n", j,
+               GetSymbol(callStack.symbols[j].funcNameId).c_str(),
                callStack.pcs[j]);
       }
     }
   }
-  std::cout << "sampling stopped" << std::endl;
+  std::cout << "sampling stopped, samples: " << cpuSampler->GetSamples()
+            << ", lost samples: " << cpuSampler->GetLostSamples()
+            << std::endl;
   delete cpuSampler;
 }
 
+// names of callchain pcs as the cpu sampler took them before the pc symbol
+// cache
+static std::string LegacyParseBTSymbol(std::string rawStr) {
+  std::string s;
+  if (rawStr.length() && rawStr[0] != '[') {
+    auto pos1 = rawStr.find('(');
+    auto pos2 = rawStr.find('+');
+    if (pos2 - pos1 > 1) {
+      auto rawFuncName = rawStr.substr(pos1 + 1, pos2 - pos1 - 1);
+      char *realFuncName;
+      int status = 99;
+      if ((realFuncName = abi::__cxa_demangle(rawFuncName.c_str(), nullptr,
+                                              nullptr, &status)) != 0) {
+        s = std::string(realFuncName);
+        free(realFuncName);
+      } else {
+        s = rawFuncName;
+      }
+    }
+  }
+  return s;
+}
+
+static std::vector<std::string> LegacyCallStackSymbols(const uint64_t *stack,
+                                                       uint64_t depth) {
+  std::vector<void *> stackPointers;
+  for (uint64_t i = 0; i < depth; ++i)
+    stackPointers.push_back((void *)stack[i]);
+  std::vector<std::string> ret;
+  char **symbols = backtrace_symbols(stackPointers.data(), depth);
+  if (symbols) {
+    for (uint64_t i = 0; i < depth; ++i)
+      ret.push_back(LegacyParseBTSymbol(std::string(symbols[i])));
+  }
+  free(symbols);
+  return ret;
+}
+
+void TestCallChainSymbolsRecursive(int depth, int nRounds) {
+  if (depth > 0) {
+    TestCallChainSymbolsRecursive(depth - 1, nRounds);
+    // not a tail call, every level keeps its frame
+    asm volatile("" ::: "memory");
+    return;
+  }
+  // a callchain as written by perf: kernel frames, then user frames
+  uint64_t pcs[MAX_UNWIND_DEPTH];
+  size_t n = Unwinder::GetUnwinder("cursor")->unwind(pcs, MAX_UNWIND_DEPTH);
+  std::vector<uint64_t> chain = {(uint64_t)PERF_CONTEXT_KERNEL,
+                                 0xffffffff81000010ull, 0xffffffff81000020ull,
+                                 (uint64_t)PERF_CONTEXT_USER};
+  chain.insert(chain.end(), pcs, pcs + n);
+
+  CPUCallStackSampler::CallStack callStack;
+  CPUCallStackSampler::SymbolizeCallChain(chain.data(), chain.size(),
+                                          MAX_UNWIND_DEPTH, callStack);
+  std::vector<std::string> legacy = LegacyCallStackSymbols(pcs, n);
+  uint64_t nSkipped = 0, nNamed = 0, nMatches = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (i >= callStack.depth || callStack.pcs[i] != pcs[i]) {
+      ++nSkipped;
+      continue;
+    }
+    if (legacy[i].empty() || callStack.symbols[i].excluded)
+      continue;
+    ++nNamed;
+    nMatches += GetSymbol(callStack.symbols[i].funcNameId) == legacy[i];
+  }
+
+  // a raw chain symbolized after draining, as by the sampler collection
+  CPUCallStackSampler::CallStack raw;
+  raw.pcs = chain;
+  CPUCallStackSampler::SymbolizeCallStack(MAX_UNWIND_DEPTH, raw);
+  bool sameAsRaw = raw.pcs == callStack.pcs;
+  for (size_t i = 0; sameAsRaw && i < raw.symbols.size(); ++i)
+    sameAsRaw = raw.symbols[i].funcNameId == callStack.symbols[i].funcNameId;
+
+  Timer legacyTimer, cachedTimer;
+  for (int r = 0; r < nRounds; ++r) {
+    legacyTimer.start();
+    LegacyCallStackSymbols(pcs, n);
+    legacyTimer.stop();
+    cachedTimer.start();
+    CPUCallStackSampler::CallStack cached;
+    CPUCallStackSampler::SymbolizeCallChain(chain.data(), chain.size(),
+                                            MAX_UNWIND_DEPTH, cached);
+    cachedTimer.stop();
+  }
+  std::cout << "user frames: " << n << ", kept: " << callStack.depth
+            << ", lost: " << nSkipped << ", named by backtrace_symbols: "
+            << nNamed << ", same names: " << nMatches
+            << ", symbolized after draining: " << sameAsRaw << std::endl;
+  std::cout << "backtrace_symbols time: " << legacyTimer.getAccumulatedTime()
+            << ", symbol cache time: " << cachedTimer.getAccumulatedTime()
+            << std::endl;
+}
+
+void TestCallChainSymbols(int depth, int nRounds) {
+  std::cout << "********** TestCallChainSymbols **********" << std::endl;
+  std::cout << "depth: " << depth << ", rounds: " << nRounds << std::endl;
+  TestCallChainSymbolsRecursive(depth, nRounds);
+}
+
+void TestCPUSampleAggregator(int nThreads, uint64_t nStacks,
+                             uint64_t nSamples, uint64_t depth) {
+  std::cout << "********** TestCPUSampleAggregator **********" << std::endl;
+  std::cout << "threads: " << nThreads << ", stacks: " << nStacks
+            << ", samples: " << nSamples << ", depth: " << depth << std::endl;
+  // the same few stacks sampled over and over on every thread
+  std::vector<CPUCallStackSampler::CallStack> samples(nSamples);
+  for (uint64_t i = 0; i < nSamples; ++i) {
+    CPUCallStackSampler::CallStack &callStack = samples[i];
+    uint64_t path = (i * 7919) % nStacks;
+    callStack.tid = 1 + i % nThreads;
+    callStack.depth = depth;
+    for (uint64_t l = depth; l-- > 0;)
+      callStack.pcs.push_back(SyntheticPC(path, l, nStacks, 4));
+    callStack.symbols.resize(depth);
+  }
+
+  // walks the tree of the thread from the root as UpdateCCT does
+  std::unordered_map<pid_t, CPUCCT *> ccts;
+  uint64_t nextId = 1, nApplied = 0;
+  auto update = [&](pid_t tid, CPUCallStackSampler::CallStack &callStack,
+                    uint64_t count) {
+    CPUCCT *&cct = ccts[tid];
+    if (!cct) {
+      cct = new CPUCCT();
+      CPUCCTNode *root = cct->newNode();
+      root->pc = 0;
+      root->id = nextId++;
+      cct->setRootNode(root);
+    }
+    CPUCCTNode *parent = cct->root;
+    for (uint64_t l = callStack.depth; l-- > 0;) {
+      CPUCCTNode *child = cct->getChildbyPC(parent, callStack.pcs[l]);
+      if (!child) {
+        child = cct->newNode();
+        child->id = nextId++;
+        child->pc = callStack.pcs[l];
+        child->addSamples(count - 1);
+        cct->insertNode(parent, child);
+      } else {
+        child->addSamples(count);
+      }
+      parent = child;
+    }
+    ++nApplied;
+  };
+  auto leafSamples = [&]() {
+    uint64_t n = 0;
+    for (auto &itr : ccts)
+      itr.second->forEachChild(itr.second->root, [&n](CPUCCTNode *child) {
+        n += child->getSamples();
+      });
+    return n;
+  };
+
+  Timer perSampleTimer, aggregatedTimer;
+  perSampleTimer.start();
+  for (auto &callStack : samples)
+    update(callStack.tid, callStack, 1);
+  perSampleTimer.stop();
+  uint64_t perSampleWalks = nApplied, perSampleCount = leafSamples();
+
+  // rounds of 256 samples, a window spanning all of them
+  for (auto &itr : ccts)
+    delete itr.second;
+  ccts.clear();
+  nApplied = 0;
+  CPUSampleAggregator aggregator(1000000);
+  std::vector<CPUCallStackSampler::CallStack> round;
+  for (uint64_t i = 0; i < nSamples; i += 256) {
+    round.assign(samples.begin() + i,
+                 samples.begin() + std::min(i + 256, nSamples));
+    aggregatedTimer.start();
+    for (auto &callStack : round)
+      aggregator.add(callStack);
+    aggregatedTimer.stop();
+  }
+  aggregatedTimer.start();
+  aggregator.flush(update);
+  aggregatedTimer.stop();
+  std::cout << "per sample: walks: " << perSampleWalks
+            << ", samples in cct: " << perSampleCount
+            << ", time: " << perSampleTimer.getElapsedTime() << std::endl;
+  std::cout << "aggregated: walks: " << nApplied
+            << ", samples in cct: " << leafSamples()
+            << ", time: " << aggregatedTimer.getAccumulatedTime() << std::endl;
+  for (auto &itr : ccts)
+    delete itr.second;
+}
+
+void TestCPUSamplerCollection(int nIdle, int nRounds) {
+  std::cout << "********** TestCPUSamplerCollection **********" << std::endl;
+  std::cout << "idle threads: " << nIdle << ", rounds: " << nRounds
+            << std::endl;
+  // a busy thread and idle ones sampled every ms, collected with no timeout
+  int32_t timeout = GetProfilerConf()->cpuSamplingTimeout;
+  uint64_t period = GetProfilerConf()->cpuSamplingPeriod;
+  GetProfilerConf()->cpuSamplingTimeout = -1;
+  GetProfilerConf()->cpuSamplingPeriod = 1000000;
+  CPUCallStackSamplerCollection collection;
+  std::atomic<bool> stop(false);
+  std::atomic<int> nRegistered(0);
+  std::vector<std::thread> threads;
+  std::vector<pid_t> tids(nIdle + 1);
+  for (int t = 0; t <= nIdle; ++t) {
+    threads.emplace_back([&, t]() {
+      tids[t] = gettid();
+      collection.RegisterSampler(tids[t]);
+      ++nRegistered;
+      volatile uint64_t x = 0;
+      while (!stop) {
+        if (t)
+          usleep(1000);
+        else
+          for (int i = 0; i < 100000; ++i)
+            x = x + i;
+      }
+    });
+  }
+  while (nRegistered <= nIdle)
+    usleep(100);
+  collection.EnableSampling();
+
+  std::vector<CPUCallStackSampler::CallStack> callStacks;
+  Timer roundTimer;
+  uint64_t maxRoundUs = 0, nSamples = 0, nBusySamples = 0;
+  for (int r = 0; r < nRounds; ++r) {
+    roundTimer.start();
+    collection.CollectData(callStacks);
+    roundTimer.stop();
+    maxRoundUs = std::max(maxRoundUs, roundTimer.getElapsedTimeInt());
+    nSamples += callStacks.size();
+    for (auto &callStack : callStacks)
+      nBusySamples += callStack.tid == (uint32_t)tids[0];
+  }
+
+  // disabling sampling wakes a collection waiting for ever
+  std::thread waiter([&]() {
+    collection.CollectData(callStacks);
+    collection.CollectData(callStacks);
+  });
+  usleep(10000);
+  Timer wakeupTimer;
+  wakeupTimer.start();
+  collection.DisableSampling();
+  for (auto tid : tids)
+    collection.DeleteSampler(tid);
+  waiter.join();
+  wakeupTimer.stop();
+  stop = true;
+  for (auto &thread : threads)
+    thread.join();
+  GetProfilerConf()->cpuSamplingTimeout = timeout;
+  GetProfilerConf()->cpuSamplingPeriod = period;
+
+  std::cout << "samples: " << nSamples << ", of the busy thread: "
+            << nBusySamples << ", max round: " << maxRoundUs << " us"
+            << std::endl;
+  std::cout << "wakeup after disabling: " << wakeupTimer.getElapsedTimeInt()
+            << " us, samples: " << collection.GetSamples() << std::endl;
+}
+
+void TestCPUSamplerPerCPU(int nThreads, int nRounds) {
+  std::cout << "********** TestCPUSamplerPerCPU **********" << std::endl;
+  std::cout << "threads: " << nThreads << ", rounds: " << nRounds
+            << std::endl;
+  int32_t timeout = GetProfilerConf()->cpuSamplingTimeout;
+  uint64_t period = GetProfilerConf()->cpuSamplingPeriod;
+  GetProfilerConf()->cpuSamplingTimeout = 100;
+  GetProfilerConf()->cpuSamplingPeriod = 1000000;
+  std::atomic<bool> stop(false);
+  std::mutex tidsMutex;
+  std::set<pid_t> tids;
+  auto busy = [&]() {
+    {
+      std::lock_guard<std::mutex> lock(tidsMutex);
+      tids.insert(gettid());
+    }
+    volatile uint64_t x = 0;
+    while (!stop)
+      for (int i = 0; i < 100000; ++i)
+        x = x + i;
+  };
+
+  // a thread alive at registration, which needs a sampler of its own, and
+  // threads created afterwards, which are covered by the per-cpu samplers
+  std::vector<std::thread> threads;
+  threads.emplace_back(busy);
+  for (bool started = false; !started; usleep(100)) {
+    std::lock_guard<std::mutex> lock(tidsMutex);
+    started = !tids.empty();
+  }
+  CPUCallStackSamplerCollection collection;
+  if (!collection.RegisterProcess()) {
+    std::cout << "per-cpu sampling not available" << std::endl;
+    stop = true;
+    threads[0].join();
+    GetProfilerConf()->cpuSamplingTimeout = timeout;
+    GetProfilerConf()->cpuSamplingPeriod = period;
+    return;
+  }
+  pid_t uncoveredTid = *tids.begin();
+  bool uncovered = collection.NeedsThreadSampler(uncoveredTid);
+  if (uncovered)
+    collection.RegisterSampler(uncoveredTid);
+  for (int t = 1; t < nThreads; ++t)
+    threads.emplace_back(busy);
+  for (bool started = false; !started; usleep(100)) {
+    std::lock_guard<std::mutex> lock(tidsMutex);
+    started = tids.size() == (size_t)nThreads;
+  }
+  int nCovered = 0;
+  for (pid_t tid : tids)
+    nCovered += !collection.NeedsThreadSampler(tid);
+  collection.EnableSampling();
+
+  std::vector<CPUCallStackSampler::CallStack> callStacks;
+  std::unordered_map<pid_t, uint64_t> tidSamples;
+  uint64_t nSamples = 0;
+  for (int r = 0; r < nRounds; ++r) {
+    collection.CollectData(callStacks);
+    nSamples += callStacks.size();
+    for (auto &callStack : callStacks)
+      ++tidSamples[callStack.tid];
+  }
+  collection.DisableSampling();
+  stop = true;
+  for (auto &thread : threads)
+    thread.join();
+  GetProfilerConf()->cpuSamplingTimeout = timeout;
+  GetProfilerConf()->cpuSamplingPeriod = period;
+
+  int nSampledThreads = 0;
+  for (pid_t tid : tids)
+    nSampledThreads += tidSamples.count(tid);
+  std::cout << "alive at registration needs a sampler: " << uncovered
+            << ", created later covered: " << nCovered << "/"
+            << nThreads - 1 << std::endl;
+  std::cout << "samples: " << nSamples << ", threads sampled: "
+            << tidSamples.size() << ", busy threads sampled: "
+            << nSampledThreads << "/" << tids.size()
+            << ", lost samples: " << collection.GetLostSamples() << std::endl;
+}
+
 int main(int argc, char **argv) {
   if (argc > 1)
     verbose = std::atoi(argv[2]);
@@ -127,6 +2327,30 @@ int main(int argc, char **argv) {
   TestBackTracerOverheadR1(std::atoi(argv[1]));
   TestBackTracerOverheadR2(std::atoi(argv[1]));
   TestCppStackPointer();
+  TestPCSymbolCache(8, 32, 64);
+  TestElfSymbolizer(32, 64);
+  TestUnwinders(std::atoi(argv[1]));
+  TestModuleFilter(64, 10000);
+  TestStackSignatureCache(64);
+  TestPySourceCache(2048, 16);
+  TestPyFrameCache(32, 64);
+  TestMainPyStack(32, 100000);
+  TestFrameClassifier(32, 1000);
+  TestCCTBuilder(4, 4096, 64);
+  TestCPUSamplerCollection(8, 200);
+  TestCallChainSymbols(32, 1000);
+  TestCPUSampleAggregator(4, 256, 1 << 18, 32);
+  TestCPUSamplerPerCPU(4, 400);
+  TestCCTArenaBenchmark(4096, 128, 2);
+  TestCCTArenaBenchmark(4096, 128, 16);
+  TestCCTRegistryConcurrent(16, 1024, 64);
+  TestCCTNodeIdBenchmark(16, 1024, 64);
+  TestSymbolTable(16, 4096);
+  TestCCTDeltaExport(4096, 128, 16);
+  TestCCTMerge(64, 256, 64);
+  TestCCTPruner(16, 256, 256);
+  TestCCTPrunedView(4096, 256);
+  TestProfileFile(4096, 64);
   samplingStarted = false;
   if (testCPUCallStackSamplerThreadHandle.joinable()) {
     testCPUCallStackSamplerThreadHandle.join();
@@ -4,24 +4,36 @@ class GPUProfilingClient {
 public:
 	GPUProfilingClient(std::shared_ptr<Channel> channel)
 		:stub_(GPUProfilingService::NewStub(channel)) {}
-	std::string IssuePCSampling(uint32_t duration) {
-		GPUProfilingRequest request;
-		request.set_duration(duration);
+	// issue rounds requests, the first one returns the whole cpu ccts and every
+	// following one only the changes since the previous response
+	std::string IssuePCSampling(uint32_t duration, uint32_t rounds) {
+		GPUProfilingResponse merged;
+		for (uint32_t i = 0; i < rounds; ++i) {
+			GPUProfilingRequest request;
+			request.set_duration(duration);
+			request.set_sinceepoch(merged.epoch());
 
-		GPUProfilingResponse response;
+			GPUProfilingResponse response;
 
-		ClientContext context;
+			ClientContext context;
 
-		Status status = stub_->PerformGPUProfiling(&context, request, &response);
+			Status status = stub_->PerformGPUProfiling(&context, request, &response);
 
-		if (status.ok()) {
-			PrintSamplingResults(response);
-			DumpSamplingResults(response, "data/test.dat");
-			return response.message();
-		} else {
-			std::cout << status.error_code() << ": " << status.error_message() << std::endl;
-			return "RPC failed";
+			if (status.ok()) {
+				std::cout << "round " << i << ": " << response.message() << ", epoch=" << response.epoch()
+						  << ", response size=" << response.ByteSizeLong() << std::endl;
+				if (i == 0)
+					merged = response;
+				else
+					MergeCCTDelta(merged, response);
+			} else {
+				std::cout << status.error_code() << ": " << status.error_message() << std::endl;
+				return "RPC failed";
+			}
 		}
+		PrintSamplingResults(merged);
+		DumpSamplingResults(merged, "data/test.dat");
+		return merged.message();
 	}
 
 private:
@@ -31,13 +43,27 @@ private:
 int main(int argc, char** argv) {
 	std::string target_str = "localhost:8886";
 	uint32_t duration = 2000;
+	uint32_t rounds = 1;
+	if (argc == 3 && std::string(argv[1]) == "--load") {
+		// print a dumped response of either DUMP_FORMAT instead of profiling
+		GPUProfilingResponse response;
+		if (!LoadSamplingResults(response, argv[2])) {
+			std::cerr << "failed to load " << argv[2] << std::endl;
+			exit(-1);
+		}
+		PrintSamplingResults(response);
+		return 0;
+	}
 	if (argc > 1) {
-		if (argc != 3) {
-			std::cerr << "usage: ./client_cpp <address> <duration>" << std::endl;
+		if (argc != 3 && argc != 4) {
+			std::cerr << "usage: ./client_cpp <address> <duration> [<rounds>]" << std::endl;
+			std::cerr << "       ./client_cpp --load <file>" << std::endl;
 			exit(-1);
 		}
 		target_str = argv[1];
 		duration = std::strtoul(argv[2], nullptr, 10);
+		if (argc == 4)
+			rounds = std::strtoul(argv[3], nullptr, 10);
 	}
 	grpc::ChannelArguments arg;
 	arg.SetMaxReceiveMessageSize(1024 * 1024 * 64);
@@ -45,7 +71,7 @@ int main(int argc, char** argv) {
 	GPUProfilingClient client(
 		grpc::CreateCustomChannel(target_str, grpc::InsecureChannelCredentials(), arg)
 	);
-	std::string response = client.IssuePCSampling(duration);
+	std::string response = client.IssuePCSampling(duration, rounds);
 	std::cout << "Client received: " << response << std::endl;
 
 	return 0;
@@ -0,0 +1,394 @@
+#pragma once
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// On-disk profile laid out to be used through mmap with no deserialization.
+//
+//   ProfileFileHeader
+//   ProfileTreeRecord   trees[nTrees]
+//   ProfileNodeRecord   nodes[nNodes]       sorted by id
+//   uint32_t            childIdxs[nChilds]  indices into nodes
+//   uint64_t            stringOffsets[nStrings + 1]
+//   char                stringData[]        NUL-terminated strings
+//   ProfileSampleRecord samples[nSamples]   sorted by parentId
+//
+// Every section starts at an offset aligned to 8 bytes, all integers are in
+// the byte order of the writer.
+#define PROFILE_FILE_MAGIC "SAMPROF"
+#define PROFILE_FILE_VERSION 1
+
+struct ProfileFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t epoch;
+  uint64_t nTrees, treesOffset;
+  uint64_t nNodes, nodesOffset;
+  uint64_t nChilds, childsOffset;
+  uint64_t nStrings, stringOffsetsOffset, stringDataOffset;
+  uint64_t nSamples, samplesOffset;
+  uint64_t fileSize;
+};
+
+struct ProfileTreeRecord {
+  uint64_t rootId;
+  uint64_t rootPC;
+};
+
+struct ProfileNodeRecord {
+  uint64_t id;
+  uint64_t pc;
+  uint64_t offset;
+  uint64_t parentId;
+  uint64_t samples;
+  // children are childIdxs[childBegin, childBegin + nChilds)
+  uint64_t childBegin;
+  uint32_t nChilds;
+  uint32_t funcNameId;
+  uint32_t treeIdx;
+  uint32_t pad;
+};
+
+// one GPU pc sample per stall reason
+struct ProfileSampleRecord {
+  uint64_t parentId;
+  uint64_t cubinCrc;
+  uint64_t pcOffset;
+  uint32_t functionNameId;
+  uint32_t stallReasonIndex;
+  uint32_t samples;
+  uint32_t correlationId;
+};
+
+class ProfileFileWriter {
+public:
+  ProfileFileWriter() : epoch(0) { addString(""); };
+
+  void setEpoch(uint64_t _epoch) { epoch = _epoch; }
+
+  uint32_t addString(const std::string &str) {
+    auto itr = string2Id.find(str);
+    if (itr != string2Id.end())
+      return itr->second;
+    uint32_t id = strings.size();
+    strings.push_back(str);
+    string2Id.insert(std::make_pair(str, id));
+    return id;
+  }
+
+  uint32_t addTree(uint64_t rootId, uint64_t rootPC) {
+    trees.push_back({rootId, rootPC});
+    return trees.size() - 1;
+  }
+
+  void addNode(uint32_t treeIdx, uint64_t id, uint64_t pc, uint64_t offset,
+               uint64_t parentId, uint64_t samples, uint32_t funcNameId,
+               const std::vector<uint64_t> &childIds) {
+    ProfileNodeRecord node;
+    memset(&node, 0, sizeof(node));
+    node.id = id;
+    node.pc = pc;
+    node.offset = offset;
+    node.parentId = parentId;
+    node.samples = samples;
+    node.funcNameId = funcNameId;
+    node.treeIdx = treeIdx;
+    nodes.push_back(node);
+    nodeChildIds.push_back(childIds);
+  }
+
+  void addSample(const ProfileSampleRecord &sample) {
+    samples.push_back(sample);
+  }
+
+  bool write(const std::string &filename) {
+    // sort the nodes by id, keeping their child lists aligned
+    std::vector<uint32_t> order(nodes.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+      order[i] = i;
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+      return nodes[a].id < nodes[b].id;
+    });
+    std::vector<ProfileNodeRecord> sortedNodes;
+    std::unordered_map<uint64_t, uint32_t> id2Idx;
+    for (uint32_t i : order) {
+      id2Idx[nodes[i].id] = sortedNodes.size();
+      sortedNodes.push_back(nodes[i]);
+    }
+    std::vector<uint32_t> childIdxs;
+    for (uint32_t i = 0; i < order.size(); ++i) {
+      ProfileNodeRecord &node = sortedNodes[i];
+      node.childBegin = childIdxs.size();
+      for (uint64_t childId : nodeChildIds[order[i]]) {
+        auto itr = id2Idx.find(childId);
+        if (itr != id2Idx.end())
+          childIdxs.push_back(itr->second);
+      }
+      node.nChilds = childIdxs.size() - node.childBegin;
+    }
+
+    std::sort(samples.begin(), samples.end(),
+              [](const ProfileSampleRecord &a, const ProfileSampleRecord &b) {
+                return a.parentId < b.parentId;
+              });
+
+    std::vector<uint64_t> stringOffsets = {0};
+    for (auto &str : strings)
+      stringOffsets.push_back(stringOffsets.back() + str.size() + 1);
+
+    ProfileFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PROFILE_FILE_MAGIC, sizeof(PROFILE_FILE_MAGIC));
+    header.version = PROFILE_FILE_VERSION;
+    header.headerSize = sizeof(header);
+    header.epoch = epoch;
+    uint64_t offset = align(sizeof(header));
+    header.nTrees = trees.size();
+    header.treesOffset = offset;
+    offset = align(offset + trees.size() * sizeof(ProfileTreeRecord));
+    header.nNodes = sortedNodes.size();
+    header.nodesOffset = offset;
+    offset = align(offset + sortedNodes.size() * sizeof(ProfileNodeRecord));
+    header.nChilds = childIdxs.size();
+    header.childsOffset = offset;
+    offset = align(offset + childIdxs.size() * sizeof(uint32_t));
+    header.nStrings = strings.size();
+    header.stringOffsetsOffset = offset;
+    offset = align(offset + stringOffsets.size() * sizeof(uint64_t));
+    header.stringDataOffset = offset;
+    offset = align(offset + stringOffsets.back());
+    header.nSamples = samples.size();
+    header.samplesOffset = offset;
+    offset = offset + samples.size() * sizeof(ProfileSampleRecord);
+    header.fileSize = offset;
+
+    std::ofstream fout(filename, std::ios::out | std::ios::binary);
+    if (!fout.is_open())
+      return false;
+    writeSection(fout, 0, &header, sizeof(header));
+    writeSection(fout, header.treesOffset, trees.data(),
+                 trees.size() * sizeof(ProfileTreeRecord));
+    writeSection(fout, header.nodesOffset, sortedNodes.data(),
+                 sortedNodes.size() * sizeof(ProfileNodeRecord));
+    writeSection(fout, header.childsOffset, childIdxs.data(),
+                 childIdxs.size() * sizeof(uint32_t));
+    writeSection(fout, header.stringOffsetsOffset, stringOffsets.data(),
+                 stringOffsets.size() * sizeof(uint64_t));
+    pad(fout, header.stringDataOffset);
+    for (auto &str : strings)
+      fout.write(str.c_str(), str.size() + 1);
+    writeSection(fout, header.samplesOffset, samples.data(),
+                 samples.size() * sizeof(ProfileSampleRecord));
+    return fout.good();
+  }
+
+private:
+  static uint64_t align(uint64_t offset) { return (offset + 7) & ~7ull; }
+
+  static void pad(std::ofstream &fout, uint64_t offset) {
+    while ((uint64_t)fout.tellp() < offset)
+      fout.put(0);
+  }
+
+  static void writeSection(std::ofstream &fout, uint64_t offset,
+                           const void *data, size_t size) {
+    pad(fout, offset);
+    fout.write((const char *)data, size);
+  }
+
+  uint64_t epoch;
+  std::vector<std::string> strings;
+  std::unordered_map<std::string, uint32_t> string2Id;
+  std::vector<ProfileTreeRecord> trees;
+  std::vector<ProfileNodeRecord> nodes;
+  std::vector<std::vector<uint64_t>> nodeChildIds;
+  std::vector<ProfileSampleRecord> samples;
+};
+
+// Read-only view of a profile file. Opening it maps the file and checks that
+// the header and every section lie within the mapping, queries read the
+// mapped tables directly and skip child and string indices out of range.
+class ProfileFileReader {
+public:
+  ProfileFileReader()
+      : base(nullptr), size(0), header(nullptr), stringDataSize(0){};
+  ~ProfileFileReader() { close(); }
+
+  ProfileFileReader(const ProfileFileReader &) = delete;
+  ProfileFileReader &operator=(const ProfileFileReader &) = delete;
+
+  bool open(const std::string &filename) {
+    close();
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ProfileFileHeader)) {
+      ::close(fd);
+      return false;
+    }
+    void *mem = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED)
+      return false;
+    base = (const uint8_t *)mem;
+    size = st.st_size;
+    header = (const ProfileFileHeader *)base;
+    if (!validate()) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (base)
+      munmap((void *)base, size);
+    base = nullptr;
+    size = 0;
+    header = nullptr;
+    stringDataSize = 0;
+  }
+
+  const ProfileFileHeader *getHeader() { return header; }
+
+  uint64_t getNTrees() { return header->nTrees; }
+
+  const ProfileTreeRecord *getTree(uint64_t i) {
+    return &table<ProfileTreeRecord>(header->treesOffset)[i];
+  }
+
+  uint64_t getNNodes() { return header->nNodes; }
+
+  const ProfileNodeRecord *getNodeByIdx(uint64_t idx) {
+    return &table<ProfileNodeRecord>(header->nodesOffset)[idx];
+  }
+
+  // nullptr if there is no node with id
+  const ProfileNodeRecord *getNode(uint64_t id) {
+    const ProfileNodeRecord *begin = table<ProfileNodeRecord>(header->nodesOffset);
+    const ProfileNodeRecord *end = begin + header->nNodes;
+    const ProfileNodeRecord *node = std::lower_bound(
+        begin, end, id,
+        [](const ProfileNodeRecord &n, uint64_t id) { return n.id < id; });
+    return node != end && node->id == id ? node : nullptr;
+  }
+
+  template <typename F> void forEachChild(const ProfileNodeRecord *node, F f) {
+    if (node->childBegin > header->nChilds ||
+        node->nChilds > header->nChilds - node->childBegin)
+      return;
+    const uint32_t *childIdxs = table<uint32_t>(header->childsOffset);
+    for (uint64_t i = node->childBegin; i < node->childBegin + node->nChilds;
+         ++i)
+      if (childIdxs[i] < header->nNodes)
+        f(getNodeByIdx(childIdxs[i]));
+  }
+
+  const char *getString(uint32_t id) {
+    if (id >= header->nStrings)
+      return "";
+    const uint64_t *offsets = table<uint64_t>(header->stringOffsetsOffset);
+    // the string data ends with a NUL, see validate
+    if (offsets[id] >= stringDataSize)
+      return "";
+    return (const char *)base + header->stringDataOffset + offsets[id];
+  }
+
+  const char *getFuncName(const ProfileNodeRecord *node) {
+    return getString(node->funcNameId);
+  }
+
+  // GPU samples whose parent is node id, as [first, second)
+  std::pair<const ProfileSampleRecord *, const ProfileSampleRecord *>
+  getSamples(uint64_t id) {
+    const ProfileSampleRecord *begin =
+        table<ProfileSampleRecord>(header->samplesOffset);
+    const ProfileSampleRecord *end = begin + header->nSamples;
+    auto first = std::lower_bound(
+        begin, end, id,
+        [](const ProfileSampleRecord &s, uint64_t id) { return s.parentId < id; });
+    auto last = std::upper_bound(
+        first, end, id,
+        [](uint64_t id, const ProfileSampleRecord &s) { return id < s.parentId; });
+    return std::make_pair(first, last);
+  }
+
+  // sum of the GPU samples attributed to the subtree of node id, a corrupted
+  // file whose children form a cycle stops after nNodes visits
+  uint64_t getSamplesUnder(uint64_t id) {
+    const ProfileNodeRecord *node = getNode(id);
+    if (!node)
+      return 0;
+    uint64_t total = 0, nVisits = 0;
+    std::vector<const ProfileNodeRecord *> toVisit = {node};
+    while (!toVisit.empty() && nVisits++ < header->nNodes) {
+      node = toVisit.back();
+      toVisit.pop_back();
+      auto range = getSamples(node->id);
+      for (auto sample = range.first; sample != range.second; ++sample)
+        total += sample->samples;
+      forEachChild(node, [&toVisit](const ProfileNodeRecord *child) {
+        toVisit.push_back(child);
+      });
+    }
+    return total;
+  }
+
+private:
+  template <typename T> const T *table(uint64_t offset) {
+    return (const T *)(base + offset);
+  }
+
+  // count records of recordSize at offset lie between the header and the end
+  // of the file, with no overflow
+  bool sectionFits(uint64_t offset, uint64_t count, uint64_t recordSize) {
+    return offset % 8 == 0 && offset >= header->headerSize &&
+           offset <= header->fileSize &&
+           count <= (header->fileSize - offset) / recordSize;
+  }
+
+  bool validate() {
+    if (memcmp(header->magic, PROFILE_FILE_MAGIC, sizeof(PROFILE_FILE_MAGIC)) ||
+        header->version != PROFILE_FILE_VERSION ||
+        header->headerSize < sizeof(ProfileFileHeader) ||
+        header->fileSize > size || header->headerSize > header->fileSize)
+      return false;
+    if (!sectionFits(header->treesOffset, header->nTrees,
+                     sizeof(ProfileTreeRecord)) ||
+        !sectionFits(header->nodesOffset, header->nNodes,
+                     sizeof(ProfileNodeRecord)) ||
+        !sectionFits(header->childsOffset, header->nChilds, sizeof(uint32_t)) ||
+        !sectionFits(header->samplesOffset, header->nSamples,
+                     sizeof(ProfileSampleRecord)))
+      return false;
+    if (header->nStrings == UINT64_MAX ||
+        !sectionFits(header->stringOffsetsOffset, header->nStrings + 1,
+                     sizeof(uint64_t)) ||
+        !sectionFits(header->stringDataOffset, 0, 1))
+      return false;
+    // offsets[nStrings] is the size of the string data
+    uint64_t dataSize =
+        table<uint64_t>(header->stringOffsetsOffset)[header->nStrings];
+    if (dataSize > header->fileSize - header->stringDataOffset ||
+        (dataSize && base[header->stringDataOffset + dataSize - 1] != 0))
+      return false;
+    stringDataSize = dataSize;
+    return true;
+  }
+
+  const uint8_t *base;
+  size_t size;
+  const ProfileFileHeader *header;
+  uint64_t stringDataSize;
+};
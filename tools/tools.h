@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -9,6 +10,7 @@
 #include <grpcpp/grpcpp.h>
 
 #include "cpp-gen/gpu_profiling.grpc.pb.h"
+#include "profile_file.h"
 
 using grpc::Channel;
 using grpc::ClientContext;
@@ -30,6 +32,15 @@ typedef enum {
 	PARSE_SUCCESS = 0x7fffffff
 } ParseSassStatus;
 
+// resolve the function name of a cct node, responses dumped before the string
+// table was introduced carry the name inline
+static const std::string& GetCCTNodeFuncName(const GPUProfilingResponse& response,
+											 const CPUCallingContextNode& node) {
+	if (node.funcname().size() || node.funcnameid() >= (uint32_t)response.stringtable_size())
+		return node.funcname();
+	return response.stringtable(node.funcnameid());
+}
+
 static void PrintSamplingResults(GPUProfilingResponse response) {
 	std::cout << "pc sampling data size: " << response.pcsamplingdata_size() << std::endl;
 	auto pcSamplingData = response.pcsamplingdata();
@@ -80,7 +91,7 @@ static void PrintSamplingResults(GPUProfilingResponse response) {
 			while (!nodeQueue.empty()) {
 				CPUCallingContextNode node = nodeQueue.front();
 				printf("[CCTNode] id=%lu, pc=%p, offset=%lu, samples=%lu, funcName=%s, nchilds=%d, childs=", \
-					node.id(), (void *)node.pc(), node.offset(), node.samples(), node.funcname().c_str(), node.childpcs_size());
+					node.id(), (void *)node.pc(), node.offset(), node.samples(), GetCCTNodeFuncName(response, node).c_str(), node.childpcs_size());
 				for (auto childid: node.childids()) {
 					printf("%lu,", childid);
 					nodeQueue.push(CCT.nodemap().at(childid));
@@ -106,15 +117,189 @@ static bool DumpSamplingResults(GPUProfilingResponse response, std::string filen
 	return false;
 }
 
+// Load a file dumped by DumpSamplingResultsMmap into a response. Names are
+// kept as indices into the string table, and every GPU sample record comes
+// back as a pc of one CUptiPCSamplingData, consecutive records of the same pc
+// as its stall reasons.
+static bool LoadSamplingResultsMmap(GPUProfilingResponse& response, std::string filename) {
+	ProfileFileReader reader;
+	if (!reader.open(filename))
+		return false;
+	const ProfileFileHeader* header = reader.getHeader();
+	response.Clear();
+	response.set_epoch(header->epoch);
+	for (uint64_t i = 0; i < header->nStrings; ++i)
+		response.add_stringtable(reader.getString(i));
+
+	std::vector<CPUCallingContextTree*> trees;
+	for (uint64_t i = 0; i < reader.getNTrees(); ++i) {
+		CPUCallingContextTree* tree = response.add_cpucallingctxtree();
+		tree->set_rootid(reader.getTree(i)->rootId);
+		tree->set_rootpc(reader.getTree(i)->rootPC);
+		trees.push_back(tree);
+	}
+	for (uint64_t idx = 0; idx < reader.getNNodes(); ++idx) {
+		const ProfileNodeRecord* record = reader.getNodeByIdx(idx);
+		if (record->treeIdx >= trees.size())
+			continue;
+		CPUCallingContextNode& node = (*trees[record->treeIdx]->mutable_nodemap())[record->id];
+		node.set_id(record->id);
+		node.set_pc(record->pc);
+		node.set_offset(record->offset);
+		node.set_parentid(record->parentId);
+		const ProfileNodeRecord* parent = reader.getNode(record->parentId);
+		node.set_parentpc(parent ? parent->pc : 0);
+		node.set_samples(record->samples);
+		node.set_funcnameid(record->funcNameId);
+		reader.forEachChild(record, [&node](const ProfileNodeRecord* child) {
+			node.add_childids(child->id);
+			node.add_childpcs(child->pc);
+		});
+	}
+
+	if (header->nSamples) {
+		CUptiPCSamplingData* data = response.add_pcsamplingdata();
+		const ProfileSampleRecord* begin = reader.getSamples(0).first;
+		const ProfileSampleRecord* prev = nullptr;
+		CUptiPCSamplingPCData* pcData = nullptr;
+		for (const ProfileSampleRecord* sample = begin; sample != begin + header->nSamples; ++sample) {
+			if (!prev || prev->parentId != sample->parentId || prev->cubinCrc != sample->cubinCrc ||
+				prev->pcOffset != sample->pcOffset || prev->functionNameId != sample->functionNameId ||
+				prev->correlationId != sample->correlationId) {
+				pcData = data->add_ppcdata();
+				pcData->set_parentcpupcid(sample->parentId);
+				pcData->set_cubincrc(sample->cubinCrc);
+				pcData->set_pcoffset(sample->pcOffset);
+				pcData->set_functionname(reader.getString(sample->functionNameId));
+				pcData->set_correlationid(sample->correlationId);
+			}
+			PCSamplingStallReason* stallReason = pcData->add_stallreason();
+			stallReason->set_pcsamplingstallreasonindex(sample->stallReasonIndex);
+			stallReason->set_samples(sample->samples);
+			pcData->set_stallreasoncount(pcData->stallreason_size());
+			data->set_totalsamples(data->totalsamples() + sample->samples);
+			prev = sample;
+		}
+		data->set_totalnumpcs(data->ppcdata_size());
+	}
+	return true;
+}
+
+// Load a response dumped in either DUMP_FORMAT, told apart by the magic of
+// the profile file format
 static bool LoadSamplingResults(GPUProfilingResponse& response, std::string filename) {
 	std::ifstream fin;
 	fin.open(filename, std::ios::in | std::ios::binary);
 	if (fin.is_open()) {
+		char magic[sizeof(PROFILE_FILE_MAGIC)] = {};
+		fin.read(magic, sizeof(magic));
+		if (fin.gcount() == sizeof(magic) && !memcmp(magic, PROFILE_FILE_MAGIC, sizeof(magic)))
+			return LoadSamplingResultsMmap(response, filename);
+		fin.clear();
+		fin.seekg(0);
 		return response.ParseFromIstream(&fin);
 	}
 	return false;
 }
 
+// Dump the response in the mmap-able profile file format, see profile_file.h
+static bool DumpSamplingResultsMmap(const GPUProfilingResponse& response, std::string filename) {
+	ProfileFileWriter writer;
+	writer.setEpoch(response.epoch());
+	for (auto& tree: response.cpucallingctxtree()) {
+		uint32_t treeIdx = writer.addTree(tree.rootid(), tree.rootpc());
+		for (auto& kv: tree.nodemap()) {
+			auto& node = kv.second;
+			std::vector<uint64_t> childIds(node.childids().begin(), node.childids().end());
+			writer.addNode(treeIdx, node.id(), node.pc(), node.offset(), node.parentid(), node.samples(),
+						   writer.addString(GetCCTNodeFuncName(response, node)), childIds);
+		}
+	}
+	for (auto& data: response.pcsamplingdata()) {
+		for (auto& pcData: data.ppcdata()) {
+			ProfileSampleRecord sample;
+			memset(&sample, 0, sizeof(sample));
+			sample.parentId = pcData.parentcpupcid();
+			sample.cubinCrc = pcData.cubincrc();
+			sample.pcOffset = pcData.pcoffset();
+			sample.functionNameId = writer.addString(pcData.functionname());
+			sample.correlationId = pcData.correlationid();
+			for (auto& stallReason: pcData.stallreason()) {
+				sample.stallReasonIndex = stallReason.pcsamplingstallreasonindex();
+				sample.samples = stallReason.samples();
+				writer.addSample(sample);
+			}
+		}
+	}
+	std::cout << "dumping response to " << filename << std::endl;
+	return writer.write(filename);
+}
+
+// Patch the ccts of base with a delta, i.e., a response to a request with
+// sinceEpoch set. Nodes of the delta replace the nodes with the same id in base
+// and new nodes are linked to their parents. GPU pc samples are appended.
+static void MergeCCTDelta(GPUProfilingResponse& base, const GPUProfilingResponse& delta) {
+	// names are indices into the string table of their own response
+	if (base.stringtable_size() == 0)
+		base.add_stringtable("");
+	std::unordered_map<std::string, uint32_t> string2Index;
+	for (int i = 0; i < base.stringtable_size(); ++i)
+		string2Index.insert({base.stringtable(i), i});
+	auto getIndex = [&](const std::string& str) {
+		auto itr = string2Index.find(str);
+		if (itr != string2Index.end())
+			return itr->second;
+		uint32_t index = base.stringtable_size();
+		base.add_stringtable(str);
+		string2Index.insert({str, index});
+		return index;
+	};
+
+	std::unordered_map<uint64_t, CPUCallingContextTree*> rootId2Tree;
+	for (auto& tree: *base.mutable_cpucallingctxtree())
+		rootId2Tree[tree.rootid()] = &tree;
+
+	for (auto& deltaTree: delta.cpucallingctxtree()) {
+		CPUCallingContextTree* tree;
+		auto itr = rootId2Tree.find(deltaTree.rootid());
+		if (itr != rootId2Tree.end()) {
+			tree = itr->second;
+		} else {
+			tree = base.add_cpucallingctxtree();
+			tree->set_rootid(deltaTree.rootid());
+			tree->set_rootpc(deltaTree.rootpc());
+			rootId2Tree[tree->rootid()] = tree;
+		}
+
+		auto nodeMap = tree->mutable_nodemap();
+		for (auto& kv: deltaTree.nodemap()) {
+			CPUCallingContextNode& node = (*nodeMap)[kv.first];
+			node = kv.second;
+			node.clear_funcname();
+			node.set_funcnameid(getIndex(GetCCTNodeFuncName(delta, kv.second)));
+		}
+
+		// parents that did not change in the delta miss their new children
+		for (auto& kv: deltaTree.nodemap()) {
+			if (kv.first == tree->rootid())
+				continue;
+			auto parentItr = nodeMap->find(kv.second.parentid());
+			if (parentItr == nodeMap->end())
+				continue;
+			CPUCallingContextNode& parent = parentItr->second;
+			if (std::find(parent.childids().begin(), parent.childids().end(), kv.first) ==
+				parent.childids().end()) {
+				parent.add_childids(kv.first);
+				parent.add_childpcs(kv.second.pc());
+			}
+		}
+	}
+
+	for (auto& data: delta.pcsamplingdata())
+		base.add_pcsamplingdata()->CopyFrom(data);
+	base.set_epoch(delta.epoch());
+}
+
 bool DumpGraph2File(GPUCallingGraph* graph, std::string filename) {
 	std::ofstream fout;
 	fout.open(filename, std::ios::out | std::ios::binary);
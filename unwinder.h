@@ -0,0 +1,181 @@
+#pragma once
+#include <algorithm>
+#include <cxxabi.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+#include <libunwind.h>
+
+#include "common.h"
+#include "elf_symbolizer.h"
+
+#define MAX_UNWIND_DEPTH 512
+
+// Walks the native call stack of the calling thread. Backends:
+//   cursor:    libunwind cursor stepping, full DWARF unwinding, frames named
+//              by unw_get_proc_name (default)
+//   backtrace: unw_backtrace with per-thread caching of the unwind info
+//   fp:        frame pointer chain, only complete for code built with
+//              -fno-omit-frame-pointer
+class Unwinder {
+public:
+  virtual ~Unwinder(){};
+
+  // Store up to maxDepth return addresses in pcs, innermost first, and return
+  // how many were stored. pcs[0] is in the caller of unwind, after dropping
+  // the skip innermost frames.
+  virtual size_t unwind(uint64_t *pcs, size_t maxDepth, size_t skip = 0) = 0;
+
+  // nullptr for an unknown backend
+  static Unwinder *GetUnwinder(const std::string &name);
+};
+
+class CursorUnwinder : public Unwinder {
+public:
+  // nameFrames names the frames missing from the pc symbol cache with
+  // unw_get_proc_name while the cursor is on them, so that ResolvePCSymbol
+  // finds the names libunwind gives rather than those of the ELF symbolizer
+  explicit CursorUnwinder(bool _nameFrames = false)
+      : nameFrames(_nameFrames) {}
+
+  __attribute__((noinline)) size_t unwind(uint64_t *pcs, size_t maxDepth,
+                                          size_t skip = 0) override {
+    unw_cursor_t cursor;
+    unw_context_t context;
+    unw_getcontext(&context);
+    unw_init_local(&cursor, &context);
+    size_t depth = 0;
+    while (depth < maxDepth && unw_step(&cursor) > 0) {
+      unw_word_t pc;
+      unw_get_reg(&cursor, UNW_REG_IP, &pc);
+      if (skip) {
+        --skip;
+        continue;
+      }
+      if (nameFrames)
+        NameFrame(&cursor, pc);
+      pcs[depth++] = pc;
+    }
+    return depth;
+  }
+
+private:
+  static void NameFrame(unw_cursor_t *cursor, uint64_t pc) {
+    PCSymbolCache *cache = PCSymbolCache::GetPCSymbolCache();
+    // excluded frames are dropped unnamed
+    if (cache->contains(pc) ||
+        ModuleFilter::GetModuleFilter()->isExcluded(pc))
+      return;
+    char fname[FUNC_NAME_LENGTH];
+    unw_word_t offset = 0;
+    fname[0] = '\0';
+    // a truncated name is still usable, unknown frames are left to the ELF
+    // symbolizer
+    int ret = unw_get_proc_name(cursor, fname, sizeof(fname), &offset);
+    if (ret != 0 && ret != -UNW_ENOMEM)
+      return;
+    int status = 99;
+    char *demangled = abi::__cxa_demangle(fname, nullptr, nullptr, &status);
+    ElfSymbolizer *symbolizer = ElfSymbolizer::GetElfSymbolizer();
+    PCSymbol symbol;
+    symbol.funcNameId = InternSymbol(demangled ? demangled : fname);
+    symbol.offset = offset;
+    symbol.excluded = false;
+    symbol.pyEval = symbolizer->isPyEvalPC(pc);
+    free(demangled);
+    cache->insert(pc, symbol);
+  }
+
+  bool nameFrames;
+};
+
+class BacktraceUnwinder : public Unwinder {
+public:
+  BacktraceUnwinder() {
+    unw_set_caching_policy(unw_local_addr_space, UNW_CACHE_PER_THREAD);
+  }
+
+  __attribute__((noinline)) size_t unwind(uint64_t *pcs, size_t maxDepth,
+                                          size_t skip = 0) override {
+    void *buffer[MAX_UNWIND_DEPTH + 1];
+    // the first address is in this function
+    int n = unw_backtrace(buffer, std::min<size_t>(maxDepth + skip + 1,
+                                                   MAX_UNWIND_DEPTH + 1));
+    size_t depth = 0;
+    for (int i = skip + 1; i < n; ++i)
+      pcs[depth++] = (uint64_t)buffer[i];
+    return depth;
+  }
+};
+
+class FramePointerUnwinder : public Unwinder {
+public:
+  __attribute__((noinline)) size_t unwind(uint64_t *pcs, size_t maxDepth,
+                                          size_t skip = 0) override {
+    static thread_local uint64_t stackLow = 0, stackHigh = 0;
+    if (!stackHigh)
+      GetStackBounds(stackLow, stackHigh);
+    size_t depth = 0;
+    // a frame holds the frame of its caller and the return address
+    uint64_t *fp = (uint64_t *)__builtin_frame_address(0);
+    while (depth < maxDepth && (uint64_t)fp >= stackLow &&
+           (uint64_t)fp + 2 * sizeof(uint64_t) <= stackHigh &&
+           !((uint64_t)fp & (sizeof(uint64_t) - 1))) {
+      uint64_t pc = fp[1];
+      uint64_t *next = (uint64_t *)fp[0];
+      if (!pc)
+        break;
+      if (skip)
+        --skip;
+      else
+        pcs[depth++] = pc;
+      // the stack grows down, callers are above
+      if (next <= fp)
+        break;
+      fp = next;
+    }
+    return depth;
+  }
+
+private:
+  static void GetStackBounds(uint64_t &low, uint64_t &high) {
+    pthread_attr_t attr;
+    void *addr = nullptr;
+    size_t size = 0;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+      pthread_attr_getstack(&attr, &addr, &size);
+      pthread_attr_destroy(&attr);
+    }
+    low = (uint64_t)addr;
+    high = low + size;
+  }
+};
+
+inline Unwinder *Unwinder::GetUnwinder(const std::string &name) {
+  if (name == "cursor") {
+    static Unwinder *unwinder = new CursorUnwinder();
+    return unwinder;
+  }
+  if (name == "backtrace") {
+    static Unwinder *unwinder = new BacktraceUnwinder();
+    return unwinder;
+  }
+  if (name == "fp") {
+    static Unwinder *unwinder = new FramePointerUnwinder();
+    return unwinder;
+  }
+  return nullptr;
+}
+
+// the backend selected by ProfilerConf. The cursor backend names frames with
+// libunwind, unless symbolization is deferred to export.
+static inline Unwinder *GetUnwinder() {
+  ProfilerConf *conf = GetProfilerConf();
+  if (conf->unwinder == "cursor" && !conf->deferSymbolization) {
+    static Unwinder *unwinder = new CursorUnwinder(true);
+    return unwinder;
+  }
+  return Unwinder::GetUnwinder(conf->unwinder);
+}
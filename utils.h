@@ -3,9 +3,12 @@
 #include <sys/time.h>
 #include <unordered_map>
 
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <string>
+#include <thread>
+#include <vector>
 
 class Timer {
 public:
@@ -61,3 +64,20 @@ private:
   int64_t accumulated;
   int64_t elapsed;
 };
+
+// Run f(i) for every i in [0, n) on up to nWorkers threads, the calling thread
+// included. Workers take the next index from a shared counter, so uneven
+// tasks are balanced.
+template <typename F> void ParallelFor(size_t n, uint32_t nWorkers, F f) {
+  std::atomic<size_t> next(0);
+  auto worker = [&next, n, &f]() {
+    for (size_t i = next.fetch_add(1); i < n; i = next.fetch_add(1))
+      f(i);
+  };
+  std::vector<std::thread> workers;
+  for (uint32_t w = 1; w < nWorkers && w < n; ++w)
+    workers.emplace_back(worker);
+  worker();
+  for (auto &t : workers)
+    t.join();
+}